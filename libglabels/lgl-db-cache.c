@@ -0,0 +1,913 @@
+/*
+ *  lgl-db-cache.c
+ *  Copyright (C) 2026  gLabels contributors.
+ *
+ *  This file is part of libglabels.
+ *
+ *  libglabels is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libglabels is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with libglabels.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "lgl-db-cache.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libglabels-private.h"
+
+#include "lgl-paper.h"
+#include "lgl-category.h"
+#include "lgl-vendor.h"
+#include "lgl-template.h"
+
+
+/*===========================================*/
+/* Private macros and constants.             */
+/*===========================================*/
+
+/*
+ * The cache file is a header, a data section and a string table.  The data
+ * section is a sequence of 32 and 64 bit numbers and doubles, in the byte
+ * order of the machine that wrote it.  Strings are given by their offset in
+ * the string table plus one, 0 being NULL; the string table holds each
+ * distinct string once, NUL terminated.
+ *
+ * The data section starts with a key, identifying the library version and
+ * languages of translated names, and the stamps (name, modification time and
+ * size) of the source directories and their files.  Then follow the papers,
+ * categories, vendors and templates, each list preceded by its length.
+ */
+#define CACHE_FILENAME    g_build_filename (g_get_user_cache_dir (), "libglabels", "template-db.cache", NULL)
+
+#define CACHE_MAGIC       "LGLDBC\0\1"
+#define CACHE_BYTE_ORDER  0x01020304
+
+
+/*===========================================*/
+/* Private types                             */
+/*===========================================*/
+
+typedef struct {
+        gchar    magic[8];
+        guint32  byte_order;
+        guint32  data_offset;
+        guint32  data_size;
+        guint32  strings_offset;
+        guint32  strings_size;
+} CacheHeader;
+
+typedef struct {
+        GString     *data;
+        GString     *strings;
+        GHashTable  *string_offsets;
+} Writer;
+
+typedef struct {
+        const gchar *p;
+        const gchar *end;
+        const gchar *strings;
+        gsize        strings_size;
+        gboolean     ok;
+} Reader;
+
+
+/*===========================================*/
+/* Local function prototypes                 */
+/*===========================================*/
+
+static gchar       *cache_key          (void);
+
+static GPtrArray   *source_stamps      (const gchar * const  *dirnames);
+
+static void         add_stamp          (GPtrArray            *stamps,
+                                        const gchar          *filename);
+
+static gint         compare_names      (gconstpointer         a,
+                                        gconstpointer         b);
+
+static void         write_u32          (Writer               *w,
+                                        guint32               value);
+static void         write_i64          (Writer               *w,
+                                        gint64                value);
+static void         write_double       (Writer               *w,
+                                        gdouble               value);
+static void         write_string       (Writer               *w,
+                                        const gchar          *string);
+static void         write_template     (Writer               *w,
+                                        const lglTemplate    *template);
+static void         write_frame        (Writer               *w,
+                                        const lglTemplateFrame *frame);
+static void         write_markup       (Writer               *w,
+                                        const lglTemplateMarkup *markup);
+
+static guint32      read_u32           (Reader               *r);
+static gint64       read_i64           (Reader               *r);
+static gdouble      read_double        (Reader               *r);
+static const gchar *read_string        (Reader               *r);
+static lglTemplate *read_template      (Reader               *r);
+static lglTemplateFrame  *read_frame   (Reader               *r);
+static lglTemplateMarkup *read_markup  (Reader               *r);
+
+
+/*===========================================*/
+/* Functions.                                */
+/*===========================================*/
+
+/*****************************************************************************/
+/* Load database from cache, if the cache is valid.                          */
+/*                                                                           */
+/* The cache file is mapped, and structures are built directly from it, each */
+/* string copied once from the string table.  Returns FALSE, leaving the     */
+/* lists unset, if there is no valid cache for the current sources.          */
+/*****************************************************************************/
+gboolean
+_lgl_db_cache_load (const gchar * const  *dirnames,
+                    GList               **papers,
+                    GList               **categories,
+                    GList               **vendors,
+                    GList               **templates)
+{
+        gchar             *filename, *key;
+        GMappedFile       *file;
+        const gchar       *contents;
+        gsize              length;
+        const CacheHeader *header;
+        Reader             r;
+        GPtrArray         *stamps;
+        guint              i, n;
+        const gchar       *s;
+        lglPaper          *paper;
+        lglCategory       *category;
+        lglVendor         *vendor;
+        lglTemplate       *template;
+        GList             *new_papers = NULL, *new_categories = NULL;
+        GList             *new_vendors = NULL, *new_templates = NULL;
+
+        filename = CACHE_FILENAME;
+        file     = g_mapped_file_new (filename, FALSE, NULL);
+        g_free (filename);
+        if (file == NULL)
+        {
+                return FALSE;
+        }
+
+        contents = g_mapped_file_get_contents (file);
+        length   = g_mapped_file_get_length (file);
+
+        header = (const CacheHeader *)contents;
+        if ( (length < sizeof (CacheHeader)) ||
+             memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) ||
+             (header->byte_order != CACHE_BYTE_ORDER) ||
+             (header->data_offset > length) ||
+             (header->data_size > length - header->data_offset) ||
+             (header->strings_offset > length) ||
+             (header->strings_size > length - header->strings_offset) ||
+             (header->strings_size == 0) ||
+             (contents[header->strings_offset + header->strings_size - 1] != '\0') )
+        {
+                g_mapped_file_unref (file);
+                return FALSE;
+        }
+
+        r.p            = contents + header->data_offset;
+        r.end          = r.p + header->data_size;
+        r.strings      = contents + header->strings_offset;
+        r.strings_size = header->strings_size;
+        r.ok           = TRUE;
+
+        /* Check key and stamps of sources. */
+        key = cache_key ();
+        s   = read_string (&r);
+        r.ok = r.ok && (g_strcmp0 (s, key) == 0);
+        g_free (key);
+
+        stamps = source_stamps (dirnames);
+        n      = read_u32 (&r);
+        r.ok   = r.ok && (n == stamps->len / 3);
+        for (i = 0; r.ok && (i < n); i++)
+        {
+                s    = read_string (&r);
+                r.ok = r.ok && (g_strcmp0 (s, g_ptr_array_index (stamps, 3*i)) == 0);
+                r.ok = r.ok && (read_i64 (&r) == *(gint64 *)g_ptr_array_index (stamps, 3*i + 1));
+                r.ok = r.ok && (read_i64 (&r) == *(gint64 *)g_ptr_array_index (stamps, 3*i + 2));
+        }
+        g_ptr_array_free (stamps, TRUE);
+
+        /* Papers. */
+        n = r.ok ? read_u32 (&r) : 0;
+        for (i = 0; r.ok && (i < n); i++)
+        {
+                paper           = g_new0 (lglPaper, 1);
+                paper->id       = g_strdup (read_string (&r));
+                paper->name     = g_strdup (read_string (&r));
+                paper->width    = read_double (&r);
+                paper->height   = read_double (&r);
+                paper->pwg_size = g_strdup (read_string (&r));
+                new_papers = g_list_prepend (new_papers, paper);
+        }
+
+        /* Categories. */
+        n = r.ok ? read_u32 (&r) : 0;
+        for (i = 0; r.ok && (i < n); i++)
+        {
+                category       = g_new0 (lglCategory, 1);
+                category->id   = g_strdup (read_string (&r));
+                category->name = g_strdup (read_string (&r));
+                new_categories = g_list_prepend (new_categories, category);
+        }
+
+        /* Vendors. */
+        n = r.ok ? read_u32 (&r) : 0;
+        for (i = 0; r.ok && (i < n); i++)
+        {
+                vendor       = g_new0 (lglVendor, 1);
+                vendor->name = g_strdup (read_string (&r));
+                vendor->url  = g_strdup (read_string (&r));
+                new_vendors = g_list_prepend (new_vendors, vendor);
+        }
+
+        /* Templates. */
+        n = r.ok ? read_u32 (&r) : 0;
+        for (i = 0; r.ok && (i < n); i++)
+        {
+                template = read_template (&r);
+                new_templates = g_list_prepend (new_templates, template);
+        }
+
+        g_mapped_file_unref (file);
+
+        if (!r.ok)
+        {
+                g_list_free_full (new_papers, (GDestroyNotify)lgl_paper_free);
+                g_list_free_full (new_categories, (GDestroyNotify)lgl_category_free);
+                g_list_free_full (new_vendors, (GDestroyNotify)lgl_vendor_free);
+                g_list_free_full (new_templates, (GDestroyNotify)lgl_template_free);
+                return FALSE;
+        }
+
+        *papers     = g_list_reverse (new_papers);
+        *categories = g_list_reverse (new_categories);
+        *vendors    = g_list_reverse (new_vendors);
+        *templates  = g_list_reverse (new_templates);
+
+        return TRUE;
+}
+
+
+/*****************************************************************************/
+/* Save database to cache.                                                   */
+/*                                                                           */
+/* The cache is written to a temporary file and renamed into place, so that  */
+/* readers never see a partial cache.  Failures are silently ignored; the    */
+/* database is then simply read from its sources next time.                  */
+/*****************************************************************************/
+void
+_lgl_db_cache_save (const gchar * const  *dirnames,
+                    GList                *papers,
+                    GList                *categories,
+                    GList                *vendors,
+                    GList                *templates)
+{
+        Writer       w;
+        CacheHeader  header;
+        GString     *contents;
+        GPtrArray   *stamps;
+        gchar       *key, *filename, *dirname;
+        GList       *p;
+        guint        i;
+        lglPaper    *paper;
+        lglCategory *category;
+        lglVendor   *vendor;
+
+        w.data           = g_string_new (NULL);
+        w.strings        = g_string_new (NULL);
+        w.string_offsets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        key = cache_key ();
+        write_string (&w, key);
+
+        stamps = source_stamps (dirnames);
+        write_u32 (&w, stamps->len / 3);
+        for (i = 0; i < stamps->len; i += 3)
+        {
+                write_string (&w, g_ptr_array_index (stamps, i));
+                write_i64 (&w, *(gint64 *)g_ptr_array_index (stamps, i + 1));
+                write_i64 (&w, *(gint64 *)g_ptr_array_index (stamps, i + 2));
+        }
+
+        write_u32 (&w, g_list_length (papers));
+        for (p = papers; p != NULL; p = p->next)
+        {
+                paper = p->data;
+                write_string (&w, paper->id);
+                write_string (&w, paper->name);
+                write_double (&w, paper->width);
+                write_double (&w, paper->height);
+                write_string (&w, paper->pwg_size);
+        }
+
+        write_u32 (&w, g_list_length (categories));
+        for (p = categories; p != NULL; p = p->next)
+        {
+                category = p->data;
+                write_string (&w, category->id);
+                write_string (&w, category->name);
+        }
+
+        write_u32 (&w, g_list_length (vendors));
+        for (p = vendors; p != NULL; p = p->next)
+        {
+                vendor = p->data;
+                write_string (&w, vendor->name);
+                write_string (&w, vendor->url);
+        }
+
+        write_u32 (&w, g_list_length (templates));
+        for (p = templates; p != NULL; p = p->next)
+        {
+                write_template (&w, p->data);
+        }
+
+        /* The string table always ends with a NUL, even if empty. */
+        g_string_append_c (w.strings, '\0');
+
+        memset (&header, 0, sizeof (header));
+        memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+        header.byte_order     = CACHE_BYTE_ORDER;
+        header.data_offset    = sizeof (header);
+        header.data_size      = w.data->len;
+        header.strings_offset = header.data_offset + header.data_size;
+        header.strings_size   = w.strings->len;
+
+        contents = g_string_new_len ((const gchar *)&header, sizeof (header));
+        g_string_append_len (contents, w.data->str, w.data->len);
+        g_string_append_len (contents, w.strings->str, w.strings->len);
+
+        filename = CACHE_FILENAME;
+        dirname  = g_path_get_dirname (filename);
+        g_mkdir_with_parents (dirname, 0775);
+        g_file_set_contents (filename, contents->str, contents->len, NULL);
+        g_free (dirname);
+        g_free (filename);
+
+        g_string_free (contents, TRUE);
+        g_ptr_array_free (stamps, TRUE);
+        g_free (key);
+        g_hash_table_destroy (w.string_offsets);
+        g_string_free (w.strings, TRUE);
+        g_string_free (w.data, TRUE);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Key of cache: library version and languages of translations.    */
+/*---------------------------------------------------------------------------*/
+static gchar *
+cache_key (void)
+{
+        gchar *languages, *key;
+
+        languages = g_strjoinv (":", (gchar **)g_get_language_names ());
+        key       = g_strdup_printf ("%s %s", PACKAGE_VERSION, languages);
+        g_free (languages);
+
+        return key;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Stamps of directories and their data files.                     */
+/*                                                                           */
+/* Returns array of (name, mtime, size) triples, in a stable order.          */
+/*---------------------------------------------------------------------------*/
+static GPtrArray *
+source_stamps (const gchar * const *dirnames)
+{
+        GPtrArray   *stamps;
+        GPtrArray   *names;
+        GDir        *dp;
+        const gchar *name;
+        gchar       *filename;
+        guint        i, j;
+
+        stamps = g_ptr_array_new_with_free_func (g_free);
+
+        for (i = 0; dirnames[i] != NULL; i++)
+        {
+                add_stamp (stamps, dirnames[i]);
+
+                dp = g_dir_open (dirnames[i], 0, NULL);
+                if (dp == NULL)
+                {
+                        continue;
+                }
+
+                names = g_ptr_array_new_with_free_func (g_free);
+                while ((name = g_dir_read_name (dp)) != NULL)
+                {
+                        if (g_str_has_suffix (name, ".xml") || g_str_has_suffix (name, ".template"))
+                        {
+                                g_ptr_array_add (names, g_strdup (name));
+                        }
+                }
+                g_dir_close (dp);
+
+                g_ptr_array_sort (names, compare_names);
+
+                for (j = 0; j < names->len; j++)
+                {
+                        filename = g_build_filename (dirnames[i], g_ptr_array_index (names, j), NULL);
+                        add_stamp (stamps, filename);
+                        g_free (filename);
+                }
+                g_ptr_array_free (names, TRUE);
+        }
+
+        return stamps;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Add stamp of file to array, a time of -1 if it does not exist.  */
+/*---------------------------------------------------------------------------*/
+static void
+add_stamp (GPtrArray   *stamps,
+           const gchar *filename)
+{
+        GStatBuf  st;
+        gint64   *mtime, *size;
+
+        mtime = g_new (gint64, 1);
+        size  = g_new (gint64, 1);
+
+        if (g_stat (filename, &st) == 0)
+        {
+                *mtime = st.st_mtime;
+                *size  = S_ISDIR (st.st_mode) ? 0 : st.st_size;
+        }
+        else
+        {
+                *mtime = -1;
+                *size  = 0;
+        }
+
+        g_ptr_array_add (stamps, g_strdup (filename));
+        g_ptr_array_add (stamps, mtime);
+        g_ptr_array_add (stamps, size);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Compare elements of array of names.                             */
+/*---------------------------------------------------------------------------*/
+static gint
+compare_names (gconstpointer a,
+               gconstpointer b)
+{
+        return strcmp (*(const gchar **)a, *(const gchar **)b);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Writers.                                                        */
+/*---------------------------------------------------------------------------*/
+static void
+write_u32 (Writer  *w,
+           guint32  value)
+{
+        g_string_append_len (w->data, (const gchar *)&value, sizeof (value));
+}
+
+
+static void
+write_i64 (Writer  *w,
+           gint64   value)
+{
+        g_string_append_len (w->data, (const gchar *)&value, sizeof (value));
+}
+
+
+static void
+write_double (Writer  *w,
+              gdouble  value)
+{
+        g_string_append_len (w->data, (const gchar *)&value, sizeof (value));
+}
+
+
+static void
+write_string (Writer      *w,
+              const gchar *string)
+{
+        gpointer offset;
+
+        if (string == NULL)
+        {
+                write_u32 (w, 0);
+                return;
+        }
+
+        if (!g_hash_table_lookup_extended (w->string_offsets, string, NULL, &offset))
+        {
+                offset = GUINT_TO_POINTER (w->strings->len + 1);
+                g_string_append_len (w->strings, string, strlen (string) + 1);
+                g_hash_table_insert (w->string_offsets, g_strdup (string), offset);
+        }
+
+        write_u32 (w, GPOINTER_TO_UINT (offset));
+}
+
+
+static void
+write_template (Writer            *w,
+                const lglTemplate *template)
+{
+        GList *p;
+
+        write_string (w, template->brand);
+        write_string (w, template->part);
+        write_string (w, template->equiv_part);
+        write_string (w, template->description);
+        write_string (w, template->paper_id);
+        write_double (w, template->page_width);
+        write_double (w, template->page_height);
+        write_string (w, template->product_url);
+
+        write_u32 (w, g_list_length (template->category_ids));
+        for (p = template->category_ids; p != NULL; p = p->next)
+        {
+                write_string (w, p->data);
+        }
+
+        write_u32 (w, g_list_length (template->frames));
+        for (p = template->frames; p != NULL; p = p->next)
+        {
+                write_frame (w, p->data);
+        }
+}
+
+
+static void
+write_frame (Writer                 *w,
+             const lglTemplateFrame *frame)
+{
+        GList             *p;
+        lglTemplateLayout *layout;
+
+        write_u32 (w, frame->shape);
+        write_string (w, frame->all.id);
+
+        switch (frame->shape)
+        {
+        case LGL_TEMPLATE_FRAME_SHAPE_RECT:
+                write_double (w, frame->rect.w);
+                write_double (w, frame->rect.h);
+                write_double (w, frame->rect.r);
+                write_double (w, frame->rect.x_waste);
+                write_double (w, frame->rect.y_waste);
+                break;
+        case LGL_TEMPLATE_FRAME_SHAPE_ELLIPSE:
+                write_double (w, frame->ellipse.w);
+                write_double (w, frame->ellipse.h);
+                write_double (w, frame->ellipse.waste);
+                break;
+        case LGL_TEMPLATE_FRAME_SHAPE_ROUND:
+                write_double (w, frame->round.r);
+                write_double (w, frame->round.waste);
+                break;
+        case LGL_TEMPLATE_FRAME_SHAPE_CD:
+                write_double (w, frame->cd.r1);
+                write_double (w, frame->cd.r2);
+                write_double (w, frame->cd.w);
+                write_double (w, frame->cd.h);
+                write_double (w, frame->cd.waste);
+                break;
+        default:
+                break;
+        }
+
+        write_u32 (w, g_list_length (frame->all.layouts));
+        for (p = frame->all.layouts; p != NULL; p = p->next)
+        {
+                layout = p->data;
+                write_u32 (w, layout->nx);
+                write_u32 (w, layout->ny);
+                write_double (w, layout->x0);
+                write_double (w, layout->y0);
+                write_double (w, layout->dx);
+                write_double (w, layout->dy);
+        }
+
+        write_u32 (w, g_list_length (frame->all.markups));
+        for (p = frame->all.markups; p != NULL; p = p->next)
+        {
+                write_markup (w, p->data);
+        }
+}
+
+
+static void
+write_markup (Writer                  *w,
+              const lglTemplateMarkup *markup)
+{
+        write_u32 (w, markup->type);
+
+        switch (markup->type)
+        {
+        case LGL_TEMPLATE_MARKUP_MARGIN:
+                write_double (w, markup->margin.size);
+                break;
+        case LGL_TEMPLATE_MARKUP_LINE:
+                write_double (w, markup->line.x1);
+                write_double (w, markup->line.y1);
+                write_double (w, markup->line.x2);
+                write_double (w, markup->line.y2);
+                break;
+        case LGL_TEMPLATE_MARKUP_CIRCLE:
+                write_double (w, markup->circle.x0);
+                write_double (w, markup->circle.y0);
+                write_double (w, markup->circle.r);
+                break;
+        case LGL_TEMPLATE_MARKUP_RECT:
+                write_double (w, markup->rect.x1);
+                write_double (w, markup->rect.y1);
+                write_double (w, markup->rect.w);
+                write_double (w, markup->rect.h);
+                write_double (w, markup->rect.r);
+                break;
+        case LGL_TEMPLATE_MARKUP_ELLIPSE:
+                write_double (w, markup->ellipse.x1);
+                write_double (w, markup->ellipse.y1);
+                write_double (w, markup->ellipse.w);
+                write_double (w, markup->ellipse.h);
+                break;
+        default:
+                break;
+        }
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Readers.  Reading past the end clears r->ok and returns zero.   */
+/*---------------------------------------------------------------------------*/
+static guint32
+read_u32 (Reader *r)
+{
+        guint32 value = 0;
+
+        if (r->ok && (r->end - r->p >= (gssize)sizeof (value)))
+        {
+                memcpy (&value, r->p, sizeof (value));
+                r->p += sizeof (value);
+        }
+        else
+        {
+                r->ok = FALSE;
+        }
+
+        return value;
+}
+
+
+static gint64
+read_i64 (Reader *r)
+{
+        gint64 value = 0;
+
+        if (r->ok && (r->end - r->p >= (gssize)sizeof (value)))
+        {
+                memcpy (&value, r->p, sizeof (value));
+                r->p += sizeof (value);
+        }
+        else
+        {
+                r->ok = FALSE;
+        }
+
+        return value;
+}
+
+
+static gdouble
+read_double (Reader *r)
+{
+        gdouble value = 0.0;
+
+        if (r->ok && (r->end - r->p >= (gssize)sizeof (value)))
+        {
+                memcpy (&value, r->p, sizeof (value));
+                r->p += sizeof (value);
+        }
+        else
+        {
+                r->ok = FALSE;
+        }
+
+        return value;
+}
+
+
+static const gchar *
+read_string (Reader *r)
+{
+        guint32 offset;
+
+        offset = read_u32 (r);
+        if (offset == 0)
+        {
+                return NULL;
+        }
+        if (offset > r->strings_size)
+        {
+                r->ok = FALSE;
+                return NULL;
+        }
+
+        /* The table ends with a NUL, so the string ends within it. */
+        return r->strings + offset - 1;
+}
+
+
+static lglTemplate *
+read_template (Reader *r)
+{
+        lglTemplate      *template;
+        guint             i, n;
+        lglTemplateFrame *frame;
+
+        template = g_new0 (lglTemplate, 1);
+        template->ref_count = 1;
+
+        template->brand       = g_strdup (read_string (r));
+        template->part        = g_strdup (read_string (r));
+        template->equiv_part  = g_strdup (read_string (r));
+        template->description = g_strdup (read_string (r));
+        template->paper_id    = g_strdup (read_string (r));
+        template->page_width  = read_double (r);
+        template->page_height = read_double (r);
+        template->product_url = g_strdup (read_string (r));
+
+        n = read_u32 (r);
+        for (i = 0; r->ok && (i < n); i++)
+        {
+                template->category_ids = g_list_prepend (template->category_ids,
+                                                         g_strdup (read_string (r)));
+        }
+        template->category_ids = g_list_reverse (template->category_ids);
+
+        n = read_u32 (r);
+        for (i = 0; r->ok && (i < n); i++)
+        {
+                frame = read_frame (r);
+                if (frame != NULL)
+                {
+                        template->frames = g_list_prepend (template->frames, frame);
+                }
+        }
+        template->frames = g_list_reverse (template->frames);
+
+        return template;
+}
+
+
+static lglTemplateFrame *
+read_frame (Reader *r)
+{
+        lglTemplateFrame  *frame;
+        lglTemplateLayout *layout;
+        lglTemplateMarkup *markup;
+        guint              i, n;
+
+        frame = g_new0 (lglTemplateFrame, 1);
+
+        frame->shape  = read_u32 (r);
+        frame->all.id = g_strdup (read_string (r));
+
+        switch (frame->shape)
+        {
+        case LGL_TEMPLATE_FRAME_SHAPE_RECT:
+                frame->rect.w       = read_double (r);
+                frame->rect.h       = read_double (r);
+                frame->rect.r       = read_double (r);
+                frame->rect.x_waste = read_double (r);
+                frame->rect.y_waste = read_double (r);
+                break;
+        case LGL_TEMPLATE_FRAME_SHAPE_ELLIPSE:
+                frame->ellipse.w     = read_double (r);
+                frame->ellipse.h     = read_double (r);
+                frame->ellipse.waste = read_double (r);
+                break;
+        case LGL_TEMPLATE_FRAME_SHAPE_ROUND:
+                frame->round.r     = read_double (r);
+                frame->round.waste = read_double (r);
+                break;
+        case LGL_TEMPLATE_FRAME_SHAPE_CD:
+                frame->cd.r1    = read_double (r);
+                frame->cd.r2    = read_double (r);
+                frame->cd.w     = read_double (r);
+                frame->cd.h     = read_double (r);
+                frame->cd.waste = read_double (r);
+                break;
+        default:
+                r->ok = FALSE;
+                break;
+        }
+
+        n = read_u32 (r);
+        for (i = 0; r->ok && (i < n); i++)
+        {
+                layout = g_new0 (lglTemplateLayout, 1);
+                layout->nx = read_u32 (r);
+                layout->ny = read_u32 (r);
+                layout->x0 = read_double (r);
+                layout->y0 = read_double (r);
+                layout->dx = read_double (r);
+                layout->dy = read_double (r);
+                frame->all.layouts = g_list_prepend (frame->all.layouts, layout);
+        }
+        frame->all.layouts = g_list_reverse (frame->all.layouts);
+
+        n = read_u32 (r);
+        for (i = 0; r->ok && (i < n); i++)
+        {
+                markup = read_markup (r);
+                frame->all.markups = g_list_prepend (frame->all.markups, markup);
+        }
+        frame->all.markups = g_list_reverse (frame->all.markups);
+
+        return frame;
+}
+
+
+static lglTemplateMarkup *
+read_markup (Reader *r)
+{
+        lglTemplateMarkup *markup;
+
+        markup = g_new0 (lglTemplateMarkup, 1);
+
+        markup->type = read_u32 (r);
+
+        switch (markup->type)
+        {
+        case LGL_TEMPLATE_MARKUP_MARGIN:
+                markup->margin.size = read_double (r);
+                break;
+        case LGL_TEMPLATE_MARKUP_LINE:
+                markup->line.x1 = read_double (r);
+                markup->line.y1 = read_double (r);
+                markup->line.x2 = read_double (r);
+                markup->line.y2 = read_double (r);
+                break;
+        case LGL_TEMPLATE_MARKUP_CIRCLE:
+                markup->circle.x0 = read_double (r);
+                markup->circle.y0 = read_double (r);
+                markup->circle.r  = read_double (r);
+                break;
+        case LGL_TEMPLATE_MARKUP_RECT:
+                markup->rect.x1 = read_double (r);
+                markup->rect.y1 = read_double (r);
+                markup->rect.w  = read_double (r);
+                markup->rect.h  = read_double (r);
+                markup->rect.r  = read_double (r);
+                break;
+        case LGL_TEMPLATE_MARKUP_ELLIPSE:
+                markup->ellipse.x1 = read_double (r);
+                markup->ellipse.y1 = read_double (r);
+                markup->ellipse.w  = read_double (r);
+                markup->ellipse.h  = read_double (r);
+                break;
+        default:
+                r->ok = FALSE;
+                break;
+        }
+
+        return markup;
+}
+
+
+
+
+/*
+ * Local Variables:       -- emacs
+ * mode: C                -- emacs
+ * c-basic-offset: 8      -- emacs
+ * tab-width: 8           -- emacs
+ * indent-tabs-mode: nil  -- emacs
+ * End:                   -- emacs
+ */
@@ -0,0 +1,59 @@
+/*
+ *  lgl-db-cache.h
+ *  Copyright (C) 2026  gLabels contributors.
+ *
+ *  This file is part of libglabels.
+ *
+ *  libglabels is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libglabels is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with libglabels.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LGL_DB_CACHE_H__
+#define __LGL_DB_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Compiled cache of the template database (private to libglabels).
+ *
+ * dirnames is the NULL terminated list of directories the database is read
+ * from; the cache is only loaded while they and their files are unchanged.
+ */
+gboolean  _lgl_db_cache_load  (const gchar * const  *dirnames,
+                               GList               **papers,
+                               GList               **categories,
+                               GList               **vendors,
+                               GList               **templates);
+
+void      _lgl_db_cache_save  (const gchar * const  *dirnames,
+                               GList                *papers,
+                               GList                *categories,
+                               GList                *vendors,
+                               GList                *templates);
+
+G_END_DECLS
+
+#endif /* __LGL_DB_CACHE_H__ */
+
+
+
+/*
+ * Local Variables:       -- emacs
+ * mode: C                -- emacs
+ * c-basic-offset: 8      -- emacs
+ * tab-width: 8           -- emacs
+ * indent-tabs-mode: nil  -- emacs
+ * End:                   -- emacs
+ */
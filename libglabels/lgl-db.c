@@ -27,11 +27,13 @@
 #include <glib/gstdio.h>
 #include <glib-object.h>
 #include <string.h>
+#include <math.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include "libglabels-private.h"
 
+#include "lgl-db-cache.h"
 #include "lgl-xml-paper.h"
 #include "lgl-xml-category.h"
 #include "lgl-xml-vendor.h"
@@ -46,6 +48,9 @@
 #define USER_CONFIG_DIR       g_build_filename (g_get_user_config_dir (), "libglabels", "templates" , NULL)
 #define ALT_USER_CONFIG_DIR   g_build_filename (g_get_home_dir (), ".glabels", NULL)
 
+/* Grid of frame sizes in geometric signatures, the tolerance of lgl_template_are_templates_identical(). */
+#define SIGNATURE_GRID        0.5
+
 
 /*===========================================*/
 /* Private types                             */
@@ -63,15 +68,64 @@ typedef struct _lglDbModel          lglDbModel;
 typedef struct _lglDbModelClass     lglDbModelClass;
 
 
+/* Template file, as indexed by lgl_db_init_lazy(). */
+typedef struct {
+        gchar      *filename;
+        gboolean    user_flag;    /* In user template directory. */
+        gboolean    loaded_flag;
+} TemplateFile;
+
+
+/* Brand in secondary indexes. */
+typedef struct {
+        gchar        *brand;      /* Spelling of first template of brand. */
+        guint         rank;       /* Position in sorted list of brands. */
+        GArray       *ranks;      /* Ranks of templates of brand. */
+} BrandEntry;
+
+
+/* Template in secondary indexes. */
+typedef struct {
+        lglTemplate  *template;
+        gchar        *name;       /* "brand part" */
+        GBytes       *sort_key;   /* Sort key of name. */
+        guint         order;      /* Order of registration, to break ties. */
+        BrandEntry   *brand;
+} IndexEntry;
+
+
 struct _lglDbModel {
-        GObject     parent;
+        GObject       parent;
+
+        GList        *papers;
+        GList        *categories;
+        GList        *vendors;
+        GList        *templates;
+        GList        *templates_tail;
 
-        GList      *papers;
-        GList      *categories;
-        GList      *vendors;
-        GList      *templates;
+        /* Links of templates, by casefolded name and by casefolded brand and part. */
+        GHashTable   *template_names;
+        GHashTable   *template_brand_parts;
 
-        GHashTable *template_cache;
+        /*
+         * Secondary indexes, rebuilt on first query after a change.  Templates
+         * are ranked by name; the indexes map casefolded brands, paper ids
+         * and category ids, and geometric signatures, to ascending arrays of
+         * ranks.
+         */
+        gboolean      indexes_valid;
+        GPtrArray    *sorted_templates;
+        GPtrArray    *sorted_brands;
+        GHashTable   *brand_index;
+        GHashTable   *paper_index;
+        GHashTable   *category_index;
+        GHashTable   *signature_index;
+
+        /* Lazy loading: template files, and file of each casefolded name. */
+        GList        *template_files;
+        GHashTable   *template_index;
+        TemplateFile *loading_file;
+        gboolean      full_pages_flag;
 };
 
 
@@ -101,6 +155,17 @@ static guint signals[LAST_SIGNAL] = {0};
 
 static lglDbModel *model = NULL;
 
+/*
+ * Parts of the database loaded so far.  Loading is serialized by db_mutex,
+ * which is recursive because reading templates looks up papers and, for
+ * equivalent parts, other templates.
+ */
+static GRecMutex   db_mutex;
+static gint        papers_loaded     = FALSE;
+static gint        categories_loaded = FALSE;
+static gint        vendors_loaded    = FALSE;
+static gint        templates_loaded  = FALSE;
+
 
 /*===========================================*/
 /* Local function prototypes                 */
@@ -108,7 +173,44 @@ static lglDbModel *model = NULL;
 
 static void   lgl_db_model_finalize        (GObject     *object);
 
-static void   add_to_template_cache        (lglTemplate *template);
+static void   add_template                 (lglTemplate *template);
+static void   remove_template              (GList       *link);
+static void   clear_templates              (void);
+static GList *find_template                (const gchar *brand,
+                                            const gchar *part);
+static GList *find_template_name           (const gchar *name);
+static gchar *template_name_key            (const gchar *name);
+static gchar *template_brand_part_key      (const gchar *brand,
+                                            const gchar *part);
+
+static void   build_indexes                (void);
+static void   add_rank                     (GHashTable  *index,
+                                            gchar       *key,
+                                            guint        rank);
+static gboolean has_rank                   (GArray      *ranks,
+                                            guint        rank);
+static GArray *filter_templates            (const gchar *brand,
+                                            const gchar *paper_id,
+                                            const gchar *category_id);
+static gchar *template_signature           (const lglTemplate *template,
+                                            gint         offset1,
+                                            gint         offset2);
+static gint   compare_ranks                (gconstpointer a,
+                                            gconstpointer b);
+static gint   compare_index_entries        (gconstpointer a,
+                                            gconstpointer b);
+static gint   compare_brand_entries        (gconstpointer a,
+                                            gconstpointer b);
+static void   index_entry_free             (IndexEntry  *entry);
+static void   brand_entry_free             (BrandEntry  *entry);
+
+static void   init_papers                  (void);
+static void   init_categories              (void);
+static void   init_vendors                 (void);
+static void   init_templates               (void);
+static void   init_template                (const gchar *brand,
+                                            const gchar *part);
+static void   init_template_name           (const gchar *name);
 
 static GList *read_papers                  (void);
 static GList *read_paper_files_from_dir    (GList       *papers,
@@ -124,9 +226,24 @@ static GList *read_vendor_files_from_dir   (GList       *vendors,
 
 static void   read_templates               (void);
 static void   read_template_files_from_dir (const gchar *dirname);
+static void   add_full_page_templates      (void);
+
+static void   index_template_files_from_dir (const gchar *dirname,
+                                             gboolean     user_flag);
+static void   index_template_file          (TemplateFile *file);
+static gchar *get_tag_attribute            (const gchar *tag,
+                                            const gchar *attribute);
+static gchar *decode_entities              (const gchar *text,
+                                            gsize        length);
+static void   load_template_file           (TemplateFile *file);
+static void   template_file_free           (TemplateFile *file);
 
 static lglTemplate *template_full_page     (const gchar *page_size);
 
+static gchar **config_dirs                 (void);
+static gboolean load_cache                 (void);
+static void   save_cache                   (void);
+
 
 /*****************************************************************************/
 /* Object infrastructure.                                                    */
@@ -164,7 +281,16 @@ lgl_db_model_class_init (lglDbModelClass *class)
 static void
 lgl_db_model_init (lglDbModel *this)
 {
-        this->template_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)lgl_template_free);
+        this->template_names       = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        this->template_brand_parts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        this->sorted_templates = g_ptr_array_new_with_free_func ((GDestroyNotify)index_entry_free);
+        this->sorted_brands    = g_ptr_array_new_with_free_func ((GDestroyNotify)brand_entry_free);
+        this->brand_index      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        this->paper_index      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_array_unref);
+        this->category_index   = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_array_unref);
+        this->signature_index  = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_array_unref);
+        this->template_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 
@@ -180,7 +306,17 @@ lgl_db_model_finalize (GObject *object)
         g_return_if_fail (object && IS_LGL_DB_MODEL (object));
         this = LGL_DB_MODEL (object);
 
-        g_hash_table_unref (this->template_cache);
+        g_hash_table_unref (this->template_names);
+        g_hash_table_unref (this->template_brand_parts);
+
+        g_hash_table_unref (this->brand_index);
+        g_hash_table_unref (this->paper_index);
+        g_hash_table_unref (this->category_index);
+        g_hash_table_unref (this->signature_index);
+        g_ptr_array_free (this->sorted_templates, TRUE);
+        g_ptr_array_free (this->sorted_brands, TRUE);
+        g_hash_table_unref (this->template_index);
+        g_list_free_full (this->template_files, (GDestroyNotify)template_file_free);
 
         for (p = this->papers; p != NULL; p = p->next)
         {
@@ -243,62 +379,73 @@ lgl_db_model_new (void)
  * This function initializes its paper definitions, category definitions, vendor definitions,
  * and its template database. It will search both system and user template directories to locate
  * this data.
+ *
+ * The database is kept in a compiled cache in the user cache directory, which is used instead
+ * of the template directories as long as they and their files are unchanged.
  */
 void
 lgl_db_init (void)
 {
-        lglPaper    *paper_other;
-        lglCategory *category_user_defined;
-        lglTemplate *template;
-        GList       *page_sizes;
-        GList       *p;
-
-        model = lgl_db_model_new ();
-
-        /*
-         * Paper definitions
-         */
-        model->papers = read_papers ();
-
-        /* Create and append an "Other" entry. */
-        /* Translators: "Other" here means other page size.  Meaning a page size
-         * other than the standard ones that libglabels knows about such as
-         * "letter", "A4", etc. */
-        paper_other = lgl_paper_new ("Other", _("Other"), 0.0, 0.0, NULL);
-        model->papers = g_list_append (model->papers, paper_other);
+        g_rec_mutex_lock (&db_mutex);
+        if (!model)
+        {
+                model = lgl_db_model_new ();
+                load_cache ();
+        }
+        g_rec_mutex_unlock (&db_mutex);
 
-        /*
-         * Categories
-         */
-        model->categories = read_categories ();
+        init_papers ();
+        init_categories ();
+        init_vendors ();
+        init_templates ();
+}
 
-        /* Create and append a "User defined" entry. */
-        category_user_defined = lgl_category_new ("user-defined", _("User defined"));
-        model->categories = g_list_append (model->categories, category_user_defined);
 
-        /*
-         * Vendors
-         */
-        model->vendors = read_vendors ();
+/**
+ * lgl_db_init_lazy:
+ *
+ * Initialize libglabels to load its data on demand, for applications that only
+ * need a few templates, such as batch printing.
+ *
+ * Template files are only scanned for the brand and part names they define.  A
+ * template file is fully read when one of its templates is first looked up by
+ * name, and the rest of the database when first needed as a whole, e.g. for
+ * lists of templates or brands.  Paper, category and vendor definitions are
+ * read on first use.  Results are the same as after lgl_db_init().  If the compiled
+ * cache of the database is valid, the whole database is loaded from it instead.
+ *
+ * Loading is thread safe, but templates read on demand change the database, so
+ * threads must not otherwise use the database while others look up templates.
+ */
+void
+lgl_db_init_lazy (void)
+{
+        gchar *data_dir;
 
-        /*
-         * Templates
-         */
-        read_templates ();
+        g_rec_mutex_lock (&db_mutex);
 
-        /* Create and append generic full page templates. */
-        page_sizes = lgl_db_get_paper_id_list ();
-        for ( p=page_sizes; p != NULL; p=p->next )
+        if (!model)
         {
-                if ( !lgl_db_is_paper_id_other (p->data) )
+                model = lgl_db_model_new ();
+
+                if (!load_cache ())
                 {
-                        template = template_full_page (p->data);
-                        _lgl_db_register_template_internal (template);
-                        lgl_template_free (template);
+                        /* Same order as read_templates(), so the same templates win. */
+                        data_dir = USER_CONFIG_DIR;
+                        index_template_files_from_dir (data_dir, TRUE);
+                        g_free (data_dir);
+
+                        data_dir = ALT_USER_CONFIG_DIR;
+                        index_template_files_from_dir (data_dir, FALSE);
+                        g_free (data_dir);
+
+                        data_dir = SYSTEM_CONFIG_DIR;
+                        index_template_files_from_dir (data_dir, FALSE);
+                        g_free (data_dir);
                 }
         }
-        lgl_db_free_paper_id_list (page_sizes);
 
+        g_rec_mutex_unlock (&db_mutex);
 }
 
 
@@ -356,10 +503,7 @@ lgl_db_get_paper_id_list (void)
         GList           *p;
         lglPaper        *paper;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_papers ();
 
         for ( p=model->papers; p != NULL; p=p->next )
         {
@@ -409,10 +553,7 @@ lgl_db_get_paper_name_list (void)
         GList           *p;
         lglPaper        *paper;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_papers ();
 
         for ( p=model->papers; p != NULL; p=p->next )
         {
@@ -462,10 +603,7 @@ lgl_db_lookup_paper_from_name (const gchar *name)
         GList       *p;
         lglPaper    *paper;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_papers ();
 
         if (name == NULL)
         {
@@ -501,10 +639,7 @@ lgl_db_lookup_paper_from_id (const gchar *id)
         GList       *p;
         lglPaper    *paper;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_papers ();
 
         if (id == NULL)
         {
@@ -600,10 +735,7 @@ lgl_db_is_paper_id_known (const gchar *id)
         GList       *p;
         lglPaper    *paper;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_papers ();
 
         if (id == NULL)
         {
@@ -739,10 +871,7 @@ lgl_db_print_known_papers (void)
         GList       *p;
         lglPaper    *paper;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_papers ();
 
         g_print ("%s():\n", __FUNCTION__);
         for (p = model->papers; p != NULL; p = p->next)
@@ -776,10 +905,7 @@ lgl_db_get_category_id_list (void)
         GList           *p;
         lglCategory     *category;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_categories ();
 
         for ( p=model->categories; p != NULL; p=p->next )
         {
@@ -829,10 +955,7 @@ lgl_db_get_category_name_list (void)
         GList           *p;
         lglCategory     *category;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_categories ();
 
         for ( p=model->categories; p != NULL; p=p->next )
         {
@@ -882,10 +1005,7 @@ lgl_db_lookup_category_from_name (const gchar *name)
         GList       *p;
         lglCategory *category;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_categories ();
 
         if (name == NULL)
         {
@@ -921,10 +1041,7 @@ lgl_db_lookup_category_from_id (const gchar *id)
         GList       *p;
         lglCategory *category;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_categories ();
 
         if (id == NULL)
         {
@@ -1020,10 +1137,7 @@ lgl_db_is_category_id_known (const gchar *id)
         GList       *p;
         lglCategory *category;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_categories ();
 
         if (id == NULL)
         {
@@ -1138,10 +1252,7 @@ lgl_db_print_known_categories (void)
         GList       *p;
         lglCategory *category;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_categories ();
 
         g_print ("%s():\n", __FUNCTION__);
         for (p = model->categories; p != NULL; p = p->next)
@@ -1174,10 +1285,7 @@ lgl_db_get_vendor_name_list (void)
         GList           *p;
         lglVendor       *vendor;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_vendors ();
 
         for ( p=model->vendors; p != NULL; p=p->next )
         {
@@ -1227,10 +1335,7 @@ lgl_db_lookup_vendor_from_name (const gchar *name)
         GList       *p;
         lglVendor   *vendor;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_vendors ();
 
         if (name == NULL)
         {
@@ -1266,10 +1371,7 @@ lgl_db_is_vendor_name_known (const gchar *name)
         GList       *p;
         lglVendor   *vendor;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_vendors ();
 
         if (name == NULL)
         {
@@ -1379,10 +1481,7 @@ lgl_db_print_known_vendors (void)
         GList       *p;
         lglVendor   *vendor;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_vendors ();
 
         g_print ("%s():\n", __FUNCTION__);
         for (p = model->vendors; p != NULL; p = p->next)
@@ -1417,32 +1516,47 @@ GList *
 lgl_db_get_brand_list (const gchar *paper_id,
                        const gchar *category_id)
 {
-        GList            *p_tmplt;
-        lglTemplate      *template;
+        GArray           *ranks;
+        gboolean         *found;
+        IndexEntry       *entry;
+        BrandEntry       *brand;
+        guint             i;
         GList            *brands = NULL;
 
-        if (!model)
+        init_templates ();
+
+        g_rec_mutex_lock (&db_mutex);
+
+        build_indexes ();
+
+        ranks = filter_templates (NULL, paper_id, category_id);
+
+        /* Mark brands of matching templates, then list them in order. */
+        found = g_new0 (gboolean, model->sorted_brands->len);
+        for (i = 0; i < (ranks ? ranks->len : model->sorted_templates->len); i++)
         {
-                lgl_db_init ();
+                entry = g_ptr_array_index (model->sorted_templates,
+                                           ranks ? g_array_index (ranks, guint, i) : i);
+                found[entry->brand->rank] = TRUE;
         }
 
-        for (p_tmplt = model->templates; p_tmplt != NULL; p_tmplt = p_tmplt->next)
+        for (i = model->sorted_brands->len; i > 0; i--)
         {
-                template = (lglTemplate *) p_tmplt->data;
-                if (lgl_template_does_page_size_match (template, paper_id) &&
-                    lgl_template_does_category_match (template, category_id))
+                brand = g_ptr_array_index (model->sorted_brands, i - 1);
+                if (found[i - 1])
                 {
-
-                        if ( !g_list_find_custom (brands, template->brand,
-                                                  (GCompareFunc)lgl_str_utf8_casecmp) )
-                        {
-                                brands = g_list_insert_sorted (brands,
-                                                               g_strdup (template->brand),
-                                                               (GCompareFunc)lgl_str_utf8_casecmp);
-                        }
+                        brands = g_list_prepend (brands, g_strdup (brand->brand));
                 }
         }
 
+        g_free (found);
+        if (ranks)
+        {
+                g_array_unref (ranks);
+        }
+
+        g_rec_mutex_unlock (&db_mutex);
+
         return brands;
 }
 
@@ -1477,13 +1591,32 @@ lgl_db_free_brand_list (GList *brands)
 void
 _lgl_db_register_template_internal (const lglTemplate   *template)
 {
-        lglTemplate *template_copy;
+        lglTemplate  *template_copy;
+        gchar        *name, *key;
+        TemplateFile *file;
+
+        if (model->loading_file != NULL)
+        {
+                /* Leave templates also defined by earlier files to them. */
+                name = g_strdup_printf ("%s %s", template->brand, template->part);
+                key  = template_name_key (name);
+                file = g_hash_table_lookup (model->template_index, key);
+                g_free (name);
+                g_free (key);
+                if ( (file != NULL) && (file != model->loading_file) )
+                {
+                        return;
+                }
+        }
 
-        if (!lgl_db_does_template_exist (template->brand, template->part))
+        if (!find_template (template->brand, template->part))
         {
                 template_copy = lgl_template_dup (template);
-                model->templates = g_list_append (model->templates, template_copy);
-                add_to_template_cache (template_copy);
+                if ( (model->loading_file != NULL) && model->loading_file->user_flag )
+                {
+                        lgl_template_add_category (template_copy, "user-defined");
+                }
+                add_template (template_copy);
         }
         else
         {
@@ -1508,10 +1641,7 @@ lgl_db_register_template (const lglTemplate *template)
         gchar       *dir, *filename, *abs_filename;
         gint         bytes_written;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_template (template->brand, template->part);
 
         if (lgl_db_does_template_exist (template->brand, template->part))
         {
@@ -1533,8 +1663,11 @@ lgl_db_register_template (const lglTemplate *template)
                 {
                         template_copy = lgl_template_dup (template);
                         lgl_template_add_category (template_copy, "user-defined");
-                        model->templates = g_list_append (model->templates, template_copy);
-                        add_to_template_cache (template_copy);
+                        add_template (template_copy);
+                        if (g_atomic_int_get (&templates_loaded))
+                        {
+                                save_cache ();
+                        }
                         g_signal_emit (G_OBJECT (model), signals[CHANGED], 0);
                         return LGL_DB_REG_OK;
                 }
@@ -1565,21 +1698,19 @@ lgl_db_register_template (const lglTemplate *template)
 lglDbDeleteStatus
 lgl_db_delete_template_by_name (const gchar *name)
 {
-        lglTemplate *template, *template1;
+        lglTemplate *template;
         gchar       *dir, *filename, *abs_filename;
-        GList       *p;
+        GList       *link;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_templates ();
 
-        if (!lgl_db_does_template_name_exist (name))
+        link = find_template_name (name);
+        if (link == NULL)
         {
                 return LGL_DB_DELETE_DOES_NOT_EXIST;
         }
 
-        template = lgl_db_lookup_template_from_name (name);
+        template = (lglTemplate *)link->data;
         if ( lgl_template_does_category_match (template, "user-defined") )
         {
                 dir = USER_CONFIG_DIR;
@@ -1598,19 +1729,9 @@ lgl_db_delete_template_by_name (const gchar *name)
                 g_free (filename);
                 g_free (abs_filename);
 
-                for ( p=model->templates; p != NULL; p=p->next )
-                {
-                        template1 = (lglTemplate *)p->data;
-
-                        if ( lgl_template_do_templates_match (template, template1) )
-                        {
-                                model->templates = g_list_delete_link (model->templates, p);
-                                g_hash_table_remove (model->template_cache, name);
-                                break;
-                        }
-                }
+                remove_template (link);
 
-                lgl_template_free (template);
+                save_cache ();
 
                 g_signal_emit (G_OBJECT (model), signals[CHANGED], 0);
                 return LGL_DB_DELETE_OK;
@@ -1664,31 +1785,14 @@ gboolean
 lgl_db_does_template_exist (const gchar *brand,
                             const gchar *part)
 {
-        GList            *p_tmplt;
-        lglTemplate      *template;
-
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_template (brand, part);
 
         if ((brand == NULL) || (part == NULL))
         {
                 return FALSE;
         }
 
-        for (p_tmplt = model->templates; p_tmplt != NULL; p_tmplt = p_tmplt->next)
-        {
-                template = (lglTemplate *) p_tmplt->data;
-
-                if ( UTF8_EQUAL (brand, template->brand) &&
-                     UTF8_EQUAL (part, template->part) )
-                {
-                        return TRUE;
-                }
-        }
-
-        return FALSE;
+        return find_template (brand, part) != NULL;
 }
 
 
@@ -1704,34 +1808,14 @@ lgl_db_does_template_exist (const gchar *brand,
 gboolean
 lgl_db_does_template_name_exist (const gchar *name)
 {
-        GList            *p_tmplt;
-        lglTemplate      *template;
-        gchar            *candidate_name;
-
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_template_name (name);
 
         if (name == NULL)
         {
                 return FALSE;
         }
 
-        for (p_tmplt = model->templates; p_tmplt != NULL; p_tmplt = p_tmplt->next)
-        {
-                template = (lglTemplate *) p_tmplt->data;
-                candidate_name = g_strdup_printf ("%s %s", template->brand, template->part);
-
-                if ( UTF8_EQUAL (candidate_name, name) )
-                {
-                        g_free (candidate_name);
-                        return TRUE;
-                }
-                g_free (candidate_name);
-        }
-
-        return FALSE;
+        return find_template_name (name) != NULL;
 }
 
 
@@ -1753,28 +1837,35 @@ lgl_db_get_template_name_list_all (const gchar *brand,
                                    const gchar *paper_id,
                                    const gchar *category_id)
 {
-        GList            *p_tmplt;
-        lglTemplate      *template;
-        gchar            *name;
+        GArray           *ranks;
+        IndexEntry       *entry;
+        guint             i, n;
         GList            *names = NULL;
 
-        if (!model)
+        init_templates ();
+
+        g_rec_mutex_lock (&db_mutex);
+
+        build_indexes ();
+
+        ranks = filter_templates (brand, paper_id, category_id);
+
+        /* Ranks are ascending, so build list from the end. */
+        n = ranks ? ranks->len : model->sorted_templates->len;
+        for (i = n; i > 0; i--)
         {
-                lgl_db_init ();
+                entry = g_ptr_array_index (model->sorted_templates,
+                                           ranks ? g_array_index (ranks, guint, i - 1) : i - 1);
+                names = g_list_prepend (names, g_strdup (entry->name));
         }
 
-        for (p_tmplt = model->templates; p_tmplt != NULL; p_tmplt = p_tmplt->next)
+        if (ranks)
         {
-                template = (lglTemplate *) p_tmplt->data;
-                if (lgl_template_does_brand_match (template, brand) &&
-                    lgl_template_does_page_size_match (template, paper_id) &&
-                    lgl_template_does_category_match (template, category_id))
-                {
-                        name = g_strdup_printf ("%s %s", template->brand, template->part);
-                        names = g_list_insert_sorted (names, name, (GCompareFunc)lgl_str_part_name_cmp);
-                }
+                g_array_unref (ranks);
         }
 
+        g_rec_mutex_unlock (&db_mutex);
+
         return names;
 }
 
@@ -1791,45 +1882,70 @@ lgl_db_get_template_name_list_all (const gchar *brand,
 GList *
 lgl_db_get_similar_template_name_list (const gchar  *name)
 {
-        GList            *p_tmplt;
+        GList            *link;
         lglTemplate      *template1;
-        lglTemplate      *template2;
-        gchar            *name2;
+        IndexEntry       *entry;
+        GArray           *ranks, *candidates;
+        gchar            *signature;
+        gint              offset1, offset2;
+        guint             i;
         GList            *names = NULL;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_templates ();
 
         if ( !name )
         {
                 return NULL;
         }
 
-        template1 = lgl_db_lookup_template_from_name (name);
-        if ( !template1 )
+        link = find_template_name (name);
+        if ( !link )
         {
                 return NULL;
         }
+        template1 = (lglTemplate *) link->data;
 
-        for (p_tmplt = model->templates; p_tmplt != NULL; p_tmplt = p_tmplt->next)
-        {
-                template2 = (lglTemplate *) p_tmplt->data;
+        g_rec_mutex_lock (&db_mutex);
 
-                if ( lgl_template_are_templates_identical (template1, template2) )
-                {
+        build_indexes ();
 
-                        name2 = g_strdup_printf ("%s %s", template2->brand, template2->part);
-                        if ( !UTF8_EQUAL (name2, name) )
+        /*
+         * Frame sizes within tolerance of each other are at most one grid
+         * step apart, so probe the neighbouring signatures too.  Candidates
+         * are then checked in full, e.g. for their layouts.
+         */
+        candidates = g_array_new (FALSE, FALSE, sizeof (guint));
+        for (offset1 = -1; offset1 <= 1; offset1++)
+        {
+                for (offset2 = -1; offset2 <= 1; offset2++)
+                {
+                        signature = template_signature (template1, offset1, offset2);
+                        ranks     = g_hash_table_lookup (model->signature_index, signature);
+                        g_free (signature);
+                        if (ranks)
                         {
-                                names = g_list_insert_sorted (names, name2,
-                                                              (GCompareFunc)lgl_str_part_name_cmp);
+                                g_array_append_vals (candidates, ranks->data, ranks->len);
                         }
+                }
+        }
+        g_array_sort (candidates, compare_ranks);
+
+        for (i = candidates->len; i > 0; i--)
+        {
+                entry = g_ptr_array_index (model->sorted_templates,
+                                           g_array_index (candidates, guint, i - 1));
 
+                if ( lgl_template_are_templates_identical (template1, entry->template) &&
+                     !UTF8_EQUAL (entry->name, name) )
+                {
+                        names = g_list_prepend (names, g_strdup (entry->name));
                 }
         }
 
+        g_array_unref (candidates);
+
+        g_rec_mutex_unlock (&db_mutex);
+
         return names;
 }
 
@@ -1869,29 +1985,26 @@ lgl_db_free_template_name_list (GList *names)
 lglTemplate *
 lgl_db_lookup_template_from_name (const gchar *name)
 {
-        lglTemplate      *template;
-        lglTemplate      *new_template;
+        GList            *link;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_template_name (name);
 
         if (name == NULL)
         {
                 /* If no name, return first template as a default */
+                init_templates ();
                 return lgl_template_dup ((lglTemplate *) model->templates->data);
         }
 
-        template = g_hash_table_lookup (model->template_cache, name);
+        link = find_template_name (name);
 
-        if (template)
+        if (link)
         {
-                new_template = lgl_template_dup (template);
-                return new_template;
+                return lgl_template_dup ((lglTemplate *) link->data);
         }
 
         /* No matching template has been found so return the first template */
+        init_templates ();
         return lgl_template_dup ((lglTemplate *) model->templates->data);
 }
 
@@ -1910,67 +2023,894 @@ lglTemplate *
 lgl_db_lookup_template_from_brand_part(const gchar *brand,
                                        const gchar *part)
 {
-        gchar            *name;
-        lglTemplate      *template;
-        lglTemplate      *new_template;
+        GList            *link;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_template (brand, part);
 
         if ((brand == NULL) || (part == NULL))
         {
                 /* If no name, return first template as a default */
+                init_templates ();
                 return lgl_template_dup ((lglTemplate *) model->templates->data);
         }
 
-        name = g_strdup_printf ("%s %s", brand, part);
-        template = g_hash_table_lookup (model->template_cache, name);
+        link = find_template (brand, part);
 
-        if (template)
+        if (link)
         {
-                new_template = lgl_template_dup (template);
-                return new_template;
+                return lgl_template_dup ((lglTemplate *) link->data);
         }
 
         /* No matching template has been found so return the first template */
-        g_free (name);
+        init_templates ();
         return lgl_template_dup ((lglTemplate *) model->templates->data);
 }
 
 
-static void
-add_to_template_cache (lglTemplate *template)
+/**
+ * lgl_db_get_template_from_name:
+ * @name: name string
+ *
+ * Get template of template database from name string.  Unlike
+ * lgl_db_lookup_template_from_name(), the template is not copied, but shared
+ * with the database, so it must not be modified.
+ *
+ * Returns: a new reference to an #lglTemplate structure, to be released with
+ * lgl_template_unref().
+ *
+ */
+lglTemplate *
+lgl_db_get_template_from_name (const gchar *name)
 {
-        gchar            *name;
+        GList            *link;
 
-        name = g_strdup_printf ("%s %s", template->brand, template->part);
+        init_template_name (name);
+
+        link = name ? find_template_name (name) : NULL;
 
-        g_hash_table_insert (model->template_cache, name, template);
+        if (link)
+        {
+                return lgl_template_ref ((lglTemplate *) link->data);
+        }
+
+        /* If no name or no matching template, return first template as a default */
+        init_templates ();
+        return lgl_template_ref ((lglTemplate *) model->templates->data);
 }
 
 
-void
-read_templates (void)
+/**
+ * lgl_db_get_template_from_brand_part:
+ * @brand: brand name string
+ * @part:  part name string
+ *
+ * Get template of template database from brand and part strings.  Unlike
+ * lgl_db_lookup_template_from_brand_part(), the template is not copied, but
+ * shared with the database, so it must not be modified.
+ *
+ * Returns: a new reference to an #lglTemplate structure, to be released with
+ * lgl_template_unref().
+ *
+ */
+lglTemplate *
+lgl_db_get_template_from_brand_part (const gchar *brand,
+                                     const gchar *part)
 {
-        gchar       *data_dir;
-        GList       *p;
-        lglTemplate *template;
+        GList            *link;
 
-        /*
-         * User defined templates.  Add to user-defined category.
-         */
-        data_dir = USER_CONFIG_DIR;
-        read_template_files_from_dir (data_dir);
-        g_free (data_dir);
-        for ( p=model->templates; p != NULL; p=p->next )
+        init_template (brand, part);
+
+        link = (brand && part) ? find_template (brand, part) : NULL;
+
+        if (link)
         {
-                template = (lglTemplate *)p->data;
-                lgl_template_add_category (template, "user-defined");
+                return lgl_template_ref ((lglTemplate *) link->data);
         }
 
-        /*
+        /* If no name or no matching template, return first template as a default */
+        init_templates ();
+        return lgl_template_ref ((lglTemplate *) model->templates->data);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Append template to database, which takes ownership of it.       */
+/*                                                                           */
+/* Templates are kept in order of registration; the tail of the list is      */
+/* remembered, so that appending does not walk the list.  The first template */
+/* of a name keeps the name, as for the brand and part.                      */
+/*---------------------------------------------------------------------------*/
+static void
+add_template (lglTemplate *template)
+{
+        GList *link;
+        gchar *name, *key;
+
+        link = g_list_alloc ();
+        link->data = template;
+        link->prev = model->templates_tail;
+        if (model->templates_tail)
+        {
+                model->templates_tail->next = link;
+        }
+        else
+        {
+                model->templates = link;
+        }
+        model->templates_tail = link;
+        model->indexes_valid  = FALSE;
+
+        name = g_strdup_printf ("%s %s", template->brand, template->part);
+        key  = template_name_key (name);
+        if (!g_hash_table_contains (model->template_names, key))
+        {
+                g_hash_table_insert (model->template_names, key, link);
+        }
+        else
+        {
+                g_free (key);
+        }
+        g_free (name);
+
+        key = template_brand_part_key (template->brand, template->part);
+        if (!g_hash_table_contains (model->template_brand_parts, key))
+        {
+                g_hash_table_insert (model->template_brand_parts, key, link);
+        }
+        else
+        {
+                g_free (key);
+        }
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Remove and free template at link of template list.              */
+/*---------------------------------------------------------------------------*/
+static void
+remove_template (GList *link)
+{
+        lglTemplate *template = link->data;
+        gchar       *name, *key, *key1;
+        GList       *p;
+
+        key = template_brand_part_key (template->brand, template->part);
+        if (g_hash_table_lookup (model->template_brand_parts, key) == link)
+        {
+                g_hash_table_remove (model->template_brand_parts, key);
+        }
+        g_free (key);
+
+        name = g_strdup_printf ("%s %s", template->brand, template->part);
+        key  = template_name_key (name);
+        g_free (name);
+        if (g_hash_table_lookup (model->template_names, key) == link)
+        {
+                g_hash_table_remove (model->template_names, key);
+
+                /* Pass name on to a later template of same name, if any. */
+                for (p = link->next; p != NULL; p = p->next)
+                {
+                        template = p->data;
+                        name = g_strdup_printf ("%s %s", template->brand, template->part);
+                        key1 = template_name_key (name);
+                        g_free (name);
+                        if (!strcmp (key, key1))
+                        {
+                                g_hash_table_insert (model->template_names, key1, p);
+                                break;
+                        }
+                        g_free (key1);
+                }
+        }
+        g_free (key);
+
+        if (link == model->templates_tail)
+        {
+                model->templates_tail = link->prev;
+        }
+        lgl_template_free ((lglTemplate *)link->data);
+        model->templates = g_list_delete_link (model->templates, link);
+        model->indexes_valid = FALSE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Remove and free all templates.                                  */
+/*---------------------------------------------------------------------------*/
+static void
+clear_templates (void)
+{
+        g_hash_table_remove_all (model->template_names);
+        g_hash_table_remove_all (model->template_brand_parts);
+
+        g_list_free_full (model->templates, (GDestroyNotify)lgl_template_free);
+        model->templates      = NULL;
+        model->templates_tail = NULL;
+        model->indexes_valid  = FALSE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Find link of template from brand and part, ignoring case.       */
+/*---------------------------------------------------------------------------*/
+static GList *
+find_template (const gchar *brand,
+               const gchar *part)
+{
+        gchar *key;
+        GList *link;
+
+        key  = template_brand_part_key (brand, part);
+        link = g_hash_table_lookup (model->template_brand_parts, key);
+        g_free (key);
+
+        return link;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Find link of template from name, ignoring case.                 */
+/*---------------------------------------------------------------------------*/
+static GList *
+find_template_name (const gchar *name)
+{
+        gchar *key;
+        GList *link;
+
+        key  = template_name_key (name);
+        link = g_hash_table_lookup (model->template_names, key);
+        g_free (key);
+
+        return link;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Key of template name in indexes.                                */
+/*---------------------------------------------------------------------------*/
+static gchar *
+template_name_key (const gchar *name)
+{
+        return g_utf8_casefold (name, -1);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Key of template brand and part in index.                        */
+/*                                                                           */
+/* Brand and part are kept apart, since names like "A B C" are ambiguous.    */
+/*---------------------------------------------------------------------------*/
+static gchar *
+template_brand_part_key (const gchar *brand,
+                         const gchar *part)
+{
+        gchar *brand_key, *part_key, *key;
+
+        brand_key = g_utf8_casefold (brand, -1);
+        part_key  = g_utf8_casefold (part, -1);
+        key       = g_strconcat (brand_key, "\n", part_key, NULL);
+        g_free (brand_key);
+        g_free (part_key);
+
+        return key;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Build secondary indexes, if not valid.  Caller holds db_mutex.  */
+/*                                                                           */
+/* Templates are sorted by name once, comparing precomputed sort keys, and   */
+/* the indexes filled in rank order, so that each array of ranks is sorted   */
+/* without further work.                                                     */
+/*---------------------------------------------------------------------------*/
+static void
+build_indexes (void)
+{
+        GList       *p, *p_id;
+        lglTemplate *template;
+        IndexEntry  *entry;
+        BrandEntry  *brand;
+        gchar       *key;
+        guint        i;
+
+        if (model->indexes_valid)
+        {
+                return;
+        }
+
+        g_ptr_array_set_size (model->sorted_templates, 0);
+        g_ptr_array_set_size (model->sorted_brands, 0);
+        g_hash_table_remove_all (model->brand_index);
+        g_hash_table_remove_all (model->paper_index);
+        g_hash_table_remove_all (model->category_index);
+        g_hash_table_remove_all (model->signature_index);
+
+        for (p = model->templates, i = 0; p != NULL; p = p->next, i++)
+        {
+                template = (lglTemplate *)p->data;
+
+                key   = g_utf8_casefold (template->brand, -1);
+                brand = g_hash_table_lookup (model->brand_index, key);
+                if (brand == NULL)
+                {
+                        brand        = g_new0 (BrandEntry, 1);
+                        brand->brand = g_strdup (template->brand);
+                        brand->ranks = g_array_new (FALSE, FALSE, sizeof (guint));
+                        g_hash_table_insert (model->brand_index, key, brand);
+                        g_ptr_array_add (model->sorted_brands, brand);
+                }
+                else
+                {
+                        g_free (key);
+                }
+
+                entry           = g_new0 (IndexEntry, 1);
+                entry->template = template;
+                entry->name     = g_strdup_printf ("%s %s", template->brand, template->part);
+                entry->sort_key = lgl_str_part_name_sort_key (entry->name);
+                entry->order    = i;
+                entry->brand    = brand;
+                g_ptr_array_add (model->sorted_templates, entry);
+        }
+
+        g_ptr_array_sort (model->sorted_templates, compare_index_entries);
+        g_ptr_array_sort (model->sorted_brands, compare_brand_entries);
+
+        for (i = 0; i < model->sorted_brands->len; i++)
+        {
+                brand = g_ptr_array_index (model->sorted_brands, i);
+                brand->rank = i;
+        }
+
+        for (i = 0; i < model->sorted_templates->len; i++)
+        {
+                entry    = g_ptr_array_index (model->sorted_templates, i);
+                template = entry->template;
+
+                g_array_append_val (entry->brand->ranks, i);
+
+                if (template->paper_id)
+                {
+                        add_rank (model->paper_index, g_ascii_strdown (template->paper_id, -1), i);
+                }
+
+                for (p_id = template->category_ids; p_id != NULL; p_id = p_id->next)
+                {
+                        add_rank (model->category_index, g_ascii_strdown (p_id->data, -1), i);
+                }
+
+                add_rank (model->signature_index, template_signature (template, 0, 0), i);
+        }
+
+        model->indexes_valid = TRUE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Add rank to array of key in index, which takes the key.          */
+/*---------------------------------------------------------------------------*/
+static void
+add_rank (GHashTable *index,
+          gchar      *key,
+          guint       rank)
+{
+        GArray *ranks;
+
+        ranks = g_hash_table_lookup (index, key);
+        if (ranks == NULL)
+        {
+                ranks = g_array_new (FALSE, FALSE, sizeof (guint));
+                g_hash_table_insert (index, key, ranks);
+        }
+        else
+        {
+                g_free (key);
+        }
+
+        /* Ranks are added in order; skip categories listed twice. */
+        if ( (ranks->len == 0) || (g_array_index (ranks, guint, ranks->len - 1) != rank) )
+        {
+                g_array_append_val (ranks, rank);
+        }
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Is rank in ascending array of ranks?                            */
+/*---------------------------------------------------------------------------*/
+static gboolean
+has_rank (GArray *ranks,
+          guint   rank)
+{
+        guint lo, hi, mid, r;
+
+        lo = 0;
+        hi = ranks->len;
+        while (lo < hi)
+        {
+                mid = lo + (hi - lo) / 2;
+                r   = g_array_index (ranks, guint, mid);
+                if (r == rank)
+                {
+                        return TRUE;
+                }
+                if (r < rank)
+                {
+                        lo = mid + 1;
+                }
+                else
+                {
+                        hi = mid;
+                }
+        }
+
+        return FALSE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Ranks of templates matching filters, in ascending order.        */
+/*                                                                           */
+/* A NULL filter matches everything; returns NULL if all filters are NULL.   */
+/* Otherwise the smallest array of ranks is walked, and each rank looked up  */
+/* in the others.  Caller holds db_mutex, indexes built.                     */
+/*---------------------------------------------------------------------------*/
+static GArray *
+filter_templates (const gchar *brand,
+                  const gchar *paper_id,
+                  const gchar *category_id)
+{
+        GArray     *sets[3];
+        gint        n_sets = 0;
+        GArray     *ranks;
+        BrandEntry *brand_entry;
+        gchar      *key;
+        gint        i, j, smallest;
+        guint       rank;
+        gboolean    match;
+
+        ranks = g_array_new (FALSE, FALSE, sizeof (guint));
+
+        if (brand)
+        {
+                key         = g_utf8_casefold (brand, -1);
+                brand_entry = g_hash_table_lookup (model->brand_index, key);
+                g_free (key);
+                if (brand_entry == NULL)
+                {
+                        return ranks;
+                }
+                sets[n_sets++] = brand_entry->ranks;
+        }
+
+        if (paper_id)
+        {
+                key = g_ascii_strdown (paper_id, -1);
+                sets[n_sets] = g_hash_table_lookup (model->paper_index, key);
+                g_free (key);
+                if (sets[n_sets++] == NULL)
+                {
+                        return ranks;
+                }
+        }
+
+        if (category_id)
+        {
+                key = g_ascii_strdown (category_id, -1);
+                sets[n_sets] = g_hash_table_lookup (model->category_index, key);
+                g_free (key);
+                if (sets[n_sets++] == NULL)
+                {
+                        return ranks;
+                }
+        }
+
+        if (n_sets == 0)
+        {
+                g_array_unref (ranks);
+                return NULL;
+        }
+
+        smallest = 0;
+        for (i = 1; i < n_sets; i++)
+        {
+                if (sets[i]->len < sets[smallest]->len)
+                {
+                        smallest = i;
+                }
+        }
+
+        for (j = 0; j < (gint)sets[smallest]->len; j++)
+        {
+                rank  = g_array_index (sets[smallest], guint, j);
+                match = TRUE;
+                for (i = 0; match && (i < n_sets); i++)
+                {
+                        match = (i == smallest) || has_rank (sets[i], rank);
+                }
+                if (match)
+                {
+                        g_array_append_val (ranks, rank);
+                }
+        }
+
+        return ranks;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Geometric signature of template.                                */
+/*                                                                           */
+/* The signature holds what lgl_template_are_templates_identical() compares  */
+/* exactly, the paper and shape, and the frame size on a grid of its         */
+/* tolerance, offset by the given numbers of steps.  Layouts are left out,   */
+/* since templates match if the layouts of one are among those of the other. */
+/*---------------------------------------------------------------------------*/
+static gchar *
+template_signature (const lglTemplate *template,
+                    gint               offset1,
+                    gint               offset2)
+{
+        lglTemplateFrame *frame;
+        gdouble           size1 = 0.0, size2 = 0.0;
+        gint              shape = -1;
+        gchar            *paper_key, *signature;
+        gchar             page_w[G_ASCII_DTOSTR_BUF_SIZE];
+        gchar             page_h[G_ASCII_DTOSTR_BUF_SIZE];
+
+        if (template->frames != NULL)
+        {
+                frame = (lglTemplateFrame *)template->frames->data;
+                shape = frame->shape;
+
+                switch (frame->shape)
+                {
+                case LGL_TEMPLATE_FRAME_SHAPE_RECT:
+                        size1 = frame->rect.w;
+                        size2 = frame->rect.h;
+                        break;
+                case LGL_TEMPLATE_FRAME_SHAPE_ELLIPSE:
+                        size1 = frame->ellipse.w;
+                        size2 = frame->ellipse.h;
+                        break;
+                case LGL_TEMPLATE_FRAME_SHAPE_ROUND:
+                        size1 = frame->round.r;
+                        break;
+                case LGL_TEMPLATE_FRAME_SHAPE_CD:
+                        size1 = frame->cd.r1;
+                        size2 = frame->cd.r2;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        paper_key = g_utf8_casefold (template->paper_id ? template->paper_id : "", -1);
+        g_ascii_dtostr (page_w, sizeof (page_w), template->page_width);
+        g_ascii_dtostr (page_h, sizeof (page_h), template->page_height);
+
+        signature = g_strdup_printf ("%s/%s/%s/%d/%d/%d", paper_key, page_w, page_h, shape,
+                                     (gint)floor (size1 / SIGNATURE_GRID) + offset1,
+                                     (gint)floor (size2 / SIGNATURE_GRID) + offset2);
+
+        g_free (paper_key);
+
+        return signature;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Compare ranks.                                                  */
+/*---------------------------------------------------------------------------*/
+static gint
+compare_ranks (gconstpointer a,
+               gconstpointer b)
+{
+        guint rank_a = *(const guint *)a;
+        guint rank_b = *(const guint *)b;
+
+        return (rank_a > rank_b) - (rank_a < rank_b);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Compare templates in index by name, then order of registration. */
+/*---------------------------------------------------------------------------*/
+static gint
+compare_index_entries (gconstpointer a,
+                       gconstpointer b)
+{
+        const IndexEntry *entry_a = *(const IndexEntry **)a;
+        const IndexEntry *entry_b = *(const IndexEntry **)b;
+        gint              result;
+
+        result = g_bytes_compare (entry_a->sort_key, entry_b->sort_key);
+        if (result == 0)
+        {
+                result = (entry_a->order > entry_b->order) - (entry_a->order < entry_b->order);
+        }
+
+        return result;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Compare brands in index.                                        */
+/*---------------------------------------------------------------------------*/
+static gint
+compare_brand_entries (gconstpointer a,
+                       gconstpointer b)
+{
+        const BrandEntry *entry_a = *(const BrandEntry **)a;
+        const BrandEntry *entry_b = *(const BrandEntry **)b;
+
+        return lgl_str_utf8_casecmp (entry_a->brand, entry_b->brand);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Free template in index.                                         */
+/*---------------------------------------------------------------------------*/
+static void
+index_entry_free (IndexEntry *entry)
+{
+        g_free (entry->name);
+        g_bytes_unref (entry->sort_key);
+        g_free (entry);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Free brand in index.                                            */
+/*---------------------------------------------------------------------------*/
+static void
+brand_entry_free (BrandEntry *entry)
+{
+        g_free (entry->brand);
+        g_array_unref (entry->ranks);
+        g_free (entry);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read paper definitions, if not read yet.                        */
+/*---------------------------------------------------------------------------*/
+static void
+init_papers (void)
+{
+        lglPaper    *paper_other;
+
+        if (g_atomic_int_get (&papers_loaded))
+        {
+                return;
+        }
+
+        g_rec_mutex_lock (&db_mutex);
+
+        if (!model)
+        {
+                lgl_db_init ();
+        }
+
+        if (!papers_loaded)
+        {
+                model->papers = read_papers ();
+
+                /* Create and append an "Other" entry. */
+                /* Translators: "Other" here means other page size.  Meaning a page size
+                 * other than the standard ones that libglabels knows about such as
+                 * "letter", "A4", etc. */
+                paper_other = lgl_paper_new ("Other", _("Other"), 0.0, 0.0, NULL);
+                model->papers = g_list_append (model->papers, paper_other);
+
+                g_atomic_int_set (&papers_loaded, TRUE);
+        }
+
+        g_rec_mutex_unlock (&db_mutex);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read category definitions, if not read yet.                     */
+/*---------------------------------------------------------------------------*/
+static void
+init_categories (void)
+{
+        lglCategory *category_user_defined;
+
+        if (g_atomic_int_get (&categories_loaded))
+        {
+                return;
+        }
+
+        g_rec_mutex_lock (&db_mutex);
+
+        if (!model)
+        {
+                lgl_db_init ();
+        }
+
+        if (!categories_loaded)
+        {
+                model->categories = read_categories ();
+
+                /* Create and append a "User defined" entry. */
+                category_user_defined = lgl_category_new ("user-defined", _("User defined"));
+                model->categories = g_list_append (model->categories, category_user_defined);
+
+                g_atomic_int_set (&categories_loaded, TRUE);
+        }
+
+        g_rec_mutex_unlock (&db_mutex);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read vendor definitions, if not read yet.                       */
+/*---------------------------------------------------------------------------*/
+static void
+init_vendors (void)
+{
+        if (g_atomic_int_get (&vendors_loaded))
+        {
+                return;
+        }
+
+        g_rec_mutex_lock (&db_mutex);
+
+        if (!model)
+        {
+                lgl_db_init ();
+        }
+
+        if (!vendors_loaded)
+        {
+                model->vendors = read_vendors ();
+
+                g_atomic_int_set (&vendors_loaded, TRUE);
+        }
+
+        g_rec_mutex_unlock (&db_mutex);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read all templates, if not read yet.                            */
+/*                                                                           */
+/* Templates read on demand are dropped and all files read again in order,   */
+/* so that the database is the same as if read at once.                      */
+/*---------------------------------------------------------------------------*/
+static void
+init_templates (void)
+{
+        if (g_atomic_int_get (&templates_loaded))
+        {
+                return;
+        }
+
+        g_rec_mutex_lock (&db_mutex);
+
+        if (!model)
+        {
+                lgl_db_init ();
+        }
+
+        if (!templates_loaded)
+        {
+                clear_templates ();
+
+                /* No more loading on demand while reading the files in order. */
+                g_hash_table_remove_all (model->template_index);
+                g_list_free_full (model->template_files, (GDestroyNotify)template_file_free);
+                model->template_files  = NULL;
+                model->full_pages_flag = TRUE;
+
+                read_templates ();
+                add_full_page_templates ();
+
+                g_atomic_int_set (&templates_loaded, TRUE);
+
+                save_cache ();
+        }
+
+        g_rec_mutex_unlock (&db_mutex);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read template of brand and part, if not read yet.               */
+/*---------------------------------------------------------------------------*/
+static void
+init_template (const gchar *brand,
+               const gchar *part)
+{
+        gchar *name;
+
+        if (g_atomic_int_get (&templates_loaded))
+        {
+                return;
+        }
+
+        if ((brand == NULL) || (part == NULL))
+        {
+                init_template_name (NULL);
+                return;
+        }
+
+        name = g_strdup_printf ("%s %s", brand, part);
+        init_template_name (name);
+        g_free (name);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read template of name, if not read yet.                         */
+/*                                                                           */
+/* The template file indexed for name is read.  Names not indexed may be     */
+/* generic full page templates, which are created once papers are known.     */
+/*---------------------------------------------------------------------------*/
+static void
+init_template_name (const gchar *name)
+{
+        gchar        *key;
+        TemplateFile *file;
+
+        if (g_atomic_int_get (&templates_loaded))
+        {
+                return;
+        }
+
+        g_rec_mutex_lock (&db_mutex);
+
+        if (!model)
+        {
+                lgl_db_init ();
+        }
+
+        if (!templates_loaded && (name != NULL))
+        {
+                key  = template_name_key (name);
+                file = g_hash_table_lookup (model->template_index, key);
+                g_free (key);
+
+                if (file != NULL)
+                {
+                        if (!file->loaded_flag)
+                        {
+                                load_template_file (file);
+                        }
+                }
+                else if (!model->full_pages_flag)
+                {
+                        add_full_page_templates ();
+                }
+        }
+
+        g_rec_mutex_unlock (&db_mutex);
+}
+
+
+void
+read_templates (void)
+{
+        gchar       *data_dir;
+        GList       *p;
+        lglTemplate *template;
+
+        /*
+         * User defined templates.  Add to user-defined category.
+         */
+        data_dir = USER_CONFIG_DIR;
+        read_template_files_from_dir (data_dir);
+        g_free (data_dir);
+        for ( p=model->templates; p != NULL; p=p->next )
+        {
+                template = (lglTemplate *)p->data;
+                lgl_template_add_category (template, "user-defined");
+        }
+
+        /*
          * Alternate user defined templates.  (Used for manually created templates).
          */
         data_dir = ALT_USER_CONFIG_DIR;
@@ -2035,6 +2975,323 @@ read_template_files_from_dir (const gchar *dirname)
 }
 
 
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Create and register generic full page templates.                */
+/*---------------------------------------------------------------------------*/
+static void
+add_full_page_templates (void)
+{
+        lglTemplate *template;
+        GList       *page_sizes;
+        GList       *p;
+
+        model->full_pages_flag = TRUE;
+
+        page_sizes = lgl_db_get_paper_id_list ();
+        for ( p=page_sizes; p != NULL; p=p->next )
+        {
+                if ( !lgl_db_is_paper_id_other (p->data) )
+                {
+                        template = template_full_page (p->data);
+                        _lgl_db_register_template_internal (template);
+                        lgl_template_free (template);
+                }
+        }
+        lgl_db_free_paper_id_list (page_sizes);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Index template files of directory, by names they define.        */
+/*---------------------------------------------------------------------------*/
+static void
+index_template_files_from_dir (const gchar *dirname,
+                               gboolean     user_flag)
+{
+        GDir         *dp;
+        const gchar  *filename, *extension, *extension2;
+        TemplateFile *file;
+        GError       *gerror = NULL;
+
+        if (dirname == NULL)
+                return;
+
+        if (!g_file_test (dirname, G_FILE_TEST_EXISTS))
+        {
+                return;
+        }
+
+        dp = g_dir_open (dirname, 0, &gerror);
+        if (gerror != NULL)
+        {
+                g_message ("cannot open data directory: %s", gerror->message );
+                return;
+        }
+
+        while ((filename = g_dir_read_name (dp)) != NULL)
+        {
+
+                extension = strrchr (filename, '.');
+                extension2 = strrchr (filename, '-');
+
+                if ( (extension && ASCII_EQUAL (extension, ".template")) ||
+                     (extension2 && ASCII_EQUAL (extension2, "-templates.xml")) )
+                {
+                        file = g_new0 (TemplateFile, 1);
+                        file->filename  = g_build_filename (dirname, filename, NULL);
+                        file->user_flag = user_flag;
+
+                        model->template_files = g_list_append (model->template_files, file);
+                        index_template_file (file);
+                }
+
+        }
+
+        g_dir_close (dp);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Index names of templates defined by file.                       */
+/*                                                                           */
+/* The file is only scanned for the attributes of its Template tags, which   */
+/* is much cheaper than parsing it.  The first file defining a name wins.    */
+/*---------------------------------------------------------------------------*/
+static void
+index_template_file (TemplateFile *file)
+{
+        gchar        *contents;
+        const gchar  *p, *end;
+        gchar        *tag, *brand, *part, *name, *key;
+        gchar       **v;
+        gchar         quote;
+
+        if (!g_file_get_contents (file->filename, &contents, NULL, NULL))
+        {
+                return;
+        }
+
+        for (p = strchr (contents, '<'); p != NULL; p = strchr (p, '<'))
+        {
+                if (g_str_has_prefix (p, "<!--"))
+                {
+                        end = strstr (p, "-->");
+                        p = end ? end : p + 1;
+                        continue;
+                }
+
+                /* Find end of tag, allowing for ">" in quoted values. */
+                quote = 0;
+                for (end = p + 1; (*end != '\0') && (quote || (*end != '>')); end++)
+                {
+                        if (quote ? (*end == quote) : ((*end == '"') || (*end == '\'')))
+                        {
+                                quote = quote ? 0 : *end;
+                        }
+                }
+
+                if (g_str_has_prefix (p, "<Template") && g_ascii_isspace (p[9]))
+                {
+                        tag   = g_strndup (p, end - p);
+                        brand = get_tag_attribute (tag, "brand");
+                        part  = get_tag_attribute (tag, "part");
+                        if (!brand || !part)
+                        {
+                                g_free (brand);
+                                g_free (part);
+                                brand = part = NULL;
+
+                                name = get_tag_attribute (tag, "name");
+                                if (name)
+                                {
+                                        v = g_strsplit (name, " ", 2);
+                                        if (v[0] && v[1])
+                                        {
+                                                brand = g_strdup (v[0]);
+                                                part  = g_strchug (g_strdup (v[1]));
+                                        }
+                                        g_strfreev (v);
+                                        g_free (name);
+                                }
+                        }
+                        g_free (tag);
+
+                        if (brand && part)
+                        {
+                                name = g_strdup_printf ("%s %s", brand, part);
+                                key  = template_name_key (name);
+                                if (!g_hash_table_contains (model->template_index, key))
+                                {
+                                        g_hash_table_insert (model->template_index, key, file);
+                                }
+                                else
+                                {
+                                        g_free (key);
+                                }
+                                g_free (name);
+                        }
+                        g_free (brand);
+                        g_free (part);
+                }
+
+                if (*end == '\0')
+                {
+                        break;
+                }
+                p = end;
+        }
+
+        g_free (contents);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Get value of attribute of tag ("<Name attr=... >"), or NULL.    */
+/*---------------------------------------------------------------------------*/
+static gchar *
+get_tag_attribute (const gchar *tag,
+                   const gchar *attribute)
+{
+        const gchar *p, *name, *value;
+        gsize        name_len;
+        gchar        quote;
+
+        /* Skip element name. */
+        for (p = tag + 1; *p && !g_ascii_isspace (*p) && (*p != '>') && (*p != '/'); p++);
+
+        for (;;)
+        {
+                while (g_ascii_isspace (*p))
+                {
+                        p++;
+                }
+                if ( (*p == '\0') || (*p == '>') || (*p == '/') )
+                {
+                        return NULL;
+                }
+
+                name = p;
+                while (*p && (*p != '=') && !g_ascii_isspace (*p) && (*p != '>'))
+                {
+                        p++;
+                }
+                name_len = p - name;
+
+                while (g_ascii_isspace (*p))
+                {
+                        p++;
+                }
+                if (*p != '=')
+                {
+                        return NULL;
+                }
+                p++;
+                while (g_ascii_isspace (*p))
+                {
+                        p++;
+                }
+                if ( (*p != '"') && (*p != '\'') )
+                {
+                        return NULL;
+                }
+                quote = *p++;
+
+                value = p;
+                while (*p && (*p != quote))
+                {
+                        p++;
+                }
+                if (*p == '\0')
+                {
+                        return NULL;
+                }
+
+                if ( (name_len == strlen (attribute)) && !strncmp (name, attribute, name_len) )
+                {
+                        return decode_entities (value, p - value);
+                }
+                p++;
+        }
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Copy of attribute value, with XML entities decoded.             */
+/*---------------------------------------------------------------------------*/
+static gchar *
+decode_entities (const gchar *text,
+                 gsize        length)
+{
+        GString     *s;
+        const gchar *p, *end, *semicolon;
+        gunichar     c;
+
+        s   = g_string_sized_new (length);
+        end = text + length;
+
+        for (p = text; p < end; p++)
+        {
+                semicolon = (*p == '&') ? memchr (p, ';', end - p) : NULL;
+                if (semicolon == NULL)
+                {
+                        g_string_append_c (s, *p);
+                        continue;
+                }
+
+                if (g_str_has_prefix (p, "&amp;"))       c = '&';
+                else if (g_str_has_prefix (p, "&lt;"))   c = '<';
+                else if (g_str_has_prefix (p, "&gt;"))   c = '>';
+                else if (g_str_has_prefix (p, "&quot;")) c = '"';
+                else if (g_str_has_prefix (p, "&apos;")) c = '\'';
+                else if (g_str_has_prefix (p, "&#x"))    c = g_ascii_strtoull (p + 3, NULL, 16);
+                else if (g_str_has_prefix (p, "&#"))     c = g_ascii_strtoull (p + 2, NULL, 10);
+                else                                     c = 0;
+
+                if (c == 0)
+                {
+                        g_string_append_c (s, *p);
+                        continue;
+                }
+
+                g_string_append_unichar (s, c);
+                p = semicolon;
+        }
+
+        return g_string_free (s, FALSE);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read templates of indexed file.                                 */
+/*---------------------------------------------------------------------------*/
+static void
+load_template_file (TemplateFile *file)
+{
+        TemplateFile *loading_file;
+
+        file->loaded_flag = TRUE;
+
+        /* Equivalent parts may load another file while reading this one. */
+        loading_file        = model->loading_file;
+        model->loading_file = file;
+
+        lgl_xml_template_read_templates_from_file (file->filename);
+
+        model->loading_file = loading_file;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Free indexed template file.                                     */
+/*---------------------------------------------------------------------------*/
+static void
+template_file_free (TemplateFile *file)
+{
+        g_free (file->filename);
+        g_free (file);
+}
+
+
 static lglTemplate *
 template_full_page (const gchar *paper_id)
 {
@@ -2080,6 +3337,79 @@ template_full_page (const gchar *paper_id)
 }
 
 
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Directories the database is read from.  (must free w/ g_strfreev) */
+/*---------------------------------------------------------------------------*/
+static gchar **
+config_dirs (void)
+{
+        gchar **dirs;
+
+        dirs = g_new0 (gchar *, 4);
+        dirs[0] = SYSTEM_CONFIG_DIR;
+        dirs[1] = USER_CONFIG_DIR;
+        dirs[2] = ALT_USER_CONFIG_DIR;
+
+        return dirs;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Load whole database from compiled cache, if valid.              */
+/*---------------------------------------------------------------------------*/
+static gboolean
+load_cache (void)
+{
+        gchar    **dirs;
+        gboolean   ok;
+        GList     *templates = NULL;
+        GList     *p;
+
+        dirs = config_dirs ();
+        ok   = _lgl_db_cache_load ((const gchar * const *)dirs,
+                                   &model->papers, &model->categories,
+                                   &model->vendors, &templates);
+        g_strfreev (dirs);
+
+        if (ok)
+        {
+                for (p = templates; p != NULL; p = p->next)
+                {
+                        add_template ((lglTemplate *)p->data);
+                }
+                g_list_free (templates);
+                model->full_pages_flag = TRUE;
+
+                g_atomic_int_set (&papers_loaded, TRUE);
+                g_atomic_int_set (&categories_loaded, TRUE);
+                g_atomic_int_set (&vendors_loaded, TRUE);
+                g_atomic_int_set (&templates_loaded, TRUE);
+        }
+
+        return ok;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Save whole database to compiled cache.                          */
+/*---------------------------------------------------------------------------*/
+static void
+save_cache (void)
+{
+        gchar **dirs;
+
+        init_papers ();
+        init_categories ();
+        init_vendors ();
+
+        dirs = config_dirs ();
+        _lgl_db_cache_save ((const gchar * const *)dirs,
+                            model->papers, model->categories,
+                            model->vendors, model->templates);
+        g_strfreev (dirs);
+}
+
+
 /**
  * lgl_db_print_known_templates:
  *
@@ -2092,10 +3422,7 @@ lgl_db_print_known_templates (void)
         GList       *p;
         lglTemplate *template;
 
-        if (!model)
-        {
-                lgl_db_init ();
-        }
+        init_templates ();
 
         g_print ("%s():\n", __FUNCTION__);
         for (p=model->templates; p!=NULL; p=p->next)
@@ -57,6 +57,8 @@ typedef void  (*lglDbNotifyFunc) (gpointer user_data);
  */
 void           lgl_db_init                           (void);
 
+void           lgl_db_init_lazy                      (void);
+
 
 
 /*
@@ -165,6 +167,11 @@ lglTemplate   *lgl_db_lookup_template_from_name      (const gchar         *name)
 lglTemplate   *lgl_db_lookup_template_from_brand_part(const gchar         *brand,
                                                       const gchar         *part);
 
+lglTemplate   *lgl_db_get_template_from_name         (const gchar         *name);
+
+lglTemplate   *lgl_db_get_template_from_brand_part   (const gchar         *brand,
+                                                      const gchar         *part);
+
 
 /*
  * Debugging functions
@@ -27,6 +27,11 @@
 
 #define FRAC_EPSILON 0.00005
 
+/* Tags of chunks in sort keys; the end sorts before any chunk. */
+#define SORT_KEY_END     0x00
+#define SORT_KEY_NUMBER  0x01
+#define SORT_KEY_TEXT    0x02
+
 
 /*===========================================*/
 /* Private types                             */
@@ -45,6 +50,11 @@
 static gchar *span_digits (gchar **p);
 static gchar *span_non_digits (gchar **p);
 
+static void   append_number_chunk (GByteArray  *key,
+                                   const gchar *chunk);
+static void   append_text_chunk   (GByteArray  *key,
+                                   const gchar *chunk);
+
 /*===========================================*/
 /* Functions.                                */
 /*===========================================*/
@@ -191,6 +201,100 @@ lgl_str_part_name_cmp (const gchar *s1,
 }
 
 
+/**
+ * lgl_str_part_name_sort_key:
+ * @s: UTF-8 string representing a part name or number.
+ *
+ * Create a binary sort key for a part name or number, for sorting many names.
+ * Keys of two strings compare with g_bytes_compare(), a memcmp() of their
+ * bytes, in the natural sort order of lgl_str_part_name_cmp(), without any
+ * further case folding, collation or allocation.
+ *
+ * The key is a sequence of chunks.  A numeric chunk is its 64 bit value, most
+ * significant byte first; a non-numeric chunk is its g_utf8_collate_key(),
+ * ended by a zero byte.  Numeric chunks are tagged to sort before non-numeric
+ * chunks, where lgl_str_part_name_cmp() would collate the digits, so the two
+ * orders may differ in how they place a number against punctuation.
+ *
+ * Returns: a newly allocated #GBytes containing the key.
+ *
+ */
+GBytes *
+lgl_str_part_name_sort_key (const gchar *s)
+{
+        GByteArray *key;
+        gchar      *folded_s, *p, *chunk;
+        guint8      tag = SORT_KEY_END;
+
+        key = g_byte_array_new ();
+
+        if ( s != NULL )
+        {
+                folded_s = g_utf8_casefold (s, -1);
+
+                for ( p = folded_s; *p != '\0'; )
+                {
+                        if ( g_ascii_isdigit (*p) )
+                        {
+                                chunk = span_digits (&p);
+                                append_number_chunk (key, chunk);
+                        }
+                        else
+                        {
+                                chunk = span_non_digits (&p);
+                                append_text_chunk (key, chunk);
+                        }
+                        g_free (chunk);
+                }
+
+                g_free (folded_s);
+        }
+
+        /* A NULL string sorts first, like an empty one. */
+        g_byte_array_append (key, &tag, 1);
+
+        return g_byte_array_free_to_bytes (key);
+}
+
+
+static void
+append_number_chunk (GByteArray  *key,
+                     const gchar *chunk)
+{
+        guint8  data[9];
+        guint64 n;
+        gint    i;
+
+        n = g_ascii_strtoull (chunk, NULL, 10);
+
+        data[0] = SORT_KEY_NUMBER;
+        for ( i = 8; i > 0; i-- )
+        {
+                data[i] = n & 0xff;
+                n >>= 8;
+        }
+
+        g_byte_array_append (key, data, sizeof (data));
+}
+
+
+static void
+append_text_chunk (GByteArray  *key,
+                   const gchar *chunk)
+{
+        guint8  tag = SORT_KEY_TEXT;
+        gchar  *collate_key;
+
+        collate_key = g_utf8_collate_key (chunk, -1);
+
+        /* Include terminating zero, which sorts before any other byte. */
+        g_byte_array_append (key, &tag, 1);
+        g_byte_array_append (key, (const guint8 *)collate_key, strlen (collate_key) + 1);
+
+        g_free (collate_key);
+}
+
+
 static gchar *
 span_digits (gchar **p)
 {
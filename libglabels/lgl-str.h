@@ -31,6 +31,8 @@ gint   lgl_str_utf8_casecmp    (const gchar *s1,
 gint   lgl_str_part_name_cmp   (const gchar *s1,
                                 const gchar *s2);
 
+GBytes *lgl_str_part_name_sort_key (const gchar *s);
+
 gchar *lgl_str_format_fraction (gdouble      x);
 
 G_END_DECLS
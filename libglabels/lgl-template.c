@@ -98,6 +98,7 @@ lgl_template_new (const gchar         *brand,
         template->paper_id    = g_strdup (paper_id);
         template->page_width  = page_width;
         template->page_height = page_height;
+        template->ref_count   = 1;
 
         return template;
 }
@@ -1120,15 +1121,55 @@ lgl_template_dup (const lglTemplate *orig_template)
  *   @template: Template to free.
  *
  * This function frees all memory associated with given template structure.
+ * It is the same as lgl_template_unref(), so that it also releases templates
+ * shared with lgl_template_ref().
  *
  */
 void
 lgl_template_free (lglTemplate *template)
+{
+        lgl_template_unref (template);
+}
+
+
+/**
+ * lgl_template_ref:
+ *   @template: Template to reference.
+ *
+ * This function adds a reference to a template structure.  Templates are
+ * shared by reference, instead of being duplicated with lgl_template_dup(),
+ * where they are not to be modified, as for templates of the template database
+ * (see lgl_db_get_template_from_name()).
+ *
+ * Returns:  @template.
+ *
+ */
+lglTemplate *
+lgl_template_ref (lglTemplate *template)
+{
+        g_return_val_if_fail (template, NULL);
+
+        g_atomic_int_inc (&template->ref_count);
+
+        return template;
+}
+
+
+/**
+ * lgl_template_unref:
+ *   @template: Template to release.
+ *
+ * This function releases a reference to a template structure, and frees all
+ * memory associated with it when the last reference is released.
+ *
+ */
+void
+lgl_template_unref (lglTemplate *template)
 {
         GList            *p;
         lglTemplateFrame *frame;
 
-        if ( template != NULL )
+        if ( (template != NULL) && g_atomic_int_dec_and_test (&template->ref_count) )
         {
                 g_free (template->brand);
                 template->brand = NULL;
@@ -1136,12 +1177,18 @@ lgl_template_free (lglTemplate *template)
                 g_free (template->part);
                 template->part = NULL;
 
+                g_free (template->equiv_part);
+                template->equiv_part = NULL;
+
                 g_free (template->description);
                 template->description = NULL;
 
                 g_free (template->paper_id);
                 template->paper_id = NULL;
 
+                g_free (template->product_url);
+                template->product_url = NULL;
+
                 for ( p=template->category_ids; p != NULL; p=p->next )
                 {
                         g_free (p->data);
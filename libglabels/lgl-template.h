@@ -69,6 +69,9 @@ struct _lglTemplate {
          * template. */
         GList               *frames;
 
+        /* Private: number of references, see lgl_template_ref(). */
+        gint                 ref_count;
+
 };
 
 
@@ -392,6 +395,10 @@ lglTemplate         *lgl_template_dup                  (const lglTemplate    *or
 
 void                 lgl_template_free                 (lglTemplate          *template);
 
+lglTemplate         *lgl_template_ref                  (lglTemplate          *template);
+
+void                 lgl_template_unref                (lglTemplate          *template);
+
 lglTemplateFrame    *lgl_template_frame_dup            (const lglTemplateFrame     *orig_frame);
 void                 lgl_template_frame_free           (lglTemplateFrame           *frame);
 
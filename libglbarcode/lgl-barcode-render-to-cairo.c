@@ -44,11 +44,22 @@
 /* Private globals                           */
 /*===========================================*/
 
+/* Surface user data marking surfaces drawn with pixel snapping. */
+static const cairo_user_data_key_t pixel_snap_key;
+
 
 /*===========================================*/
 /* Local function prototypes                 */
 /*===========================================*/
 
+static gboolean is_pixel_aligned    (cairo_t *cr);
+
+static void     snapped_rectangle   (cairo_t *cr,
+                                     gdouble  x,
+                                     gdouble  y,
+                                     gdouble  w,
+                                     gdouble  h);
+
 
 /****************************************************************************/
 /**
@@ -62,6 +73,11 @@
  * barcode bounding box.  Context should be scaled such that all dimensions
  * are in points ( 1 point = 1/72 inch ) and that positive y coordinates
  * go down the surface.
+ *
+ * When rendering without rotation to an image surface for which pixel
+ * snapping was requested with lgl_barcode_render_set_pixel_snap(), the edges
+ * of bars and boxes are snapped to the pixel grid, so that bars of equal width
+ * are drawn with an equal whole number of pixels.
  */
 void
 lgl_barcode_render_to_cairo (const lglBarcode  *bc,
@@ -83,7 +99,10 @@ lgl_barcode_render_to_cairo (const lglBarcode  *bc,
         gdouble                 x_offset, y_offset;
         gint                    iw, ih;
         gdouble                 layout_width;
+        gboolean                snap_flag;
+
 
+        snap_flag = is_pixel_aligned (cr);
 
         for (p = bc->shapes; p != NULL; p = p->next) {
 
@@ -95,17 +114,33 @@ lgl_barcode_render_to_cairo (const lglBarcode  *bc,
                 case LGL_BARCODE_SHAPE_LINE:
                         line = (lglBarcodeShapeLine *) shape;
 
-                        cairo_move_to (cr, line->x, line->y);
-                        cairo_line_to (cr, line->x, line->y + line->length);
-                        cairo_set_line_width (cr, line->width);
-                        cairo_stroke (cr);
+                        if ( snap_flag )
+                        {
+                                snapped_rectangle (cr, line->x - line->width/2, line->y,
+                                                   line->width, line->length);
+                                cairo_fill (cr);
+                        }
+                        else
+                        {
+                                cairo_move_to (cr, line->x, line->y);
+                                cairo_line_to (cr, line->x, line->y + line->length);
+                                cairo_set_line_width (cr, line->width);
+                                cairo_stroke (cr);
+                        }
 
                         break;
 
                 case LGL_BARCODE_SHAPE_BOX:
                         box = (lglBarcodeShapeBox *) shape;
 
-                        cairo_rectangle (cr, box->x, box->y, box->width, box->height);
+                        if ( snap_flag )
+                        {
+                                snapped_rectangle (cr, box->x, box->y, box->width, box->height);
+                        }
+                        else
+                        {
+                                cairo_rectangle (cr, box->x, box->y, box->width, box->height);
+                        }
                         cairo_fill (cr);
 
                         break;
@@ -336,6 +371,94 @@ lgl_barcode_render_to_cairo_path (const lglBarcode  *bc,
 
 
 
+/****************************************************************************/
+/**
+ * lgl_barcode_render_set_pixel_snap:
+ * @surface:   A #cairo_surface_t image surface
+ * @snap_flag: %TRUE to snap barcodes drawn to @surface to its pixel grid
+ *
+ * Request that barcodes rendered to @surface with lgl_barcode_render_to_cairo()
+ * have the edges of their bars and boxes snapped to whole pixels.  This suits
+ * output that is not antialiased, such as 1 bit per pixel images for thermal
+ * printers, where bars of equal width should not differ by a pixel.  Other
+ * surfaces are drawn unsnapped.
+ */
+void
+lgl_barcode_render_set_pixel_snap (cairo_surface_t *surface,
+                                   gboolean         snap_flag)
+{
+        cairo_surface_set_user_data (surface, &pixel_snap_key,
+                                     GINT_TO_POINTER (snap_flag), NULL);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Does context draw to pixels that are to be snapped to, with    */
+/* user axes along pixel rows?                                              */
+/*--------------------------------------------------------------------------*/
+static gboolean
+is_pixel_aligned (cairo_t *cr)
+{
+        cairo_surface_t *surface;
+        cairo_matrix_t   matrix;
+
+        surface = cairo_get_target (cr);
+        if ( (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE) ||
+             !cairo_surface_get_user_data (surface, &pixel_snap_key) )
+        {
+                return FALSE;
+        }
+
+        cairo_get_matrix (cr, &matrix);
+
+        return ( (fabs (matrix.xy) < 1e-6) && (fabs (matrix.yx) < 1e-6) ) ||
+                ( (fabs (matrix.xx) < 1e-6) && (fabs (matrix.yy) < 1e-6) );
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Add rectangle, with its corner and size rounded to pixels.     */
+/*                                                                          */
+/* The size is rounded separately from the corner, so that it does not      */
+/* depend on where the rectangle falls relative to the pixel grid.  Sizes   */
+/* below one pixel are not snapped, rather than widened to a whole pixel.   */
+/*--------------------------------------------------------------------------*/
+static void
+snapped_rectangle (cairo_t *cr,
+                   gdouble  x,
+                   gdouble  y,
+                   gdouble  w,
+                   gdouble  h)
+{
+        gdouble x1 = x,     y1 = y;
+        gdouble x2 = x + w, y2 = y + h;
+        gdouble dx, dy, dw, dh;
+
+        cairo_user_to_device (cr, &x1, &y1);
+        cairo_user_to_device (cr, &x2, &y2);
+
+        if ( (fabs (x2 - x1) < 1.0) || (fabs (y2 - y1) < 1.0) )
+        {
+                cairo_rectangle (cr, x, y, w, h);
+                return;
+        }
+
+        dx = floor (MIN (x1, x2) + 0.5);
+        dy = floor (MIN (y1, y2) + 0.5);
+        dw = floor (fabs (x2 - x1) + 0.5);
+        dh = floor (fabs (y2 - y1) + 0.5);
+
+        x1 = dx;      y1 = dy;
+        x2 = dx + dw; y2 = dy + dh;
+
+        cairo_device_to_user (cr, &x1, &y1);
+        cairo_device_to_user (cr, &x2, &y2);
+
+        cairo_rectangle (cr, MIN (x1, x2), MIN (y1, y2), fabs (x2 - x1), fabs (y2 - y1));
+}
+
+
+
 /*
  * Local Variables:       -- emacs
  * mode: C                -- emacs
@@ -32,6 +32,9 @@ void  lgl_barcode_render_to_cairo      (const lglBarcode *bc,
 void  lgl_barcode_render_to_cairo_path (const lglBarcode *bc,
                                         cairo_t          *cr);
 
+void  lgl_barcode_render_set_pixel_snap (cairo_surface_t *surface,
+                                         gboolean         snap_flag);
+
 G_END_DECLS
 
 #endif /* __LGL_RENDER_TO_CAIRO_H__ */
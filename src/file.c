@@ -132,13 +132,13 @@ new_complete (GtkDialog *dialog,
 
         rotate_flag = gl_new_label_dialog_get_rotate_state (GL_NEW_LABEL_DIALOG (dialog));
 
-        template = lgl_db_lookup_template_from_name (sheet_name);
+        template = lgl_db_get_template_from_name (sheet_name);
 
         label = GL_LABEL(gl_label_new ());
         gl_label_set_template (label, template, FALSE);
         gl_label_set_rotate_flag (label, rotate_flag, FALSE);
 
-        lgl_template_free (template);
+        lgl_template_unref (template);
 
         window = GL_WINDOW (g_object_get_data (G_OBJECT (dialog), "parent_window"));
         if ( gl_window_is_empty (window) )
@@ -253,13 +253,15 @@ properties_choose_complete (GtkDialog *dialog,
 
         rotate_flag = gl_new_label_dialog_get_rotate_state (GL_NEW_LABEL_DIALOG (dialog));
 
-        template = lgl_db_lookup_template_from_name (sheet_name);
+        template = lgl_db_get_template_from_name (sheet_name);
 
         label = GL_LABEL(g_object_get_data (G_OBJECT (dialog), "label"));
 
         gl_label_set_template (label, template, TRUE);
         gl_label_set_rotate_flag (label, rotate_flag, TRUE);
 
+        lgl_template_unref (template);
+
 	gl_debug (DEBUG_FILE, "END");
 }
 
@@ -21,8 +21,15 @@
 #include <config.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
 
+#include <locale.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <libglabels.h>
 #include "merge-init.h"
@@ -33,45 +40,198 @@
 #include "print-op.h"
 #include "file-util.h"
 #include "prefs.h"
+#include "stats.h"
 #include "debug.h"
 
+/*============================================*/
+/* Private types                              */
+/*============================================*/
+
+/* Options of a single job. */
+typedef struct {
+        gchar     *output;
+        gint       n_copies;
+        gint       n_sheets;
+        gint       first;
+        gboolean   outline_flag;
+        gboolean   reverse_flag;
+        gboolean   crop_marks_flag;
+        gchar     *input;
+        gchar     *records;
+        gchar     *shard;
+        gint       n_jobs;
+        gdouble    dpi;
+        gboolean   dither_flag;
+        gint       pages_per_file;
+        gchar     *max_file_size;
+        gchar    **remaining_args;
+} JobOptions;
+
+/* Label kept open, with size and modification time of its file when read. */
+typedef struct {
+        glLabel   *label;
+        gint64     size;
+        gint64     mtime;
+} LoadedLabel;
+
+
 /*============================================*/
 /* Private globals                            */
 /*============================================*/
-static gchar    *output          = "output.pdf";
-static gint     n_copies         = 1;
-static gint     n_sheets         = 1;
-static gint     first            = 1;
-static gboolean outline_flag     = FALSE;
-static gboolean reverse_flag     = FALSE;
-static gboolean crop_marks_flag  = FALSE;
-static gchar    *input           = NULL;
-static gchar    **remaining_args = NULL;
+
+/* Job options are parsed into here, then copied out. */
+static JobOptions options = {
+        "output.pdf",   /* output */
+        1,              /* n_copies */
+        1,              /* n_sheets */
+        1,              /* first */
+        FALSE,          /* outline_flag */
+        FALSE,          /* reverse_flag */
+        FALSE,          /* crop_marks_flag */
+        NULL,           /* input */
+        NULL,           /* records */
+        NULL,           /* shard */
+        1,              /* n_jobs */
+        300.0,          /* dpi */
+        FALSE,          /* dither_flag */
+        0,              /* pages_per_file */
+        NULL,           /* max_file_size */
+        NULL            /* remaining_args */
+};
 
 static GOptionEntry option_entries[] = {
-        {"output", 'o', 0, G_OPTION_ARG_STRING, &output,
-         N_("set output filename (default=\"output.pdf\")"), N_("filename")},
-        {"sheets", 's', 0, G_OPTION_ARG_INT, &n_sheets,
+        {"output", 'o', 0, G_OPTION_ARG_STRING, &options.output,
+         N_("set output filename, format from extension .pdf, .ps, .svg, .png, .tif or .pbm (default=\"output.pdf\"); merge fields, e.g. \"${id}.pdf\", give one file per label"), N_("filename")},
+        {"sheets", 's', 0, G_OPTION_ARG_INT, &options.n_sheets,
          N_("number of sheets (default=1)"), N_("sheets")},
-        {"copies", 'c', 0, G_OPTION_ARG_INT, &n_copies,
+        {"copies", 'c', 0, G_OPTION_ARG_INT, &options.n_copies,
          N_("number of copies (default=1)"), N_("copies")},
-        {"first", 'f', 0, G_OPTION_ARG_INT, &first,
+        {"first", 'f', 0, G_OPTION_ARG_INT, &options.first,
          N_("first label on first sheet (default=1)"), N_("first")},
-        {"outline", 'l', 0, G_OPTION_ARG_NONE, &outline_flag,
+        {"outline", 'l', 0, G_OPTION_ARG_NONE, &options.outline_flag,
          N_("print outlines (to test printer alignment)"), NULL},
-        {"reverse", 'r', 0, G_OPTION_ARG_NONE, &reverse_flag,
+        {"reverse", 'r', 0, G_OPTION_ARG_NONE, &options.reverse_flag,
          N_("print in reverse (i.e. a mirror image)"), NULL},
-        {"cropmarks", 'C', 0, G_OPTION_ARG_NONE, &crop_marks_flag,
+        {"cropmarks", 'C', 0, G_OPTION_ARG_NONE, &options.crop_marks_flag,
          N_("print crop marks"), NULL},
-        {"input", 'i', 0, G_OPTION_ARG_STRING, &input,
+        {"input", 'i', 0, G_OPTION_ARG_STRING, &options.input,
          N_("input file for merging"), N_("filename")},
+        {"records", 0, 0, G_OPTION_ARG_STRING, &options.records,
+         N_("only print merge records START to END (default=all)"), N_("START-END")},
+        {"shard", 0, 0, G_OPTION_ARG_STRING, &options.shard,
+         N_("only print K'th of N equal runs of whole sheets"), N_("K/N")},
+        {"jobs", 'j', 0, G_OPTION_ARG_INT, &options.n_jobs,
+         N_("number of threads drawing pages, or with --serve of jobs run at once, 0 for one per processor (default=1)"), N_("jobs")},
+        {"dpi", 0, 0, G_OPTION_ARG_DOUBLE, &options.dpi,
+         N_("resolution of .png and .tif output, one image per sheet, or of .pbm output, one monochrome image per label (default=300)"), N_("dpi")},
+        {"dither", 0, 0, G_OPTION_ARG_NONE, &options.dither_flag,
+         N_("dither .pbm output, rather than threshold it"), NULL},
+        {"pages-per-file", 0, 0, G_OPTION_ARG_INT, &options.pages_per_file,
+         N_("split .pdf, .ps or .svg output into numbered files of at most N sheets"), N_("N")},
+        {"max-file-size", 0, 0, G_OPTION_ARG_STRING, &options.max_file_size,
+         N_("split .pdf, .ps or .svg output into numbered files of about at most SIZE bytes, with optional k, M or G suffix"), N_("SIZE")},
         { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY,
-          &remaining_args, NULL, N_("[FILE...]") },
+          &options.remaining_args, NULL, N_("[FILE...]") },
         { NULL }
 };
 
+/* Options of the whole process, not of single jobs. */
+static gchar    *cache_dir       = NULL;
+static gchar    *manifest        = NULL;
+static gchar    *socket_path     = NULL;
+static gchar    *stats_file      = NULL;
+
+static GOptionEntry process_option_entries[] = {
+        {"merge-cache", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir,
+         N_("cache parsed merge sources in directory, for reuse by later runs"), N_("directory")},
+        {"manifest", 'm', 0, G_OPTION_ARG_FILENAME, &manifest,
+         N_("also run jobs listed in file, one per line, each given as options and files like those of this command"), N_("filename")},
+        {"serve", 0, 0, G_OPTION_ARG_FILENAME, &socket_path,
+         N_("run jobs sent to Unix domain socket, only accessible to this user, returning their output, until killed"), N_("socket")},
+        {"stats", 0, 0, G_OPTION_ARG_FILENAME, &stats_file,
+         N_("write counts and timings of all jobs to file, as JSON; with --serve, after each job"), N_("filename")},
+        { NULL }
+};
+
+/* Guards options while job lines are parsed. */
+static GMutex      options_mutex;
+
+/* Labels already opened (LoadedLabel), by filename, kept to reuse their caches. */
+static GHashTable *loaded_labels = NULL;
+static GMutex      loaded_labels_mutex;
+
+
+
+/*============================================*/
+/* Private function prototypes                */
+/*============================================*/
+static gboolean    run_job          (const JobOptions  *opts,
+                                     glLabel           *label,
+                                     const gchar       *prgname,
+                                     gboolean          *output_ok);
+
+static gboolean    print_label      (glLabel           *label,
+                                     const gchar       *filename,
+                                     const JobOptions  *opts,
+                                     gint               record_start,
+                                     gint               record_end,
+                                     gint               i_shard,
+                                     gint               n_shards,
+                                     goffset            max_size);
+
+static gboolean    run_manifest     (const gchar       *filename,
+                                     const JobOptions  *defaults,
+                                     const gchar       *prgname);
+
+static gboolean    serve            (const gchar       *path,
+                                     const JobOptions  *defaults,
+                                     const gchar       *prgname);
+
+static gboolean    serve_run_cb     (GThreadedSocketService *service,
+                                     GSocketConnection *connection,
+                                     GObject           *source_object,
+                                     gpointer           user_data);
+
+static gchar      *serve_job        (GDataInputStream  *in,
+                                     GOutputStream     *out,
+                                     const JobOptions  *defaults,
+                                     const gchar       *prgname);
+
+static gchar      *read_chunk       (GDataInputStream  *in,
+                                     const gchar       *header,
+                                     gsize             *length);
+
+static JobOptions *parse_job_line   (const gchar       *line,
+                                     const JobOptions  *defaults,
+                                     const gchar       *prgname,
+                                     GError           **error);
+
+static JobOptions *job_options_dup  (const JobOptions  *opts);
+
+static void        job_options_free (JobOptions        *opts);
+
+static glLabel    *load_label       (const gchar       *filename);
+
+static void        loaded_label_free (LoadedLabel       *loaded);
+
+static gboolean    parse_pair       (const gchar       *text,
+                                     gchar              separator,
+                                     gint              *value1,
+                                     gint              *value2);
+
+static gboolean    parse_size       (const gchar       *text,
+                                     goffset           *size);
+
+static gboolean    is_raster        (const gchar       *filename);
+
+static gboolean    is_per_label     (const gchar       *filename);
+
+static gboolean    export           (glPrintOp         *print_op,
+                                     const gchar       *filename,
+                                     const JobOptions  *opts);
+
+
 
-
 /*****************************************************************************/
 /* Main                                                                      */
 /*****************************************************************************/
@@ -79,16 +239,10 @@ int
 main (int argc, char **argv)
 {
 	GOptionContext    *option_context;
-        GList             *p, *file_list = NULL;
-        gchar             *abs_fn;
-        glLabel           *label = NULL;
-        glMerge           *merge = NULL;
-        const lglTemplate *template;
-        lglTemplateFrame  *frame;
-        glXMLLabelStatus   status;
-        glPrintOp         *print_op;
-	gchar	          *utf8_filename;
         GError            *error = NULL;
+        JobOptions        *defaults;
+        gboolean           ok;
+        glStatsTimer       timer;
 
         bindtextdomain (GETTEXT_PACKAGE, GLABELS_LOCALE_DIR);
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
@@ -98,10 +252,11 @@ main (int argc, char **argv)
         g_option_context_set_summary (option_context,
                                       _("Print files created with gLabels."));
 	g_option_context_add_main_entries (option_context, option_entries, GETTEXT_PACKAGE);
+	g_option_context_add_main_entries (option_context, process_option_entries, GETTEXT_PACKAGE);
 
 
-        /* Initialize minimal gtk program */
-        gtk_parse_args (&argc, &argv);
+        /* Output is written with cairo alone, so GTK needs no initialization. */
+        setlocale (LC_ALL, "");
         if (!g_option_context_parse (option_context, &argc, &argv, &error))
 	{
 	        g_print(_("%s\nRun '%s --help' to see a full list of available command line options.\n"),
@@ -110,87 +265,987 @@ main (int argc, char **argv)
 		return 1;
 	}
 
+        /*
+         * Initialize components once, so that the template database, merge
+         * backends and fonts stay loaded for every job of a manifest or of
+         * the server.
+         */
+        gl_debug_init ();
+        if (stats_file != NULL)
+        {
+                gl_stats_enable ();
+        }
+        gl_merge_init ();
+        gl_merge_set_default_stream_flag (TRUE); /* Records are only needed in order. */
+        gl_merge_set_cache_dir (cache_dir);
+
+        /* Only the templates of the labels printed are read. */
+        gl_stats_timer_start (&timer);
+        lgl_db_init_lazy ();
+        gl_stats_add_phase (GL_STATS_PHASE_DB, &timer);
+        gl_prefs_init_null ();
+	gl_template_history_init_null ();
+	gl_font_history_init_null ();
+
+        loaded_labels = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, (GDestroyNotify)loaded_label_free);
+
+        defaults = job_options_dup (&options);
+
+        ok = run_job (defaults, NULL, argv[0], NULL);
+
+        /* Label files of the command line are not printed again. */
+        g_strfreev (defaults->remaining_args);
+        defaults->remaining_args = NULL;
+
+        if (ok && (manifest != NULL))
+        {
+                ok = run_manifest (manifest, defaults, argv[0]);
+        }
+        if (ok && (socket_path != NULL))
+        {
+                ok = serve (socket_path, defaults, argv[0]);
+        }
+
+        if (stats_file != NULL)
+        {
+                if (!gl_stats_write (stats_file, &error))
+                {
+                        fprintf ( stderr, _("cannot write statistics: %s\n"), error->message );
+                        g_error_free (error);
+                        ok = FALSE;
+                }
+        }
+
+        job_options_free (defaults);
+        g_hash_table_destroy (loaded_labels);
+
+        return ok ? 0 : 1;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Print job, either the given label or the label files of job.    */
+/*                                                                           */
+/* Returns FALSE if the options are invalid.  If output_ok is not NULL, it  */
+/* is set to FALSE if a label file could not be opened or its output could   */
+/* not be written, and to TRUE otherwise (even if there was nothing to       */
+/* print).                                                                   */
+/*---------------------------------------------------------------------------*/
+static gboolean
+run_job (const JobOptions *opts,
+         glLabel          *label,
+         const gchar      *prgname,
+         gboolean         *output_ok)
+{
+        GList             *p, *file_list = NULL;
+	gchar	          *utf8_filename;
+        glMerge           *merge;
+        gint               record_start = 1, record_end = -1;
+        gint               i_shard = 1, n_shards = 1;
+        goffset            max_size = 0;
+        gboolean           ok = TRUE;
+
+        if ( ((opts->records != NULL) && (!parse_pair (opts->records, '-', &record_start, &record_end) ||
+                                          (record_start < 1) ||
+                                          ((record_end >= 0) && (record_end < record_start)))) ||
+             ((opts->shard != NULL) && (!parse_pair (opts->shard, '/', &i_shard, &n_shards) ||
+                                        (n_shards < 1) || (i_shard < 1) || (i_shard > n_shards))) ||
+             (opts->dpi <= 0) || (opts->pages_per_file < 0) ||
+             ((opts->max_file_size != NULL) && !parse_size (opts->max_file_size, &max_size)) )
+        {
+	        g_print(_("Invalid record range, shard, resolution or file size\nRun '%s --help' to see a full list of available command line options.\n"),
+			prgname);
+		return FALSE;
+        }
+
+        if (label != NULL)
+        {
+                file_list = g_list_append (file_list, g_strdup ("-"));
+        }
 
         /* create file list */
-	if (remaining_args != NULL) {
+	else if (opts->remaining_args != NULL) {
 		gint i, num_args;
 
-		num_args = g_strv_length (remaining_args);
+		num_args = g_strv_length (opts->remaining_args);
 		for (i = 0; i < num_args; ++i) {
-			utf8_filename = g_filename_to_utf8 (remaining_args[i], -1, NULL, NULL, NULL);
+			utf8_filename = g_filename_to_utf8 (opts->remaining_args[i], -1, NULL, NULL, NULL);
 			if (utf8_filename)
 				file_list = g_list_append (file_list, utf8_filename);
 		}
-		g_strfreev (remaining_args);
-		remaining_args = NULL;
 	}
 
-        /* initialize components */
-        gl_debug_init ();
-        gl_merge_init ();
-        lgl_db_init ();
-        gl_prefs_init_null ();
-	gl_template_history_init_null ();
-	gl_font_history_init_null ();
-
         /* now print the files */
         for (p = file_list; p; p = p->next) {
                 g_print ("LABEL FILE = %s\n", (gchar *) p->data);
-                label = gl_xml_label_open (p->data, &status);
+                if (label != NULL)
+                {
+                        label = g_object_ref (label);
+                }
+                else
+                {
+                        label = load_label (p->data);
+                }
 
 
-                if ( status == XML_LABEL_OK ) {
+                if ( label != NULL ) {
 
-                        merge = gl_label_get_merge (label);
-                        if (input != NULL) {
+                        if (opts->input != NULL) {
+                                merge = gl_label_get_merge (label);
                                 if (merge != NULL) {
-                                        gl_merge_set_src(merge, input);
+                                        gl_merge_set_src(merge, opts->input);
                                         gl_label_set_merge(label, merge, FALSE);
+                                        g_object_unref (merge);
                                 } else {
                                         fprintf ( stderr,
                                                   _("cannot perform document merge with glabels file %s\n"),
                                                   (char *)p->data );
                                 }
                         }
-                        abs_fn = gl_file_util_make_absolute ( output );
-                        template = gl_label_get_template (label);
-                        frame = (lglTemplateFrame *)template->frames->data;
-
-                        print_op = gl_print_op_new (label);
-                        gl_print_op_set_filename        (print_op, abs_fn);
-                        gl_print_op_set_n_copies        (print_op, n_copies);
-                        gl_print_op_set_first           (print_op, first);
-                        gl_print_op_set_outline_flag    (print_op, outline_flag);
-                        gl_print_op_set_reverse_flag    (print_op, reverse_flag);
-                        gl_print_op_set_crop_marks_flag (print_op, crop_marks_flag);
-                        if (merge)
-                        {
-                                gl_print_op_set_n_sheets (print_op,
-                                                          ceil ((double)(first-1 + n_copies * gl_merge_get_record_count(merge))
-                                                                / lgl_template_frame_get_n_labels (frame)));
-                        }
-                        else
-                        {
-                                gl_print_op_set_n_sheets (print_op, n_sheets);
-                                gl_print_op_set_last     (print_op,
-                                                          lgl_template_frame_get_n_labels (frame));
-                        }
-                        gtk_print_operation_run (GTK_PRINT_OPERATION (print_op),
-                                                 GTK_PRINT_OPERATION_ACTION_EXPORT,
-                                                 NULL,
-                                                 NULL);
+
+                        ok = print_label (label, p->data, opts,
+                                          record_start, record_end, i_shard, n_shards, max_size) && ok;
 
                         g_object_unref (label);
+                        label = NULL;
                 }
                 else {
                         fprintf ( stderr, _("cannot open glabels file %s\n"),
                                   (char *)p->data );
+                        ok = FALSE;
+                }
+        }
+
+        g_list_free_full (file_list, g_free);
+
+        if (output_ok != NULL)
+        {
+                *output_ok = ok;
+        }
+
+        return TRUE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Print one label file of a job.                                  */
+/*                                                                           */
+/* Returns FALSE if output could not be written.  A job with nothing to      */
+/* print writes no output and is not an error.                               */
+/*---------------------------------------------------------------------------*/
+static gboolean
+print_label (glLabel          *label,
+             const gchar      *filename,
+             const JobOptions *opts,
+             gint              record_start,
+             gint              record_end,
+             gint              i_shard,
+             gint              n_shards,
+             goffset           max_size)
+{
+        gchar             *abs_fn;
+        glMerge           *merge;
+        const lglTemplate *template;
+        lglTemplateFrame  *frame;
+        glPrintOp         *print_op;
+        gint               n_records, window_end, n_job_sheets, first_sheet;
+        gint               first_record, n_labels;
+        gboolean           ok = TRUE;
+
+        merge = gl_label_get_merge (label);
+
+        abs_fn = gl_file_util_make_absolute ( opts->output );
+        template = gl_label_get_template (label);
+        frame = (lglTemplateFrame *)template->frames->data;
+
+        print_op = gl_print_op_new (label);
+        gl_print_op_set_filename        (print_op, abs_fn);
+        gl_print_op_set_n_copies        (print_op, opts->n_copies);
+        gl_print_op_set_first           (print_op, opts->first);
+        gl_print_op_set_outline_flag    (print_op, opts->outline_flag);
+        gl_print_op_set_reverse_flag    (print_op, opts->reverse_flag);
+        gl_print_op_set_crop_marks_flag (print_op, opts->crop_marks_flag);
+        gl_print_op_set_n_threads       (print_op, (opts->n_jobs > 0) ? opts->n_jobs : (gint)g_get_num_processors ());
+        gl_print_op_set_pages_per_file  (print_op, opts->pages_per_file);
+        gl_print_op_set_max_file_size   (print_op, max_size);
+        if (merge)
+        {
+                /* Window of records, 1-based and inclusive. */
+                n_records  = gl_merge_get_record_count (merge);
+                gl_print_op_set_n_records (print_op, n_records);
+                window_end = record_end;
+                if ( (window_end < 0) || (window_end > n_records) )
+                {
+                        window_end = n_records;
+                }
+                n_records = MAX (window_end - record_start + 1, 0);
+                gl_print_op_set_record_range (print_op, record_start - 1, window_end);
+
+                /* Per-label output: shards split the records. */
+                first_record = record_start - 1 + n_records * (i_shard - 1) / n_shards;
+                n_labels     = n_records * i_shard / n_shards - n_records * (i_shard - 1) / n_shards;
+                if (is_per_label (abs_fn))
+                {
+                        gl_print_op_set_record_range (print_op, first_record,
+                                                      first_record + n_labels);
+                }
+
+                n_job_sheets = 0;
+                if (n_records > 0)
+                {
+                        n_job_sheets = ceil ((double)(opts->first-1 + opts->n_copies * n_records)
+                                             / lgl_template_frame_get_n_labels (frame));
+                }
+        }
+        else
+        {
+                n_job_sheets = opts->n_sheets;
+                gl_print_op_set_last     (print_op,
+                                          lgl_template_frame_get_n_labels (frame));
+
+                /* Per-label output: only the first shard prints. */
+                n_labels = (i_shard == 1) ? opts->n_copies : 0;
+        }
+
+        /*
+         * Each shard prints a run of whole sheets of the job,
+         * so that shard outputs concatenate into the full job.
+         */
+        first_sheet = n_job_sheets * (i_shard - 1) / n_shards;
+        gl_print_op_set_first_sheet (print_op, first_sheet);
+        gl_print_op_set_n_sheets (print_op,
+                                  n_job_sheets * i_shard / n_shards - first_sheet);
+
+        if ( is_per_label (abs_fn) ? (n_labels > 0) :
+             (gl_print_op_get_n_sheets (print_op) > 0) )
+        {
+                if (!export (print_op, abs_fn, opts))
+                {
+                        fprintf ( stderr, _("cannot write output file %s\n"),
+                                  abs_fn );
+                        ok = FALSE;
+                }
+                else if (merge)
+                {
+                        /* Records of shard, however often re-read. */
+                        gl_stats_count (GL_STATS_RECORDS, n_labels);
+                }
+        }
+        else
+        {
+                fprintf ( stderr, _("nothing to print for glabels file %s\n"),
+                          filename );
+        }
+
+        g_object_unref (print_op);
+        g_free (abs_fn);
+        if (merge)
+        {
+                g_object_unref (merge);
+        }
+
+        return ok;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Run jobs of manifest, one per line.                             */
+/*                                                                           */
+/* Each line holds job options and label files, with shell quoting, e.g.     */
+/*     -i orders.csv -o "orders 1.pdf" -c 2 shipping.glabels                 */
+/* Options not given default to those of the command line.  Empty lines and  */
+/* lines starting with "#" are skipped.                                      */
+/*---------------------------------------------------------------------------*/
+static gboolean
+run_manifest (const gchar      *filename,
+              const JobOptions *defaults,
+              const gchar      *prgname)
+{
+        gchar       *contents;
+        gchar      **lines;
+        gint         i_line;
+        JobOptions  *opts;
+        GError      *error = NULL;
+        gboolean     ok = TRUE;
+
+        if (!g_file_get_contents (filename, &contents, NULL, &error))
+        {
+                fprintf ( stderr, _("cannot read manifest %s: %s\n"), filename, error->message );
+                g_error_free (error);
+                return FALSE;
+        }
+        lines = g_strsplit (contents, "\n", -1);
+        g_free (contents);
+
+        for (i_line = 0; lines[i_line] != NULL; i_line++)
+        {
+                g_strstrip (lines[i_line]);
+                if ( (lines[i_line][0] == '\0') || (lines[i_line][0] == '#') )
+                {
+                        continue;
+                }
+
+                opts = parse_job_line (lines[i_line], defaults, prgname, &error);
+                if (opts == NULL)
+                {
+                        fprintf ( stderr, "%s:%d: %s\n", filename, i_line + 1, error->message );
+                        g_clear_error (&error);
+                        ok = FALSE;
+                        continue;
+                }
+
+                ok = run_job (opts, NULL, prgname, NULL) && ok;
+
+                job_options_free (opts);
+        }
+
+        g_strfreev (lines);
+
+        return ok;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Serve jobs on Unix domain socket, until killed.                 */
+/*                                                                           */
+/* Each connection carries one job.  The client sends a job line, as in a    */
+/* manifest, optionally followed by the label file and merge input inline,   */
+/* then "END":                                                               */
+/*     JOB -o label.pdf -c 2 /path/shipping.glabels                          */
+/*     LABEL <length>\n<length bytes of .glabels file>                       */
+/*     INPUT <length>\n<length bytes of merge input>                         */
+/*     END                                                                   */
+/* Only the base name of the output filename is used.  Each file written by  */
+/* the job is returned as "FILE <name> <length>\n<length bytes>", followed   */
+/* by "DONE", or else "ERROR <message>" is returned, e.g. "ERROR nothing to */
+/* print" for an empty job or "ERROR cannot write output" if it failed.      */
+/* Paths in the job line are relative to the working directory of the       */
+/* server.                                                                   */
+/*                                                                           */
+/* Up to --jobs jobs run at once; each draws its pages on one thread unless  */
+/* its job line has its own --jobs option.                                   */
+/*---------------------------------------------------------------------------*/
+typedef struct {
+        const JobOptions *defaults;
+        const gchar      *prgname;
+} ServeData;
+
+static gboolean
+serve (const gchar      *path,
+       const JobOptions *defaults,
+       const gchar      *prgname)
+{
+        ServeData        data;
+        JobOptions      *job_defaults;
+        GSocketService  *service;
+        GSocketAddress  *address;
+        GMainLoop       *loop;
+        GError          *error = NULL;
+        gint             n_jobs;
+        GStatBuf         st;
+        mode_t           old_mask;
+        gboolean         ok;
+
+        n_jobs = (defaults->n_jobs > 0) ? defaults->n_jobs : (gint)g_get_num_processors ();
+
+        job_defaults         = job_options_dup (defaults);
+        job_defaults->n_jobs = 1;
+
+        data.defaults = job_defaults;
+        data.prgname  = prgname;
+
+        /*
+         * A socket left by an earlier server would refuse the address.  Any
+         * other file at the path is left alone, and binding fails instead.
+         */
+        if ( (g_lstat (path, &st) == 0) && S_ISSOCK (st.st_mode) )
+        {
+                g_unlink (path);
+        }
+
+        /* Jobs read and write files as this user, so only it may connect. */
+        service  = g_threaded_socket_service_new (n_jobs);
+        address  = g_unix_socket_address_new (path);
+        old_mask = umask (0077);
+        ok = g_socket_listener_add_address (G_SOCKET_LISTENER (service), address,
+                                            G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                            NULL, NULL, &error);
+        umask (old_mask);
+        if (!ok)
+        {
+                fprintf ( stderr, _("cannot listen on %s: %s\n"), path, error->message );
+                g_error_free (error);
+                g_object_unref (address);
+                g_object_unref (service);
+                job_options_free (job_defaults);
+                return FALSE;
+        }
+        g_object_unref (address);
+
+        g_signal_connect (service, "run", G_CALLBACK (serve_run_cb), &data);
+        g_socket_service_start (service);
+
+        loop = g_main_loop_new (NULL, FALSE);
+        g_main_loop_run (loop);
+
+        g_main_loop_unref (loop);
+        g_object_unref (service);
+        job_options_free (job_defaults);
+
+        return TRUE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Serve connection, in thread of socket service.                  */
+/*---------------------------------------------------------------------------*/
+static gboolean
+serve_run_cb (GThreadedSocketService *service,
+              GSocketConnection      *connection,
+              GObject                *source_object,
+              gpointer                user_data)
+{
+        ServeData        *data = user_data;
+        GDataInputStream *in;
+        GOutputStream    *out;
+        gchar            *message;
+        gchar            *reply;
+
+        in  = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+        out = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+        message = serve_job (in, out, data->defaults, data->prgname);
+        if (message != NULL)
+        {
+                reply = g_strdup_printf ("ERROR %s\n", message);
+                g_output_stream_write_all (out, reply, strlen (reply), NULL, NULL, NULL);
+                g_free (reply);
+                g_free (message);
+
+                /* Unread data of request must not be taken for another. */
+                g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+        }
+
+        g_object_unref (in);
+
+        if (stats_file != NULL)
+        {
+                gl_stats_write (stats_file, NULL);
+        }
+
+        return TRUE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read, run and answer job of connection.                         */
+/*                                                                           */
+/* Returns NULL on success, otherwise an error message to return.           */
+/*---------------------------------------------------------------------------*/
+static gchar *
+serve_job (GDataInputStream *in,
+           GOutputStream    *out,
+           const JobOptions *defaults,
+           const gchar      *prgname)
+{
+        gchar             *line, *job_line = NULL;
+        gchar             *label_data = NULL, *input_data = NULL;
+        gsize              label_length = 0, input_length = 0;
+        gchar             *tmp_dir, *out_dir, *name, *filename, *contents, *header;
+        GError            *error = NULL;
+        JobOptions        *opts = NULL;
+        glLabel           *label = NULL;
+        glXMLLabelStatus   status;
+        GDir              *dir;
+        GList             *names = NULL, *p;
+        gsize              length;
+        gchar             *message = NULL;
+        gboolean           output_ok = TRUE;
+
+        /* Read request. */
+        while ( (line = g_data_input_stream_read_line (in, NULL, NULL, NULL)) != NULL )
+        {
+                g_strchomp (line);
+                if (g_str_has_prefix (line, "JOB "))
+                {
+                        g_free (job_line);
+                        job_line = g_strdup (line + 4);
+                }
+                else if (g_str_has_prefix (line, "LABEL "))
+                {
+                        g_free (label_data);
+                        label_data = read_chunk (in, line, &label_length);
+                        if (label_data == NULL)
+                        {
+                                /* Connection is dropped after answer. */
+                                g_free (line);
+                                message = g_strdup ("incomplete LABEL data");
+                                goto done;
+                        }
+                }
+                else if (g_str_has_prefix (line, "INPUT "))
+                {
+                        g_free (input_data);
+                        input_data = read_chunk (in, line, &input_length);
+                        if (input_data == NULL)
+                        {
+                                /* Connection is dropped after answer. */
+                                g_free (line);
+                                message = g_strdup ("incomplete INPUT data");
+                                goto done;
+                        }
+                }
+                else if (strcmp (line, "END") == 0)
+                {
+                        g_free (line);
+                        break;
                 }
+                g_free (line);
+        }
+        if (line == NULL)
+        {
+                message = g_strdup ("incomplete request");
+                goto done;
+        }
+        if (job_line == NULL)
+        {
+                message = g_strdup ("no JOB line");
+                goto done;
+        }
+
+        opts = parse_job_line (job_line, defaults, prgname, &error);
+        if (opts == NULL)
+        {
+                message = g_strdup (error->message);
+                g_error_free (error);
+                goto done;
+        }
+
+        /* Inline merge input and output go to a directory of the job. */
+        tmp_dir = g_dir_make_tmp ("glabels-batch-XXXXXX", &error);
+        if (tmp_dir == NULL)
+        {
+                message = g_strdup (error->message);
+                g_error_free (error);
+                goto done;
+        }
+        out_dir = g_build_filename (tmp_dir, "out", NULL);
+        g_mkdir (out_dir, 0700);
+
+        name = g_path_get_basename (opts->output);
+        g_free (opts->output);
+        opts->output = g_build_filename (out_dir, name, NULL);
+        g_free (name);
+
+        if (input_data != NULL)
+        {
+                g_free (opts->input);
+                opts->input = g_build_filename (tmp_dir, "input", NULL);
+                g_file_set_contents (opts->input, input_data, input_length, NULL);
         }
 
-        g_list_free (file_list);
+        if (label_data != NULL)
+        {
+                /* Opening labels may read templates, see load_label(). */
+                g_mutex_lock (&loaded_labels_mutex);
+                label = gl_xml_label_open_buffer (label_data, &status);
+                g_mutex_unlock (&loaded_labels_mutex);
+                if (status != XML_LABEL_OK)
+                {
+                        message = g_strdup ("cannot parse label");
+                }
+        }
+
+        if ( (message == NULL) && !run_job (opts, label, prgname, &output_ok) )
+        {
+                message = g_strdup ("invalid job options");
+        }
+        else if ( (message == NULL) && !output_ok )
+        {
+                message = g_strdup ("cannot write output");
+        }
+
+        /* Return output files, in name order, and clean up. */
+        dir = g_dir_open (out_dir, 0, NULL);
+        if (dir != NULL)
+        {
+                while ( (name = (gchar *)g_dir_read_name (dir)) != NULL )
+                {
+                        names = g_list_insert_sorted (names, g_strdup (name), (GCompareFunc)strcmp);
+                }
+                g_dir_close (dir);
+        }
+
+        if ( (message == NULL) && (names == NULL) )
+        {
+                message = g_strdup ("nothing to print");
+        }
+
+        for (p = names; p != NULL; p = p->next)
+        {
+                filename = g_build_filename (out_dir, p->data, NULL);
+                if ( (message == NULL) && g_file_get_contents (filename, &contents, &length, NULL) )
+                {
+                        header = g_strdup_printf ("FILE %s %" G_GSIZE_FORMAT "\n",
+                                                  (gchar *)p->data, length);
+                        g_output_stream_write_all (out, header, strlen (header), NULL, NULL, NULL);
+                        g_output_stream_write_all (out, contents, length, NULL, NULL, NULL);
+                        g_free (header);
+                        g_free (contents);
+                }
+                g_unlink (filename);
+                g_free (filename);
+        }
+        g_list_free_full (names, g_free);
+
+        if (message == NULL)
+        {
+                g_output_stream_write_all (out, "DONE\n", 5, NULL, NULL, NULL);
+        }
+
+        if (input_data != NULL)
+        {
+                g_unlink (opts->input);
+        }
+        g_rmdir (out_dir);
+        g_rmdir (tmp_dir);
+        g_free (out_dir);
+        g_free (tmp_dir);
+
+ done:
+        if (label != NULL)
+        {
+                g_object_unref (label);
+        }
+        if (opts != NULL)
+        {
+                job_options_free (opts);
+        }
+        g_free (job_line);
+        g_free (label_data);
+        g_free (input_data);
+
+        return message;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Read data of "<KEY> <length>" header line, nul terminated.      */
+/*                                                                           */
+/* Returns NULL if data cannot be allocated or is shorter than announced.    */
+/*---------------------------------------------------------------------------*/
+static gchar *
+read_chunk (GDataInputStream *in,
+            const gchar      *header,
+            gsize            *length)
+{
+        gchar *data;
+        gsize  n_read = 0;
+
+        *length = g_ascii_strtoull (strchr (header, ' ') + 1, NULL, 10);
+
+        data = g_try_malloc (*length + 1);
+        if (data == NULL)
+        {
+                *length = 0;
+                return NULL;
+        }
+
+        if ( !g_input_stream_read_all (G_INPUT_STREAM (in), data, *length, &n_read, NULL, NULL)
+             || (n_read != *length) )
+        {
+                /* Rest of request is out of step, see serve_job(). */
+                g_free (data);
+                *length = 0;
+                return NULL;
+        }
+        data[n_read] = '\0';
+
+        return data;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Parse job line, giving options of job, NULL on error.           */
+/*                                                                           */
+/* Options not given on line are those of defaults.                          */
+/*---------------------------------------------------------------------------*/
+static JobOptions *
+parse_job_line (const gchar       *line,
+                const JobOptions  *defaults,
+                const gchar       *prgname,
+                GError           **error)
+{
+        gchar          **args, **job_argv;
+        gint             n_args, job_argc, i;
+        GOptionContext  *option_context;
+        JobOptions      *opts = NULL;
+
+        if (!g_shell_parse_argv (line, &n_args, &args, error))
+        {
+                return NULL;
+        }
 
-        return 0;
+        /* Options are parsed as if given after the program name. */
+        job_argc    = n_args + 1;
+        job_argv    = g_new0 (gchar *, job_argc + 1);
+        job_argv[0] = (gchar *)prgname;
+        for (i = 0; i < n_args; i++)
+        {
+                job_argv[i + 1] = args[i];
+        }
+
+        option_context = g_option_context_new (NULL);
+        g_option_context_set_help_enabled (option_context, FALSE);
+        g_option_context_add_main_entries (option_context, option_entries, GETTEXT_PACKAGE);
+
+        g_mutex_lock (&options_mutex);
+
+        options                = *defaults;
+        options.remaining_args = NULL;
+        if (g_option_context_parse (option_context, &job_argc, &job_argv, error))
+        {
+                opts = job_options_dup (&options);
+        }
+
+        /* Free strings parsed from line. */
+        if (options.output != defaults->output)         g_free (options.output);
+        if (options.input != defaults->input)           g_free (options.input);
+        if (options.records != defaults->records)       g_free (options.records);
+        if (options.shard != defaults->shard)           g_free (options.shard);
+        if (options.max_file_size != defaults->max_file_size) g_free (options.max_file_size);
+        g_strfreev (options.remaining_args);
+
+        g_mutex_unlock (&options_mutex);
+
+        g_option_context_free (option_context);
+        g_free (job_argv);
+        g_strfreev (args);
+
+        return opts;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Duplicate job options.                                          */
+/*---------------------------------------------------------------------------*/
+static JobOptions *
+job_options_dup (const JobOptions *opts)
+{
+        JobOptions *dup;
+
+        dup = g_new (JobOptions, 1);
+        *dup = *opts;
+
+        dup->output         = g_strdup (opts->output);
+        dup->input          = g_strdup (opts->input);
+        dup->records        = g_strdup (opts->records);
+        dup->shard          = g_strdup (opts->shard);
+        dup->max_file_size  = g_strdup (opts->max_file_size);
+        dup->remaining_args = g_strdupv (opts->remaining_args);
+
+        return dup;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Free job options.                                               */
+/*---------------------------------------------------------------------------*/
+static void
+job_options_free (JobOptions *opts)
+{
+        g_free (opts->output);
+        g_free (opts->input);
+        g_free (opts->records);
+        g_free (opts->shard);
+        g_free (opts->max_file_size);
+        g_strfreev (opts->remaining_args);
+        g_free (opts);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Get copy of label of file, opening file on first use.           */
+/*                                                                           */
+/* Labels are kept open, so that later jobs share their images and other    */
+/* caches.  Jobs get their own copy, so that they can run at once.  Labels   */
+/* are opened one at a time, as opening them may read templates on demand.   */
+/* The file is checked on every use, and opened again if its size or        */
+/* modification time changed since it was read.                              */
+/*---------------------------------------------------------------------------*/
+static glLabel *
+load_label (const gchar *filename)
+{
+        LoadedLabel       *loaded;
+        glLabel           *label, *copy = NULL;
+        glXMLLabelStatus   status;
+        GStatBuf           st;
+
+        g_mutex_lock (&loaded_labels_mutex);
+
+        if (g_stat (filename, &st) != 0)
+        {
+                g_hash_table_remove (loaded_labels, filename);
+                g_mutex_unlock (&loaded_labels_mutex);
+                return NULL;
+        }
+
+        loaded = g_hash_table_lookup (loaded_labels, filename);
+        if ( (loaded == NULL) ||
+             (loaded->size != (gint64)st.st_size) || (loaded->mtime != (gint64)st.st_mtime) )
+        {
+                g_hash_table_remove (loaded_labels, filename);
+                loaded = NULL;
+
+                label = gl_xml_label_open (filename, &status);
+                if ( status == XML_LABEL_OK )
+                {
+                        loaded        = g_new0 (LoadedLabel, 1);
+                        loaded->label = label;
+                        loaded->size  = st.st_size;
+                        loaded->mtime = st.st_mtime;
+                        g_hash_table_insert (loaded_labels, g_strdup (filename), loaded);
+                }
+        }
+        if (loaded != NULL)
+        {
+                copy = gl_label_dup (loaded->label);
+        }
+
+        g_mutex_unlock (&loaded_labels_mutex);
+
+        return copy;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Free label kept open.                                           */
+/*---------------------------------------------------------------------------*/
+static void
+loaded_label_free (LoadedLabel *loaded)
+{
+        g_object_unref (loaded->label);
+        g_free (loaded);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Parse "V1<separator>V2" option value.  V2 may be omitted for a  */
+/* range (e.g. "100-"), in which case value2 is left unchanged.              */
+/*---------------------------------------------------------------------------*/
+static gboolean
+parse_pair (const gchar *text,
+            gchar        separator,
+            gint        *value1,
+            gint        *value2)
+{
+        gchar  *end;
+
+        *value1 = strtol (text, &end, 10);
+        if ( (end == text) || (*end != separator) )
+        {
+                return FALSE;
+        }
+
+        text = end + 1;
+        if ( (*text == '\0') && (separator == '-') )
+        {
+                return TRUE;
+        }
+
+        *value2 = strtol (text, &end, 10);
+
+        return (end != text) && (*end == '\0');
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Parse size in bytes, with optional k, M or G (binary) suffix.   */
+/*---------------------------------------------------------------------------*/
+static gboolean
+parse_size (const gchar *text,
+            goffset     *size)
+{
+        gchar   *end;
+        guint64  value;
+
+        value = g_ascii_strtoull (text, &end, 10);
+        if (end == text)
+        {
+                return FALSE;
+        }
+
+        switch (*end)
+        {
+        case 'k':
+        case 'K':
+                value <<= 10;
+                end++;
+                break;
+        case 'm':
+        case 'M':
+                value <<= 20;
+                end++;
+                break;
+        case 'g':
+        case 'G':
+                value <<= 30;
+                end++;
+                break;
+        default:
+                break;
+        }
+
+        *size = value;
+
+        return (*end == '\0') && (value > 0);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Is filename that of a raster image format?                      */
+/*---------------------------------------------------------------------------*/
+static gboolean
+is_raster (const gchar *filename)
+{
+        return g_str_has_suffix (filename, ".png") ||
+                g_str_has_suffix (filename, ".tif") ||
+                g_str_has_suffix (filename, ".tiff");
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Is output one file per label?  That is, is filename a pattern   */
+/* of merge fields, or that of the monochrome (thermal printer) format?      */
+/*---------------------------------------------------------------------------*/
+static gboolean
+is_per_label (const gchar *filename)
+{
+        return (strstr (filename, "${") != NULL) || g_str_has_suffix (filename, ".pbm");
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Export job in format of filename.                               */
+/*---------------------------------------------------------------------------*/
+static gboolean
+export (glPrintOp        *print_op,
+        const gchar      *filename,
+        const JobOptions *opts)
+{
+        if (is_per_label (filename))
+        {
+                return gl_print_op_export_labels (print_op, filename, opts->dpi, opts->dither_flag);
+        }
+        else if (is_raster (filename))
+        {
+                return gl_print_op_export_raster (print_op, filename, opts->dpi);
+        }
+        else
+        {
+                return gl_print_op_export (print_op, filename);
+        }
 }
 
 
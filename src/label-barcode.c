@@ -59,6 +59,12 @@ struct _glLabelBarcodePrivate {
         lglBarcode          *display_gbc;
         gdouble              w, h;
 
+        /* Data with field resolved for merge, kept while printing records. */
+        gboolean             field_resolved;
+        glTextNode          *field_node;
+        glMerge             *field_merge;
+        const glMergeStore  *field_store;
+
 };
 
 
@@ -78,6 +84,11 @@ static void  copy                           (glLabelObject       *dst_object,
 
 static void  update_barcode                 (glLabelBarcode      *lbc);
 
+static const glTextNode *get_field_node     (glLabelBarcode      *lbc,
+                                             const glMergeRecord *record);
+
+static void  clear_field_node               (glLabelBarcode      *lbc);
+
 static void  set_size                       (glLabelObject       *object,
                                              gdouble              w,
                                              gdouble              h,
@@ -154,6 +165,7 @@ gl_label_barcode_finalize (GObject *object)
         g_return_if_fail (object && GL_IS_LABEL_BARCODE (object));
 
         gl_text_node_free (&lbc->priv->text_node);
+        clear_field_node (lbc);
         gl_label_barcode_style_free (lbc->priv->style);
         gl_color_node_free (&(lbc->priv->color_node));
         lgl_barcode_free (lbc->priv->display_gbc);
@@ -261,6 +273,7 @@ gl_label_barcode_set_data (glLabelBarcode   *lbc,
                 
                 gl_text_node_free (&lbc->priv->text_node);
                 lbc->priv->text_node = gl_text_node_dup (text_node);
+                clear_field_node (lbc);
 
                 update_barcode (lbc);
 
@@ -401,6 +414,58 @@ update_barcode (glLabelBarcode *lbc)
 }
 
 
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Get data to expand for record, owned by object.                 */
+/*                                                                           */
+/* The field is resolved to a column when the store of records changes,      */
+/* i.e. once per job, rather than looked up for every record.                */
+/*---------------------------------------------------------------------------*/
+static const glTextNode *
+get_field_node (glLabelBarcode      *lbc,
+                const glMergeRecord *record)
+{
+        glLabel *label;
+
+        if ( !lbc->priv->field_resolved ||
+             (lbc->priv->field_store != record->store) )
+        {
+                clear_field_node (lbc);
+
+                lbc->priv->field_resolved = TRUE;
+                lbc->priv->field_node     = gl_text_node_dup (lbc->priv->text_node);
+                lbc->priv->field_store    = record->store;
+
+                label = gl_label_object_get_parent (GL_LABEL_OBJECT (lbc));
+                if (label != NULL)
+                {
+                        /* Reference keeps resolved store alive. */
+                        lbc->priv->field_merge = gl_label_get_merge (label);
+                        gl_text_node_resolve (lbc->priv->field_node,
+                                              lbc->priv->field_merge);
+                }
+        }
+
+        return lbc->priv->field_node;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Forget data resolved for merge.                                 */
+/*---------------------------------------------------------------------------*/
+static void
+clear_field_node (glLabelBarcode *lbc)
+{
+        gl_text_node_free (&lbc->priv->field_node);
+        if (lbc->priv->field_merge != NULL)
+        {
+                g_object_unref (lbc->priv->field_merge);
+                lbc->priv->field_merge = NULL;
+        }
+        lbc->priv->field_store    = NULL;
+        lbc->priv->field_resolved = FALSE;
+}
+
+
 /*---------------------------------------------------------------------------*/
 /* PRIVATE.  Set object size method.                                         */
 /*---------------------------------------------------------------------------*/
@@ -523,7 +588,15 @@ draw_object (glLabelObject *object,
 
                 gl_label_object_get_raw_size (object, &w, &h);
 
-                text = gl_text_node_expand (text_node, record);
+                if (record != NULL)
+                {
+                        text = gl_text_node_expand (get_field_node (lbc, record), record);
+                }
+                else
+                {
+                        clear_field_node (lbc);
+                        text = gl_text_node_expand (text_node, NULL);
+                }
                 gbc = gl_barcode_backends_new_barcode (style->backend_id, style->id, style->text_flag, style->checksum_flag, w, h, text);
                 g_free (text);
 
@@ -70,6 +70,12 @@ struct _glLabelTextPrivate {
         gdouble          h;
 
         gboolean         checkpoint_flag;
+
+        /* Lines with fields resolved for merge, kept while printing records. */
+        gboolean            field_resolved;
+        GList              *field_lines;
+        glMerge            *field_merge;
+        const glMergeStore *field_store;
 };
 
 
@@ -93,6 +99,11 @@ static void buffer_begin_user_action_cb (GtkTextBuffer    *textbuffer,
 static void buffer_changed_cb           (GtkTextBuffer    *textbuffer,
 					 glLabelText      *ltext);
 
+static GList *get_field_lines           (glLabelText         *ltext,
+                                         const glMergeRecord *record);
+
+static void clear_field_lines           (glLabelText      *ltext);
+
 static void get_size                    (glLabelObject    *object,
 					 gdouble          *w,
 					 gdouble          *h);
@@ -266,6 +277,7 @@ gl_label_text_finalize (GObject *object)
 
 	g_object_unref (ltext->priv->tag_table);
 	g_object_unref (ltext->priv->buffer);
+	clear_field_lines (ltext);
 	g_free (ltext->priv->font_family);
 	gl_color_node_free (&(ltext->priv->color_node));
 	g_free (ltext->priv);
@@ -477,11 +489,64 @@ buffer_changed_cb (GtkTextBuffer *textbuffer,
                    glLabelText   *ltext)
 {
         ltext->priv->size_changed = TRUE;
+        clear_field_lines (ltext);
 
 	gl_label_object_emit_changed (GL_LABEL_OBJECT(ltext));
 }
 
 
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Get lines to expand for record, owned by object.                */
+/*                                                                           */
+/* Fields are resolved to columns when the store of records changes, i.e.    */
+/* once per job, rather than looked up for every record.                     */
+/*---------------------------------------------------------------------------*/
+static GList *
+get_field_lines (glLabelText         *ltext,
+                 const glMergeRecord *record)
+{
+        glLabel *label;
+
+        if ( !ltext->priv->field_resolved ||
+             (ltext->priv->field_store != record->store) )
+        {
+                clear_field_lines (ltext);
+
+                ltext->priv->field_resolved = TRUE;
+                ltext->priv->field_lines    = gl_label_text_get_lines (ltext);
+                ltext->priv->field_store    = record->store;
+
+                label = gl_label_object_get_parent (GL_LABEL_OBJECT (ltext));
+                if (label != NULL)
+                {
+                        /* Reference keeps resolved store alive. */
+                        ltext->priv->field_merge = gl_label_get_merge (label);
+                        gl_text_node_lines_resolve (ltext->priv->field_lines,
+                                                    ltext->priv->field_merge);
+                }
+        }
+
+        return ltext->priv->field_lines;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Forget lines resolved for merge.                                */
+/*---------------------------------------------------------------------------*/
+static void
+clear_field_lines (glLabelText *ltext)
+{
+        gl_text_node_lines_free (&ltext->priv->field_lines);
+        if (ltext->priv->field_merge != NULL)
+        {
+                g_object_unref (ltext->priv->field_merge);
+                ltext->priv->field_merge = NULL;
+        }
+        ltext->priv->field_store    = NULL;
+        ltext->priv->field_resolved = FALSE;
+}
+
+
 /*****************************************************************************/
 /* Get object size method.                                                   */
 /*****************************************************************************/
@@ -1139,8 +1204,19 @@ layout_text (glLabelText      *this,
         gl_label_object_get_size (GL_LABEL_OBJECT (this), &object_w, &object_h);
         gl_label_object_get_raw_size (GL_LABEL_OBJECT (this), &raw_w, &raw_h);
 
-        lines = gl_label_text_get_lines (this);
-        text = gl_text_node_lines_expand (lines, record);
+        if (record != NULL)
+        {
+                text = gl_text_node_lines_expand (get_field_lines (this, record), record);
+        }
+        else
+        {
+                /* Not printing records, let go of merge. */
+                clear_field_lines (this);
+
+                lines = gl_label_text_get_lines (this);
+                text = gl_text_node_lines_expand (lines, NULL);
+                gl_text_node_lines_free (&lines);
+        }
 
         style = this->priv->font_italic_flag ? PANGO_STYLE_ITALIC : PANGO_STYLE_NORMAL;
 
@@ -1215,7 +1291,6 @@ layout_text (glLabelText      *this,
         }
 
         g_object_unref (layout);
-        gl_text_node_lines_free (&lines);
 
         cairo_restore (cr);
 
@@ -31,6 +31,8 @@
 #include "prefs.h"
 #include "label-text.h"
 #include "label-image.h"
+#include "label-barcode.h"
+#include "stats.h"
 #include "marshal.h"
 
 #include "debug.h"
@@ -362,6 +364,41 @@ gl_label_new (void)
 }
 
 
+/*****************************************************************************/
+/* Duplicate label for drawing, e.g. by another thread.  The template,       */
+/* objects and merge are copied, but not the filename or undo history.       */
+/*****************************************************************************/
+glLabel *
+gl_label_dup (glLabel *label)
+{
+	glLabel       *dst_label;
+	GList         *p;
+	glLabelObject *object;
+
+	gl_debug (DEBUG_LABEL, "START");
+
+	g_return_val_if_fail (label && GL_IS_LABEL (label), NULL);
+
+	dst_label = GL_LABEL (gl_label_new ());
+
+	gl_label_set_template (dst_label, label->priv->template, FALSE);
+	gl_label_set_rotate_flag (dst_label, label->priv->rotate_flag, FALSE);
+
+	for (p = label->priv->object_list; p != NULL; p = p->next)
+        {
+		object = GL_LABEL_OBJECT (p->data);
+
+		gl_label_add_object (dst_label, gl_label_object_dup (object, dst_label));
+	}
+
+	dst_label->priv->merge = gl_merge_dup (label->priv->merge);
+
+	gl_debug (DEBUG_LABEL, "END");
+
+	return dst_label;
+}
+
+
 /****************************************************************************/
 /* Set filename.                                                            */
 /****************************************************************************/
@@ -602,8 +639,9 @@ gl_label_set_template (glLabel           *label,
                         gl_label_checkpoint (label, _("Label properties"));
                 }
 
+		lgl_template_ref ((lglTemplate *)template);
 		lgl_template_free (label->priv->template);
-		label->priv->template = lgl_template_dup (template);
+		label->priv->template = (lglTemplate *)template;
 
                 do_modify (label);
 		g_signal_emit (G_OBJECT(label), signals[SIZE_CHANGED], 0);
@@ -850,6 +888,9 @@ gl_label_set_merge (glLabel *label,
 
 /****************************************************************************/
 /* Get merge information structure.                                         */
+/*                                                                          */
+/* Returns a new merge object that shares its records with the label's      */
+/* merge (copy-on-write), caller must unref.                                */
 /****************************************************************************/
 glMerge *
 gl_label_get_merge (glLabel *label)
@@ -3241,6 +3282,7 @@ gl_label_draw (glLabel       *label,
 {
 	GList            *p_obj;
 	glLabelObject    *object;
+        glStatsTimer      timer;
 
 	g_return_if_fail (label && GL_IS_LABEL (label));
 
@@ -3248,7 +3290,31 @@ gl_label_draw (glLabel       *label,
         {
 		object = GL_LABEL_OBJECT (p_obj->data);
 
+                if (!gl_stats_is_enabled ())
+                {
+                        gl_label_object_draw (object, cr, screen_flag, record);
+                        continue;
+                }
+
+                gl_stats_timer_start (&timer);
                 gl_label_object_draw (object, cr, screen_flag, record);
+
+                if (GL_IS_LABEL_TEXT (object))
+                {
+                        gl_stats_add_object (GL_STATS_OBJECT_TEXT, &timer);
+                }
+                else if (GL_IS_LABEL_BARCODE (object))
+                {
+                        gl_stats_add_object (GL_STATS_OBJECT_BARCODE, &timer);
+                }
+                else if (GL_IS_LABEL_IMAGE (object))
+                {
+                        gl_stats_add_object (GL_STATS_OBJECT_IMAGE, &timer);
+                }
+                else
+                {
+                        gl_stats_add_object (GL_STATS_OBJECT_SHAPE, &timer);
+                }
 	}
 }
 
@@ -3542,7 +3608,7 @@ state_new (glLabel       *this,
 
         state->description = g_strdup (description);
 
-        state->template    = lgl_template_dup (this->priv->template);
+        state->template    = lgl_template_ref (this->priv->template);
         state->rotate_flag = this->priv->rotate_flag;
 
         for ( p_obj = this->priv->object_list; p_obj != NULL; p_obj = p_obj->next )
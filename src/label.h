@@ -84,6 +84,8 @@ GType         gl_label_get_type                (void) G_GNUC_CONST;
 
 GObject      *gl_label_new                     (void);
 
+glLabel      *gl_label_dup                     (glLabel       *label);
+
 
 void          gl_label_set_filename            (glLabel       *label,
 						const gchar   *filename);
@@ -952,7 +952,7 @@ load_recent_list (glMediaSelect      *this,
 
                         gl_debug (DEBUG_MEDIA_SELECT, "p->data = \"%s\"", p->data);
 
-                        template = lgl_db_lookup_template_from_name (p->data);
+                        template = lgl_db_get_template_from_name (p->data);
                         frame    = (lglTemplateFrame *)template->frames->data;
                         pixbuf   = gl_mini_preview_pixbuf_cache_get_pixbuf (p->data);
 
@@ -966,7 +966,7 @@ load_recent_list (glMediaSelect      *this,
                         g_free (size);
                         g_free (layout);
 
-                        lgl_template_free (template);
+                        lgl_template_unref (template);
 
                         gtk_list_store_append (store, &iter);
                         gtk_list_store_set (store, &iter,
@@ -1044,7 +1044,7 @@ load_search_all_list (glMediaSelect      *this,
 
                         gl_debug (DEBUG_MEDIA_SELECT, "p->data = \"%s\"", p->data);
 
-                        template = lgl_db_lookup_template_from_name (p->data);
+                        template = lgl_db_get_template_from_name (p->data);
                         frame    = (lglTemplateFrame *)template->frames->data;
                         pixbuf   = gl_mini_preview_pixbuf_cache_get_pixbuf (p->data);
 
@@ -1058,7 +1058,7 @@ load_search_all_list (glMediaSelect      *this,
                         g_free (size);
                         g_free (layout);
 
-                        lgl_template_free (template);
+                        lgl_template_unref (template);
 
                         gtk_list_store_append (store, &iter);
                         gtk_list_store_set (store, &iter,
@@ -1138,7 +1138,7 @@ load_custom_list (glMediaSelect      *this,
 
                         gl_debug (DEBUG_MEDIA_SELECT, "p->data = \"%s\"", p->data);
 
-                        template = lgl_db_lookup_template_from_name (p->data);
+                        template = lgl_db_get_template_from_name (p->data);
                         frame    = (lglTemplateFrame *)template->frames->data;
                         pixbuf   = gl_mini_preview_pixbuf_cache_get_pixbuf (p->data);
 
@@ -1152,7 +1152,7 @@ load_custom_list (glMediaSelect      *this,
                         g_free (size);
                         g_free (layout);
 
-                        lgl_template_free (template);
+                        lgl_template_unref (template);
 
                         gtk_list_store_append (store, &iter);
                         gtk_list_store_set (store, &iter,
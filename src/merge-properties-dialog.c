@@ -75,6 +75,11 @@ enum {
 	N_COLUMNS
 };
 
+typedef struct {
+	GtkTreeStore *store;
+	GtkTreeIter  *record_iter;
+} FieldLoadInfo;
+
 
 /*===========================================*/
 /* Private globals                           */
@@ -103,6 +108,10 @@ static void response_cb                           (glMergePropertiesDialog
 static void load_tree                             (GtkTreeStore                 *store,
 					           glMerge                      *merge);
 
+static void load_field                            (const gchar                  *key,
+						   const gchar                  *value,
+						   gpointer                      user_data);
+
 static void record_select_toggled_cb              (GtkCellRendererToggle        *cell,
 						   gchar                        *path_str,
 						   GtkTreeStore                 *store);
@@ -506,6 +515,8 @@ response_cb (glMergePropertiesDialog *dialog,
 
 	case GTK_RESPONSE_OK:
 		gl_label_set_merge (dialog->priv->label, dialog->priv->merge, TRUE);
+		/* Records are now shared with label, reload private copy for next time. */
+		load_tree (dialog->priv->store, dialog->priv->merge);
 		gtk_widget_hide (GTK_WIDGET (dialog));
 		break;
 	case GTK_RESPONSE_CANCEL:
@@ -530,11 +541,11 @@ static void
 load_tree (GtkTreeStore           *store,
 	   glMerge                *merge)
 {
-	const GList   *record_list;
-	GList         *p_rec, *p_field;
+	GList         *record_list;
+	GList         *p_rec;
 	glMergeRecord *record;
-	glMergeField  *field;
-	GtkTreeIter    iter1, iter2;
+	GtkTreeIter    iter1;
+	FieldLoadInfo  info;
 	gchar         *primary_key;
 	gchar         *primary_value;
 
@@ -543,9 +554,9 @@ load_tree (GtkTreeStore           *store,
 	gtk_tree_store_clear (store);
 
 	primary_key = gl_merge_get_primary_key (merge);
-	record_list = gl_merge_get_record_list (merge);
+	record_list = gl_merge_get_mutable_record_list (merge);
 
-	for ( p_rec=(GList *)record_list; p_rec!=NULL; p_rec=p_rec->next ) {
+	for ( p_rec=record_list; p_rec!=NULL; p_rec=p_rec->next ) {
 		record = (glMergeRecord *)p_rec->data;
 		
 		primary_value = gl_merge_eval_key (record, primary_key);
@@ -560,16 +571,9 @@ load_tree (GtkTreeStore           *store,
 
 		g_free (primary_value);
 
-		for ( p_field=record->field_list; p_field!=NULL; p_field=p_field->next ) {
-			field = (glMergeField *)p_field->data;
-
-			gtk_tree_store_append (store, &iter2, &iter1);
-			gtk_tree_store_set (store, &iter2,
-					    RECORD_FIELD_COLUMN, field->key,
-					    VALUE_COLUMN,        field->value,
-					    IS_RECORD_COLUMN,    FALSE,
-					    -1);
-		}
+		info.store       = store;
+		info.record_iter = &iter1;
+		gl_merge_record_foreach_field (record, load_field, &info);
 	}
 
 	g_free (primary_key);
@@ -578,6 +582,26 @@ load_tree (GtkTreeStore           *store,
 }
 
 
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Load single field of record into tree store.                   */
+/*--------------------------------------------------------------------------*/
+static void
+load_field (const gchar *key,
+	    const gchar *value,
+	    gpointer     user_data)
+{
+	FieldLoadInfo *info = (FieldLoadInfo *)user_data;
+	GtkTreeIter    iter;
+
+	gtk_tree_store_append (info->store, &iter, info->record_iter);
+	gtk_tree_store_set (info->store, &iter,
+			    RECORD_FIELD_COLUMN, key,
+			    VALUE_COLUMN,        value,
+			    IS_RECORD_COLUMN,    FALSE,
+			    -1);
+}
+
+
 /*--------------------------------------------------------------------------*/
 /* PRIVATE.  Record select toggled.                                         */
 /*--------------------------------------------------------------------------*/
@@ -24,12 +24,45 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <unistd.h>
 #include <string.h>
+#include <glib/gstdio.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "debug.h"
 
 #define LINE_BUF_LEN 1024
 
+/*
+ * Parallel parsing.  Mapped sources larger than PARALLEL_MIN_SIZE are split
+ * into chunks of whole records, which are parsed by a pool of worker threads.
+ * At most CHUNKS_AHEAD_PER_THREAD chunks per thread are parsed ahead of the
+ * reader, to bound memory use.
+ */
+#define PARALLEL_MIN_SIZE        (4*1024*1024)
+#define CHUNK_MIN_SIZE           (1024*1024)
+#define CHUNKS_PER_THREAD        8
+#define CHUNKS_AHEAD_PER_THREAD  2
+
+/* Input block size when decoding wide encodings to UTF-8. */
+#define DECODE_BLOCK_SIZE        (1024*1024)
+
+/*
+ * Record index.  The start offset of every record of a mapped source is
+ * kept in a file of the merge cache directory (a checksum of the source's
+ * cache key + INDEX_SUFFIX), so that records can be counted and located
+ * without parsing the source.  The index is only trusted if the size and
+ * modification time of the source, and the parsing options, match those
+ * recorded in its header, and if its offsets are valid for the source.
+ * Without a writable cache directory the index is only kept in memory, where
+ * it is shared by all cursors of the merge (see SourceCache).
+ */
+#define INDEX_SUFFIX             ".glidx"
+#define INDEX_MAGIC              "GLIDX001"
+
 /*
  * Unicode handling.
  *  The default encoding assumption is that files are in the system encoding.
@@ -49,6 +82,61 @@ enum UnicodeEncoding {
 /* Private types                             */
 /*===========================================*/
 
+typedef struct {
+        gchar              magic[8];
+        guint64            src_size;
+        gint64             src_mtime;
+        guint32            delim;
+        guint32            encoding;
+        guint64            data_len;
+        guint64            n_records;
+} IndexHeader;
+
+/*
+ * Per-source data that is worked out once per merge and shared by the merge
+ * and all of its duplicates (e.g. cursors): the UTF-8 text of wide encoded
+ * sources, and the record index.  Both are reused by every open for as long
+ * as the source is unchanged.
+ */
+typedef struct {
+        gint               ref_count;
+        GMutex             mutex;
+
+        gchar             *src;
+        gint64             src_size;
+        gint64             src_mtime;
+        GBytes            *decoded;
+
+        gchar             *index_src;
+        IndexHeader        index_header;
+        GBytes            *index;
+} SourceCache;
+
+typedef struct {
+        gsize              start;
+        gsize              end;
+
+        gboolean           done;
+        GPtrArray         *records;
+        gint               n_fields_max;
+} Chunk;
+
+/*
+ * Segment of a mapped source, scanned for record starts by its own thread
+ * while the index is built.  The scan speculatively assumes that a record
+ * starts after the first newline of the segment; build_index() checks this
+ * against the records of the preceding segments.
+ */
+typedef struct {
+        glMergeText       *merge_text;
+        gsize              start;
+        gsize              end;
+
+        GArray            *starts;     /* Record starts before end          */
+        gsize              next;       /* First record start at or past end */
+        GThread           *thread;
+} IndexSegment;
+
 struct _glMergeTextPrivate {
 
         gchar             delim;
@@ -62,8 +150,29 @@ struct _glMergeTextPrivate {
 
         FILE             *fp;
 
+        GMappedFile      *mapped_file;
+        SourceCache      *source_cache;
+        GBytes           *decoded;
+        const gchar      *data;
+        gsize             data_len;
+        gsize             data_pos;
+        gsize             data_start;
+
+        GBytes           *index;
+        const guint64    *offsets;
+        gsize             n_offsets;
+
         GPtrArray        *keys;
         gint              n_fields_max;
+
+        GThreadPool      *pool;
+        GPtrArray        *chunks;
+        guint             i_chunk;
+        guint             i_chunk_record;
+        guint             n_chunks_queued;
+        guint             n_chunks_ahead;
+        GMutex            chunk_mutex;
+        GCond             chunk_cond;
 };
 
 enum {
@@ -109,10 +218,63 @@ static void           gl_merge_text_close           (glMerge          *merge);
 static glMergeRecord *gl_merge_text_get_record      (glMerge          *merge);
 static void           gl_merge_text_copy            (glMerge          *dst_merge,
                                                      const glMerge    *src_merge);
+static gint           gl_merge_text_get_record_count (glMerge         *merge);
+static gboolean       gl_merge_text_seek_record     (glMerge          *merge,
+                                                     gint              i_record);
+static gchar         *gl_merge_text_get_cache_key   (const glMerge    *merge);
 
-static GList         *parse_line                    (glMergeText       *merge_text,
+static GPtrArray     *parse_line                    (glMergeText       *merge_text,
                                                      gchar             delim);
-static void           free_fields                   (GList           **fields);
+static GPtrArray     *parse_line_stream             (glMergeText       *merge_text,
+                                                     gchar             delim);
+static GPtrArray     *parse_line_buffer             (const gchar       *data,
+                                                     gsize             len,
+                                                     gsize            *pos,
+                                                     gchar             delim);
+static gsize          find_record_end               (const gchar       *data,
+                                                     gsize             len,
+                                                     gsize             pos,
+                                                     gchar             delim);
+static const gchar   *find_special                  (const gchar       *p,
+                                                     const gchar       *end,
+                                                     gchar             c1,
+                                                     gchar             c2,
+                                                     gchar             c3,
+                                                     gchar             c4);
+static gchar         *field_to_utf8                 (glMergeText       *merge_text,
+                                                     const gchar       *field);
+static const gchar   *codeset_from_encoding         (enum UnicodeEncoding encoding);
+static gboolean       decode_mapped                 (glMergeText       *merge_text,
+                                                     const gchar       *src);
+static GBytes        *decode_wide                   (const gchar       *data,
+                                                     gsize              len,
+                                                     enum UnicodeEncoding encoding);
+static gboolean       write_all                     (gint               fd,
+                                                     const gchar       *buf,
+                                                     gsize              len);
+static SourceCache   *source_cache_new              (void);
+static SourceCache   *source_cache_ref              (SourceCache       *cache);
+static void           source_cache_unref            (SourceCache       *cache);
+static glMergeRecord *new_record                    (glMergeText       *merge_text,
+                                                     GPtrArray         *fields);
+static gboolean       ensure_index                  (glMergeText       *merge_text);
+static GBytes        *build_index                   (glMergeText       *merge_text);
+static gpointer       scan_index_segment            (gpointer           data);
+static GBytes        *load_index                    (glMergeText       *merge_text,
+                                                     const gchar       *index_name,
+                                                     const IndexHeader *header);
+static void           save_index                    (GBytes            *index,
+                                                     const gchar       *index_name,
+                                                     const IndexHeader *header);
+static void           free_index                    (glMergeText       *merge_text);
+static gchar         *get_index_filename            (glMergeText       *merge_text);
+static gboolean       use_parallel_parse            (glMergeText       *merge_text);
+static void           start_parallel_parse          (glMergeText       *merge_text);
+static void           stop_parallel_parse           (glMergeText       *merge_text);
+static glMergeRecord *get_parallel_record           (glMergeText       *merge_text);
+static void           queue_chunks                  (glMergeText       *merge_text);
+static void           parse_chunk                   (gpointer          data,
+                                                     gpointer          user_data);
 
 
 
@@ -158,6 +320,10 @@ gl_merge_text_class_init (glMergeTextClass *class)
         merge_class->get_record      = gl_merge_text_get_record;
         merge_class->copy            = gl_merge_text_copy;
 
+        merge_class->get_record_count = gl_merge_text_get_record_count;
+        merge_class->seek_record      = gl_merge_text_seek_record;
+        merge_class->get_cache_key    = gl_merge_text_get_cache_key;
+
         gl_debug (DEBUG_MERGE, "END");
 }
 
@@ -171,6 +337,11 @@ gl_merge_text_init (glMergeText *merge_text)
 
         merge_text->priv->keys = g_ptr_array_new ();
 
+        g_mutex_init (&merge_text->priv->chunk_mutex);
+        g_cond_init (&merge_text->priv->chunk_cond);
+
+        merge_text->priv->source_cache = source_cache_new ();
+
         gl_debug (DEBUG_MERGE, "END");
 }
 
@@ -186,6 +357,9 @@ gl_merge_text_finalize (GObject *object)
 
         clear_keys (merge_text);
         g_ptr_array_free (merge_text->priv->keys, TRUE);
+        g_mutex_clear (&merge_text->priv->chunk_mutex);
+        g_cond_clear (&merge_text->priv->chunk_cond);
+        source_cache_unref (merge_text->priv->source_cache);
         g_free (merge_text->priv);
 
         G_OBJECT_CLASS (gl_merge_text_parent_class)->finalize (object);
@@ -415,6 +589,313 @@ gl_read_encoding(FILE* fp) {
         return encoding;
 }
 
+/*--------------------------------------------------------------------------*/
+/* Same as gl_read_encoding(), but for a memory mapped file.  Sets bom_len  */
+/* to the length of the byte order mark, if any.                            */
+/*--------------------------------------------------------------------------*/
+static enum UnicodeEncoding
+gl_read_encoding_mapped (const gchar *data,
+                         gsize        len,
+                         gsize       *bom_len)
+{
+        if ( (len >= 4) && (memcmp (data, "\xff\xfe\0\0", 4) == 0) ) {
+                *bom_len = 4;
+                return UTF32_LE;
+        } else if ( (len >= 2) && (memcmp (data, "\xff\xfe", 2) == 0) ) {
+                *bom_len = 2;
+                return UTF16_LE;
+        } else if ( (len >= 2) && (memcmp (data, "\xfe\xff", 2) == 0) ) {
+                *bom_len = 2;
+                return UTF16_BE;
+        } else if ( (len >= 4) && (memcmp (data, "\0\0\xfe\xff", 4) == 0) ) {
+                *bom_len = 4;
+                return UTF32_BE;
+        } else if ( (len >= 3) && (memcmp (data, "\xef\xbb\xbf", 3) == 0) ) {
+                *bom_len = 3;
+                return UTF8;
+        }
+
+        *bom_len = 0;
+        return SYSTEM_ENCODING;
+}
+
+/*--------------------------------------------------------------------------*/
+/* Lookup iconv codeset name of wide encoding, NULL for byte encodings.     */
+/*--------------------------------------------------------------------------*/
+static const gchar *
+codeset_from_encoding (enum UnicodeEncoding encoding)
+{
+        switch (encoding) {
+        case UTF16_BE:
+                return "UTF-16BE";
+        case UTF16_LE:
+                return "UTF-16LE";
+        case UTF32_BE:
+                return "UTF-32BE";
+        case UTF32_LE:
+                return "UTF-32LE";
+        default:
+                return NULL;
+        }
+}
+
+/*--------------------------------------------------------------------------*/
+/* Decode wide encoded mapped file to UTF-8.                                */
+/*                                                                          */
+/* The decoded text is taken from the source cache shared with the other    */
+/* duplicates of the merge when it is still valid for the source, and only  */
+/* decoded (and cached) otherwise.  On success the decoded text replaces    */
+/* the mapped data, so that it takes the same parsing path as UTF-8         */
+/* sources.                                                                 */
+/*--------------------------------------------------------------------------*/
+static gboolean
+decode_mapped (glMergeText *merge_text,
+               const gchar *src)
+{
+        SourceCache *cache = merge_text->priv->source_cache;
+        GStatBuf     st;
+        gboolean     stamped;
+        GBytes      *decoded;
+        gsize        len;
+
+        stamped = (g_stat (src, &st) == 0);
+
+        /* Other cursors of this merge wait here rather than decode again. */
+        g_mutex_lock (&cache->mutex);
+
+        if ( stamped && (cache->decoded != NULL) &&
+             (g_strcmp0 (cache->src, src) == 0) &&
+             (cache->src_size == (gint64)st.st_size) &&
+             (cache->src_mtime == (gint64)st.st_mtime) )
+        {
+                decoded = g_bytes_ref (cache->decoded);
+        }
+        else
+        {
+                decoded = decode_wide (merge_text->priv->data + merge_text->priv->data_pos,
+                                       merge_text->priv->data_len - merge_text->priv->data_pos,
+                                       merge_text->priv->encoding);
+                if ( (decoded != NULL) && stamped )
+                {
+                        if ( cache->decoded != NULL ) {
+                                g_bytes_unref (cache->decoded);
+                        }
+                        g_free (cache->src);
+                        cache->src       = g_strdup (src);
+                        cache->src_size  = st.st_size;
+                        cache->src_mtime = st.st_mtime;
+                        cache->decoded   = g_bytes_ref (decoded);
+                }
+        }
+
+        g_mutex_unlock (&cache->mutex);
+
+        if ( decoded == NULL ) {
+                return FALSE;
+        }
+
+        merge_text->priv->decoded  = decoded;
+        merge_text->priv->data     = g_bytes_get_data (decoded, &len);
+        merge_text->priv->data_len = len - 1;   /* Excluding terminating NUL. */
+        merge_text->priv->data_pos = 0;
+
+        return TRUE;
+}
+
+/*--------------------------------------------------------------------------*/
+/* Decode wide encoded text to NUL terminated UTF-8, NULL on error.         */
+/*                                                                          */
+/* The text is decoded DECODE_BLOCK_SIZE bytes at a time into a temporary   */
+/* file, which is then mapped, so that memory use does not grow with the    */
+/* size of the source.  A unit or surrogate pair split by the end of a      */
+/* block is carried into the next block; an incomplete unit at the end of   */
+/* the text is dropped.  Invalid units (e.g. unpaired surrogates) are       */
+/* skipped, with a single warning for the whole source.                     */
+/*--------------------------------------------------------------------------*/
+static GBytes *
+decode_wide (const gchar          *data,
+             gsize                 len,
+             enum UnicodeEncoding  encoding)
+{
+        GIConv       converter;
+        gint         fd;
+        gchar       *tmp_name;
+        gchar       *inbuf, *outbuf, *block;
+        gsize        inleft, block_len, block_left, outleft;
+        gsize        unit_len;
+        gsize        n_invalid;
+        gsize        result;
+        gint         iconv_errno;
+        gboolean     ok;
+        GMappedFile *mapped;
+        GBytes      *decoded;
+        GError      *error = NULL;
+
+        converter = g_iconv_open ("UTF-8", codeset_from_encoding (encoding));
+        if (converter == (GIConv)-1) {
+                g_warning ("g_iconv_open: %s", strerror (errno));
+                return NULL;
+        }
+
+        fd = g_file_open_tmp ("glabels-merge-XXXXXX", &tmp_name, &error);
+        if (fd < 0) {
+                g_warning ("g_file_open_tmp: %s", error->message);
+                g_error_free (error);
+                g_iconv_close (converter);
+                return NULL;
+        }
+
+        unit_len = ( (encoding == UTF32_BE) || (encoding == UTF32_LE) ) ? 4 : 2;
+
+        /* UTF-8 needs at most 3 bytes per 16-bit unit and 4 per 32-bit unit. */
+        block = g_malloc (2 * DECODE_BLOCK_SIZE);
+
+        inbuf     = (gchar *)data;
+        inleft    = len;
+        n_invalid = 0;
+        ok        = TRUE;
+
+        while ( ok && (inleft > 0) )
+        {
+                block_len  = MIN (inleft, DECODE_BLOCK_SIZE);
+                block_left = block_len;
+                outbuf     = block;
+                outleft    = 2 * DECODE_BLOCK_SIZE;
+
+                result      = g_iconv (converter, &inbuf, &block_left, &outbuf, &outleft);
+                iconv_errno = errno;
+
+                inleft -= block_len - block_left;
+                ok = write_all (fd, block, outbuf - block);
+
+                if ( (result != (gsize)-1) || (iconv_errno == E2BIG) )
+                {
+                        continue;
+                }
+
+                if ( (iconv_errno == EILSEQ) && (inleft >= unit_len) )
+                {
+                        n_invalid++;
+                        inbuf  += unit_len;
+                        inleft -= unit_len;
+                }
+                else if ( (iconv_errno != EINVAL) || (block_len == inleft) )
+                {
+                        /* Incomplete unit or surrogate pair at end of text. */
+                        break;
+                }
+                /* Otherwise carry partial unit into next block. */
+        }
+        g_iconv_close (converter);
+        g_free (block);
+
+        if ( n_invalid > 0 )
+        {
+                g_warning ("g_iconv: skipped %" G_GSIZE_FORMAT " invalid units", n_invalid);
+        }
+
+        ok = ok && write_all (fd, "", 1);
+        close (fd);
+
+        mapped = ok ? g_mapped_file_new (tmp_name, FALSE, &error) : NULL;
+        if ( ok && (mapped == NULL) )
+        {
+                g_warning ("g_mapped_file_new: %s", error->message);
+                g_error_free (error);
+        }
+
+        /* The mapping outlives the file name. */
+        g_unlink (tmp_name);
+        g_free (tmp_name);
+
+        if ( mapped == NULL ) {
+                return NULL;
+        }
+
+        decoded = g_mapped_file_get_bytes (mapped);
+        g_mapped_file_unref (mapped);
+
+        return decoded;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Write whole buffer to file descriptor, retrying after short writes.      */
+/*--------------------------------------------------------------------------*/
+static gboolean
+write_all (gint         fd,
+           const gchar *buf,
+           gsize        len)
+{
+        gssize       n;
+
+        while ( len > 0 )
+        {
+                n = write (fd, buf, len);
+                if ( n < 0 )
+                {
+                        if ( errno == EINTR ) {
+                                continue;
+                        }
+                        g_warning ("write: %s", strerror (errno));
+                        return FALSE;
+                }
+                buf += n;
+                len -= n;
+        }
+
+        return TRUE;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* New, empty decode cache.                                                 */
+/*--------------------------------------------------------------------------*/
+static SourceCache *
+source_cache_new (void)
+{
+        SourceCache *cache;
+
+        cache = g_new0 (SourceCache, 1);
+        cache->ref_count = 1;
+        g_mutex_init (&cache->mutex);
+
+        return cache;
+}
+
+/*--------------------------------------------------------------------------*/
+/* Add reference to decode cache.                                           */
+/*--------------------------------------------------------------------------*/
+static SourceCache *
+source_cache_ref (SourceCache *cache)
+{
+        g_atomic_int_inc (&cache->ref_count);
+
+        return cache;
+}
+
+/*--------------------------------------------------------------------------*/
+/* Drop reference to decode cache, freeing it with the last reference.      */
+/*--------------------------------------------------------------------------*/
+static void
+source_cache_unref (SourceCache *cache)
+{
+        if ( (cache == NULL) || !g_atomic_int_dec_and_test (&cache->ref_count) ) {
+                return;
+        }
+
+        if ( cache->decoded != NULL ) {
+                g_bytes_unref (cache->decoded);
+        }
+        g_free (cache->src);
+        if ( cache->index != NULL ) {
+                g_bytes_unref (cache->index);
+        }
+        g_free (cache->index_src);
+        g_mutex_clear (&cache->mutex);
+        g_free (cache);
+}
+
 /*
  * gLabels get-character routine for possibly Unicode text files.
  * If the source has a byte order mark (BOM) indicating a Unicode file, 
@@ -485,8 +966,11 @@ gl_merge_text_open (glMerge *merge)
         glMergeText *merge_text;
         gchar       *src;
 
-        GList       *line1_fields;
-        GList       *p;
+        GPtrArray   *line1_fields;
+        guint        i;
+
+        GError      *error = NULL;
+        gsize        bom_len;
 
         merge_text = GL_MERGE_TEXT (merge);
 
@@ -498,34 +982,45 @@ gl_merge_text_open (glMerge *merge)
                         merge_text->priv->fp = stdin;
                         merge_text->priv->encoding = SYSTEM_ENCODING;
                 } else {
-                        if ((merge_text->priv->fp = fopen (src, "r")) != NULL) {
-                                merge_text->priv->encoding = gl_read_encoding(merge_text->priv->fp);
+                        /*
+                         * Map regular files into memory, so that they can be
+                         * scanned in bulk rather than one character at a time.
+                         */
+                        merge_text->priv->mapped_file = g_mapped_file_new (src, FALSE, &error);
+                        if (merge_text->priv->mapped_file != NULL) {
+                                merge_text->priv->data     = g_mapped_file_get_contents (merge_text->priv->mapped_file);
+                                merge_text->priv->data_len = g_mapped_file_get_length (merge_text->priv->mapped_file);
+                                merge_text->priv->encoding = gl_read_encoding_mapped (merge_text->priv->data,
+                                                                                      merge_text->priv->data_len,
+                                                                                      &bom_len);
+                                merge_text->priv->data_pos = bom_len;
+
+                                if ( (merge_text->priv->encoding != SYSTEM_ENCODING) &&
+                                     (merge_text->priv->encoding != UTF8) &&
+                                     !decode_mapped (merge_text, src) )
+                                {
+                                        g_mapped_file_unref (merge_text->priv->mapped_file);
+                                        merge_text->priv->mapped_file = NULL;
+                                        merge_text->priv->data        = NULL;
+                                }
+                                merge_text->priv->data_start = merge_text->priv->data_pos;
                         } else {
-                                g_warning("gl_merge_text_open: %s (%s)",
-                                        strerror(errno), src);
+                                g_error_free (error);
+                        }
+
+                        if (merge_text->priv->mapped_file == NULL) {
+                                if ((merge_text->priv->fp = fopen (src, "r")) != NULL) {
+                                        merge_text->priv->encoding = gl_read_encoding(merge_text->priv->fp);
+                                } else {
+                                        g_warning("gl_merge_text_open: %s (%s)",
+                                                strerror(errno), src);
+                                }
                         }
                 }
                 g_free (src);
 
-                gchar* in_codeset = NULL;
-                switch (merge_text->priv->encoding) {
-                case UTF8:
-                case SYSTEM_ENCODING:
-                        break;
-                case UTF16_BE:
-                        in_codeset = "UTF-16BE";
-                        break;
-                case UTF16_LE:
-                        in_codeset = "UTF-16LE";
-                        break;
-                case UTF32_BE:
-                        in_codeset = "UTF-32BE";
-                        break;
-                case UTF32_LE:
-                        in_codeset = "UTF-32LE";
-                        break;
-                }
-                if (in_codeset != NULL) {
+                const gchar* in_codeset = codeset_from_encoding (merge_text->priv->encoding);
+                if (in_codeset != NULL && merge_text->priv->fp != NULL) {
                         merge_text->priv->g_iconverter = g_iconv_open("UTF8", in_codeset);
                         /* Since we define both codesets, we should always be able to open the converter */
                         g_assert(merge_text->priv->g_iconverter != (GIConv)-1);
@@ -540,11 +1035,25 @@ gl_merge_text_open (glMerge *merge)
                          */
 
                         line1_fields = parse_line (merge_text, merge_text->priv->delim);
-                        for ( p = line1_fields; p != NULL; p = p->next )
+                        if ( line1_fields != NULL )
                         {
-                                g_ptr_array_add (merge_text->priv->keys, g_strdup (p->data));
+                                for ( i = 0; i < line1_fields->len; i++ )
+                                {
+                                        g_ptr_array_add (merge_text->priv->keys,
+                                                         g_strdup (g_ptr_array_index (line1_fields, i)));
+                                }
+                                g_ptr_array_free (line1_fields, TRUE);
                         }
-                        free_fields (&line1_fields);
+                }
+
+                /*
+                 * Large sources are parsed in parallel.  Since only a bounded
+                 * number of chunks is parsed ahead of the reader, this also
+                 * suits streaming merges.
+                 */
+                if ( use_parallel_parse (merge_text) )
+                {
+                        start_parallel_parse (merge_text);
                 }
 
         }
@@ -563,11 +1072,33 @@ gl_merge_text_close (glMerge *merge)
 
         merge_text = GL_MERGE_TEXT (merge);
 
+        if (merge_text->priv->pool != NULL) {
+
+                stop_parallel_parse (merge_text);
+
+        }
+        free_index (merge_text);
         if (merge_text->priv->fp != NULL) {
 
-                fclose (merge_text->priv->fp);
+                if (merge_text->priv->fp != stdin) {
+                        fclose (merge_text->priv->fp);
+                }
                 merge_text->priv->fp = NULL;
 
+        }
+        if (merge_text->priv->mapped_file != NULL) {
+
+                g_mapped_file_unref (merge_text->priv->mapped_file);
+                merge_text->priv->mapped_file = NULL;
+                if (merge_text->priv->decoded != NULL) {
+                        g_bytes_unref (merge_text->priv->decoded);
+                        merge_text->priv->decoded = NULL;
+                }
+                merge_text->priv->data        = NULL;
+                merge_text->priv->data_len    = 0;
+                merge_text->priv->data_pos    = 0;
+                merge_text->priv->data_start  = 0;
+
         }
         if (merge_text->priv->g_iconverter != 0) {
                 g_iconv_close(merge_text->priv->g_iconverter);
@@ -585,12 +1116,14 @@ gl_merge_text_get_record (glMerge *merge)
         glMergeText   *merge_text;
         gchar          delim;
         glMergeRecord *record;
-        GList         *fields, *p;
-        gint           i_field;
-        glMergeField  *field;
+        GPtrArray     *fields;
 
         merge_text = GL_MERGE_TEXT (merge);
 
+        if ( merge_text->priv->pool != NULL ) {
+                return get_parallel_record (merge_text);
+        }
+
         delim = merge_text->priv->delim;
 
         fields = parse_line (merge_text, delim);
@@ -598,100 +1131,1062 @@ gl_merge_text_get_record (glMerge *merge)
                 return NULL;
         }
 
+        if ( (gint)fields->len > merge_text->priv->n_fields_max )
+        {
+                merge_text->priv->n_fields_max = fields->len;
+        }
+
+        record = new_record (merge_text, fields);
+        g_ptr_array_free (fields, TRUE);
+
+        return record;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Create record from parsed fields.                                        */
+/*--------------------------------------------------------------------------*/
+static glMergeRecord *
+new_record (glMergeText *merge_text,
+            GPtrArray   *fields)
+{
+        glMergeRecord *record;
+        gint           i_field;
+        glMergeField  *field;
+
         record = g_new0 (glMergeRecord, 1);
         record->select_flag = TRUE;
-        for (p=fields, i_field=0; p != NULL; p=p->next, i_field++) {
+        for (i_field = fields->len - 1; i_field >= 0; i_field--) {
 
                 field = g_new0 (glMergeField, 1);
-                field->key = key_from_index (merge_text, i_field);
-#ifndef CSV_ALWAYS_UTF8
-                if (merge_text->priv->encoding == SYSTEM_ENCODING) {
-                        field->value = g_locale_to_utf8 (p->data, -1, NULL, NULL, NULL);
-                } else {
-                        field->value = g_strdup (p->data);
-                }
-#else
-                field->value = g_strdup (p->data);
-#endif
-
-                record->field_list = g_list_append (record->field_list, field);
-        }
-        free_fields (&fields);
+                field->key   = key_from_index (merge_text, i_field);
+                field->value = field_to_utf8 (merge_text, g_ptr_array_index (fields, i_field));
 
-        if ( i_field > merge_text->priv->n_fields_max )
-        {
-                merge_text->priv->n_fields_max = i_field;
+                record->field_list = g_list_prepend (record->field_list, field);
         }
 
         return record;
 }
 
 
-/*---------------------------------------------------------------------------*/
-/* Copy merge_text specific fields.                                          */
-/*---------------------------------------------------------------------------*/
-static void
-gl_merge_text_copy (glMerge       *dst_merge,
-                    const glMerge *src_merge)
+/*--------------------------------------------------------------------------*/
+/* Get number of records in opened source from record index, -1 if unknown. */
+/*--------------------------------------------------------------------------*/
+static gint
+gl_merge_text_get_record_count (glMerge *merge)
 {
-        glMergeText *dst_merge_text;
-        glMergeText *src_merge_text;
-        gint         i;
+        glMergeText *merge_text;
+        gsize        n;
 
-        dst_merge_text = GL_MERGE_TEXT (dst_merge);
-        src_merge_text = GL_MERGE_TEXT (src_merge);
+        merge_text = GL_MERGE_TEXT (merge);
 
-        dst_merge_text->priv->delim          = src_merge_text->priv->delim;
-        dst_merge_text->priv->line1_has_keys = src_merge_text->priv->line1_has_keys;
+        if ( !ensure_index (merge_text) ) {
+                return -1;
+        }
 
-        for ( i=0; i < src_merge_text->priv->keys->len; i++ )
-        {
-                g_ptr_array_add (dst_merge_text->priv->keys,
-                                 g_strdup ((gchar *)g_ptr_array_index (src_merge_text->priv->keys, i)));
+        n = merge_text->priv->n_offsets;
+        if ( merge_text->priv->line1_has_keys && (n > 0) ) {
+                n--;
         }
 
-        dst_merge_text->priv->n_fields_max   = src_merge_text->priv->n_fields_max;
+        return n;
 }
 
 
-/*---------------------------------------------------------------------------*/
-/* PRIVATE.  Parse line.                                                     */
-/*                                                                           */
-/* Attempt to be a robust parser of various CSV (and similar) formats.       */
-/*                                                                           */
-/* Based on CSV format described in RFC 4180 section 2.                      */
-/*                                                                           */
-/* Additions to RFC 4180 rules:                                              */
-/*   - delimeters and other special characters may be "escaped" by a leading */
-/*     backslash (\)                                                         */
-/*   - C escape sequences for newline (\n) and tab (\t) are also translated. */
-/*   - if quoted text is not followed by a delimeter, any additional text is */
-/*     concatenated with quoted portion.                                     */
-/*                                                                           */
-/* Returns a list of fields.  A blank line is considered a line with one     */
-/* empty field.  Returns empty (NULL) when done.                             */
-/*---------------------------------------------------------------------------*/
-static GList *
-parse_line (glMergeText* merge_text,
-            gchar  delim )
+/*--------------------------------------------------------------------------*/
+/* Position opened source so that next record read is i_record.             */
+/*--------------------------------------------------------------------------*/
+static gboolean
+gl_merge_text_seek_record (glMerge *merge,
+                           gint     i_record)
 {
-        GList   *list;
-        GString *field;
-        gint     c;
-        enum { DELIM,
-               QUOTED, QUOTED_QUOTE1, QUOTED_ESCAPED,
-               SIMPLE, SIMPLE_ESCAPED,
-               DONE } state;
+        glMergeText *merge_text;
+
+        merge_text = GL_MERGE_TEXT (merge);
+
+        if ( !ensure_index (merge_text) ) {
+                return FALSE;
+        }
+
+        if ( merge_text->priv->line1_has_keys ) {
+                i_record++;
+        }
+        if ( (i_record < 0) || ((gsize)i_record > merge_text->priv->n_offsets) ) {
+                return FALSE;
+        }
+
+        /* Workers are restarted from the new position. */
+        if ( merge_text->priv->pool != NULL ) {
+                stop_parallel_parse (merge_text);
+        }
+
+        if ( (gsize)i_record < merge_text->priv->n_offsets ) {
+                merge_text->priv->data_pos = merge_text->priv->offsets[i_record];
+        } else {
+                merge_text->priv->data_pos = merge_text->priv->data_len;
+        }
+
+        if ( use_parallel_parse (merge_text) ) {
+                start_parallel_parse (merge_text);
+        }
+
+        return TRUE;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Get parse cache key of source: its absolute path, size and modification  */
+/* time, together with the parsing options.  NULL for standard input.       */
+/*--------------------------------------------------------------------------*/
+static gchar *
+gl_merge_text_get_cache_key (const glMerge *merge)
+{
+        glMergeText *merge_text;
+        gchar       *src, *cwd, *path, *key;
+        GStatBuf     st;
+
+        merge_text = GL_MERGE_TEXT (merge);
+
+        src = gl_merge_get_src (merge);
+        if ( (src == NULL) || (strcmp (src, "-") == 0) || (g_stat (src, &st) != 0) ) {
+                g_free (src);
+                return NULL;
+        }
+
+        if ( g_path_is_absolute (src) ) {
+                path = src;
+        } else {
+                cwd  = g_get_current_dir ();
+                path = g_build_filename (cwd, src, NULL);
+                g_free (cwd);
+                g_free (src);
+        }
+
+        key = g_strdup_printf ("%s\n%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT "\n%d\n%d",
+                               path,
+                               (gint64)st.st_size,
+                               (gint64)st.st_mtime,
+                               merge_text->priv->delim,
+                               merge_text->priv->line1_has_keys);
+        g_free (path);
+
+        return key;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Make sure record index of mapped source is available.                    */
+/*                                                                          */
+/* The index shared with the other duplicates of the merge is used if it is */
+/* still valid for the source.  Otherwise the saved index is used if it is  */
+/* valid, or else the index is rebuilt with find_record_end() and saved for */
+/* next time.  Offsets are relative to the parsed buffer and include the    */
+/* first line.                                                              */
+/*--------------------------------------------------------------------------*/
+static gboolean
+ensure_index (glMergeText *merge_text)
+{
+        SourceCache *cache = merge_text->priv->source_cache;
+        gchar       *src;
+        gchar       *index_name;
+        GStatBuf     st;
+        IndexHeader  header;
+        GBytes      *index;
+        gsize        len;
+
+        if ( merge_text->priv->index != NULL ) {
+                return TRUE;
+        }
+        if ( merge_text->priv->mapped_file == NULL ) {
+                return FALSE;
+        }
+
+        src = gl_merge_get_src (GL_MERGE (merge_text));
+        if ( (src == NULL) || (g_stat (src, &st) != 0) ) {
+                g_free (src);
+                return FALSE;
+        }
+
+        memset (&header, 0, sizeof (header));
+        memcpy (header.magic, INDEX_MAGIC, sizeof (header.magic));
+        header.src_size  = st.st_size;
+        header.src_mtime = st.st_mtime;
+        header.delim     = (guchar)merge_text->priv->delim;
+        header.encoding  = merge_text->priv->encoding;
+        header.data_len  = merge_text->priv->data_len;
+
+        /* Other cursors of this merge wait here rather than index again. */
+        g_mutex_lock (&cache->mutex);
+
+        if ( (cache->index == NULL) ||
+             (g_strcmp0 (cache->index_src, src) != 0) ||
+             (memcmp (&cache->index_header, &header, G_STRUCT_OFFSET (IndexHeader, n_records)) != 0) )
+        {
+                index      = NULL;
+                index_name = get_index_filename (merge_text);
+
+                if ( index_name != NULL )
+                {
+                        index = load_index (merge_text, index_name, &header);
+                }
+                if ( index == NULL )
+                {
+                        index = build_index (merge_text);
+
+                        header.n_records = g_bytes_get_size (index) / sizeof (guint64);
+                        if ( index_name != NULL )
+                        {
+                                save_index (index, index_name, &header);
+                        }
+                }
+                g_free (index_name);
+
+                if ( cache->index != NULL ) {
+                        g_bytes_unref (cache->index);
+                }
+                g_free (cache->index_src);
+                cache->index_src    = g_strdup (src);
+                cache->index_header = header;
+                cache->index        = index;
+        }
+
+        merge_text->priv->index = g_bytes_ref (cache->index);
+
+        g_mutex_unlock (&cache->mutex);
+
+        g_free (src);
+
+        merge_text->priv->offsets   = g_bytes_get_data (merge_text->priv->index, &len);
+        merge_text->priv->n_offsets = len / sizeof (guint64);
+
+        return TRUE;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Build record index of mapped source with find_record_end().              */
+/*                                                                          */
+/* Large sources are split into one segment per processor, each scanned in  */
+/* its own thread from its first newline on.  The segments are then         */
+/* stitched in order: starting from the true start of the first record of   */
+/* a segment, records are followed with find_record_end() until one starts  */
+/* where the speculative scan found one, from where on both scans agree.    */
+/* A newline within a quoted field only costs rescanning up to the next     */
+/* record start that both scans have in common.                             */
+/*--------------------------------------------------------------------------*/
+static GBytes *
+build_index (glMergeText *merge_text)
+{
+        GArray       *offsets;
+        gint          n_segments, i;
+        gsize         segment_size;
+        IndexSegment *segments, *segment;
+        guint         j;
+        gsize         pos;
+        guint64       offset;
+        gsize         len;
+
+        offsets = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+        n_segments = g_get_num_processors ();
+        if ( merge_text->priv->data_len - merge_text->priv->data_start < PARALLEL_MIN_SIZE ) {
+                n_segments = 1;
+        }
+        segment_size = (merge_text->priv->data_len - merge_text->priv->data_start) / n_segments;
+
+        segments = g_new0 (IndexSegment, n_segments);
+        for ( i = 0; i < n_segments; i++ )
+        {
+                segment = &segments[i];
+                segment->merge_text = merge_text;
+                segment->start      = merge_text->priv->data_start + i * segment_size;
+                segment->end        = (i + 1 < n_segments) ?
+                        segment->start + segment_size : merge_text->priv->data_len;
+                segment->starts     = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+                /* The first segment starts with a record, no need to scan it. */
+                if ( i > 0 )
+                {
+                        segment->thread = g_thread_new ("glabels-index", scan_index_segment, segment);
+                }
+        }
+
+        pos = merge_text->priv->data_start;
+        for ( i = 0; i < n_segments; i++ )
+        {
+                segment = &segments[i];
+                if ( segment->thread != NULL )
+                {
+                        g_thread_join (segment->thread);
+                }
+
+                j = 0;
+                while ( pos < segment->end )
+                {
+                        while ( (j < segment->starts->len) &&
+                                (g_array_index (segment->starts, guint64, j) < pos) )
+                        {
+                                j++;
+                        }
+                        if ( (j < segment->starts->len) &&
+                             (g_array_index (segment->starts, guint64, j) == pos) )
+                        {
+                                /* In step with speculative scan from here on. */
+                                g_array_append_vals (offsets,
+                                                     &g_array_index (segment->starts, guint64, j),
+                                                     segment->starts->len - j);
+                                pos = segment->next;
+                                break;
+                        }
+
+                        offset = pos;
+                        g_array_append_val (offsets, offset);
+
+                        pos = find_record_end (merge_text->priv->data,
+                                               merge_text->priv->data_len,
+                                               pos,
+                                               merge_text->priv->delim);
+                }
+
+                g_array_free (segment->starts, TRUE);
+        }
+        g_free (segments);
+
+        len = offsets->len * sizeof (guint64);
+
+        return g_bytes_new_take (g_array_free (offsets, FALSE), len);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Thread function: find record starts of index segment, assuming that a    */
+/* record starts after its first newline.                                   */
+/*--------------------------------------------------------------------------*/
+static gpointer
+scan_index_segment (gpointer data)
+{
+        IndexSegment *segment    = (IndexSegment *)data;
+        glMergeText  *merge_text = segment->merge_text;
+        const gchar  *newline;
+        guint64       pos;
+
+        newline = memchr (merge_text->priv->data + segment->start, '\n',
+                          segment->end - segment->start);
+        if ( newline == NULL ) {
+                return NULL;
+        }
+
+        pos = newline - merge_text->priv->data + 1;
+        while ( pos < segment->end )
+        {
+                g_array_append_val (segment->starts, pos);
+
+                pos = find_record_end (merge_text->priv->data,
+                                       merge_text->priv->data_len,
+                                       pos,
+                                       merge_text->priv->delim);
+        }
+        segment->next = pos;
+
+        return NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Get filename of saved index in merge cache directory, NULL if there is   */
+/* no cache directory or it is not writable.                                */
+/*--------------------------------------------------------------------------*/
+static gchar *
+get_index_filename (glMergeText *merge_text)
+{
+        const gchar *dir;
+        gchar       *key, *checksum, *basename, *filename;
+
+        dir = gl_merge_get_cache_dir ();
+        if ( dir == NULL ) {
+                return NULL;
+        }
+
+        g_mkdir_with_parents (dir, 0700);
+        if ( g_access (dir, W_OK) != 0 ) {
+                gl_debug (DEBUG_MERGE, "cache directory not writable: %s", dir);
+                return NULL;
+        }
+
+        key = gl_merge_text_get_cache_key (GL_MERGE (merge_text));
+        if ( key == NULL ) {
+                return NULL;
+        }
+
+        checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+        basename = g_strconcat (checksum, INDEX_SUFFIX, NULL);
+        filename = g_build_filename (dir, basename, NULL);
+
+        g_free (key);
+        g_free (checksum);
+        g_free (basename);
+
+        return filename;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Map saved index, if its header matches expected header and its offsets   */
+/* are ascending record starts within the parsed buffer.                    */
+/*--------------------------------------------------------------------------*/
+static GBytes *
+load_index (glMergeText       *merge_text,
+            const gchar       *index_name,
+            const IndexHeader *header)
+{
+        GMappedFile       *file;
+        const IndexHeader *file_header;
+        const guint64     *offsets;
+        gsize              len, i;
+        GBytes            *contents, *index;
+
+        file = g_mapped_file_new (index_name, FALSE, NULL);
+        if ( file == NULL ) {
+                return NULL;
+        }
+
+        len         = g_mapped_file_get_length (file);
+        file_header = (const IndexHeader *)g_mapped_file_get_contents (file);
+
+        if ( (len < sizeof (IndexHeader)) ||
+             (memcmp (file_header, header, G_STRUCT_OFFSET (IndexHeader, n_records)) != 0) ||
+             (file_header->n_records != (len - sizeof (IndexHeader)) / sizeof (guint64)) ||
+             ((len - sizeof (IndexHeader)) % sizeof (guint64) != 0) )
+        {
+                gl_debug (DEBUG_MERGE, "stale index: %s", index_name);
+                g_mapped_file_unref (file);
+                return NULL;
+        }
+
+        offsets = (const guint64 *)(file_header + 1);
+        for ( i = 0; i < file_header->n_records; i++ )
+        {
+                if ( (offsets[i] < merge_text->priv->data_start) ||
+                     (offsets[i] >= merge_text->priv->data_len) ||
+                     ((i > 0) && (offsets[i] <= offsets[i-1])) )
+                {
+                        g_message ("Ignoring corrupt merge index %s", index_name);
+                        g_mapped_file_unref (file);
+                        return NULL;
+                }
+        }
+
+        /* Offsets, still mapped from the file. */
+        contents = g_mapped_file_get_bytes (file);
+        index    = g_bytes_new_from_bytes (contents, sizeof (IndexHeader),
+                                           len - sizeof (IndexHeader));
+        g_bytes_unref (contents);
+        g_mapped_file_unref (file);
+
+        return index;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Save record index to cache file.  Failure is not an error, the index    */
+/* is simply rebuilt next time.                                             */
+/*--------------------------------------------------------------------------*/
+static void
+save_index (GBytes            *index,
+            const gchar       *index_name,
+            const IndexHeader *header)
+{
+        gsize        len, index_len;
+        gchar       *contents;
+        GError      *error = NULL;
+
+        index_len = g_bytes_get_size (index);
+        len       = sizeof (IndexHeader) + index_len;
+        contents  = g_malloc (len);
+        memcpy (contents, header, sizeof (IndexHeader));
+        memcpy (contents + sizeof (IndexHeader),
+                g_bytes_get_data (index, NULL),
+                index_len);
+
+        if ( !g_file_set_contents (index_name, contents, len, &error) )
+        {
+                gl_debug (DEBUG_MERGE, "cannot save index: %s", error->message);
+                g_error_free (error);
+        }
+
+        g_free (contents);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Release record index.                                                    */
+/*--------------------------------------------------------------------------*/
+static void
+free_index (glMergeText *merge_text)
+{
+        if ( merge_text->priv->index != NULL ) {
+                g_bytes_unref (merge_text->priv->index);
+                merge_text->priv->index = NULL;
+        }
+        merge_text->priv->offsets   = NULL;
+        merge_text->priv->n_offsets = 0;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Is remainder of mapped source large enough to be parsed in parallel?     */
+/*--------------------------------------------------------------------------*/
+static gboolean
+use_parallel_parse (glMergeText *merge_text)
+{
+        return ( (merge_text->priv->mapped_file != NULL) &&
+                 (merge_text->priv->data_len - merge_text->priv->data_pos >= PARALLEL_MIN_SIZE) &&
+                 (g_get_num_processors () > 1) );
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Split remainder of mapped source into chunks and start parsing them.     */
+/*                                                                          */
+/* Chunk boundaries are taken from the record index (see build_index()),    */
+/* or else found with find_record_end(), which follows the same quoting and */
+/* escape rules as the parser, so that quoted fields spanning lines are     */
+/* never split.                                                             */
+/*--------------------------------------------------------------------------*/
+static void
+start_parallel_parse (glMergeText *merge_text)
+{
+        gint         n_threads;
+        gsize        chunk_size, start, pos;
+        gboolean     use_index;
+        gsize        i_offset;
+        Chunk       *chunk;
+
+        n_threads  = g_get_num_processors ();
+        chunk_size = (merge_text->priv->data_len - merge_text->priv->data_pos) / (n_threads * CHUNKS_PER_THREAD);
+        chunk_size = MAX (chunk_size, CHUNK_MIN_SIZE);
+
+        merge_text->priv->chunks = g_ptr_array_new_with_free_func (g_free);
+
+        use_index = ensure_index (merge_text);
+        i_offset  = 0;
+        while ( use_index && (i_offset < merge_text->priv->n_offsets) &&
+                (merge_text->priv->offsets[i_offset] < merge_text->priv->data_pos) )
+        {
+                i_offset++;
+        }
+
+        start = merge_text->priv->data_pos;
+        while ( start < merge_text->priv->data_len )
+        {
+                if ( use_index )
+                {
+                        while ( (i_offset < merge_text->priv->n_offsets) &&
+                                (merge_text->priv->offsets[i_offset] - start < chunk_size) )
+                        {
+                                i_offset++;
+                        }
+                        pos = (i_offset < merge_text->priv->n_offsets) ?
+                                merge_text->priv->offsets[i_offset] : merge_text->priv->data_len;
+                }
+                else
+                {
+                        pos = start;
+                        while ( (pos < merge_text->priv->data_len) && (pos - start < chunk_size) )
+                        {
+                                pos = find_record_end (merge_text->priv->data,
+                                                       merge_text->priv->data_len,
+                                                       pos,
+                                                       merge_text->priv->delim);
+                        }
+                }
+
+                chunk = g_new0 (Chunk, 1);
+                chunk->start   = start;
+                chunk->end     = pos;
+                chunk->records = g_ptr_array_new ();
+                g_ptr_array_add (merge_text->priv->chunks, chunk);
+
+                start = pos;
+        }
+        merge_text->priv->data_pos = merge_text->priv->data_len;
+
+        merge_text->priv->i_chunk         = 0;
+        merge_text->priv->i_chunk_record  = 0;
+        merge_text->priv->n_chunks_queued = 0;
+        merge_text->priv->n_chunks_ahead  = n_threads * CHUNKS_AHEAD_PER_THREAD;
+
+        merge_text->priv->pool = g_thread_pool_new (parse_chunk, merge_text,
+                                                    n_threads, FALSE, NULL);
+
+        queue_chunks (merge_text);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Stop worker threads, discarding any records not yet read.                */
+/*--------------------------------------------------------------------------*/
+static void
+stop_parallel_parse (glMergeText *merge_text)
+{
+        guint          i, j;
+        Chunk         *chunk;
+        glMergeRecord *record;
+
+        /* Drop queued chunks, wait for chunks in progress. */
+        g_thread_pool_free (merge_text->priv->pool, TRUE, TRUE);
+        merge_text->priv->pool = NULL;
+
+        for ( i = 0; i < merge_text->priv->chunks->len; i++ )
+        {
+                chunk = g_ptr_array_index (merge_text->priv->chunks, i);
+
+                if ( i >= merge_text->priv->i_chunk )
+                {
+                        j = (i == merge_text->priv->i_chunk) ? merge_text->priv->i_chunk_record : 0;
+                        for ( ; j < chunk->records->len; j++ )
+                        {
+                                record = g_ptr_array_index (chunk->records, j);
+                                gl_merge_free_record (&record);
+                        }
+                }
+                g_ptr_array_free (chunk->records, TRUE);
+        }
+        g_ptr_array_free (merge_text->priv->chunks, TRUE);
+        merge_text->priv->chunks = NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Get next record, in source order, from parsed chunks.                    */
+/*--------------------------------------------------------------------------*/
+static glMergeRecord *
+get_parallel_record (glMergeText *merge_text)
+{
+        Chunk         *chunk;
+        glMergeRecord *record;
+
+        while ( merge_text->priv->i_chunk < merge_text->priv->chunks->len )
+        {
+                chunk = g_ptr_array_index (merge_text->priv->chunks, merge_text->priv->i_chunk);
+
+                g_mutex_lock (&merge_text->priv->chunk_mutex);
+                while ( !chunk->done )
+                {
+                        g_cond_wait (&merge_text->priv->chunk_cond, &merge_text->priv->chunk_mutex);
+                }
+                g_mutex_unlock (&merge_text->priv->chunk_mutex);
+
+                if ( merge_text->priv->i_chunk_record == 0 )
+                {
+                        merge_text->priv->n_fields_max = MAX (merge_text->priv->n_fields_max,
+                                                              chunk->n_fields_max);
+                }
+
+                if ( merge_text->priv->i_chunk_record < chunk->records->len )
+                {
+                        record = g_ptr_array_index (chunk->records, merge_text->priv->i_chunk_record);
+                        merge_text->priv->i_chunk_record++;
+                        return record;
+                }
+
+                /* Chunk exhausted, records now belong to caller. */
+                g_ptr_array_set_size (chunk->records, 0);
+                merge_text->priv->i_chunk++;
+                merge_text->priv->i_chunk_record = 0;
+
+                queue_chunks (merge_text);
+        }
+
+        return NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Queue chunks for parsing, up to n_chunks_ahead beyond the current chunk. */
+/*--------------------------------------------------------------------------*/
+static void
+queue_chunks (glMergeText *merge_text)
+{
+        guint  limit;
+
+        limit = MIN (merge_text->priv->i_chunk + merge_text->priv->n_chunks_ahead,
+                     merge_text->priv->chunks->len);
+
+        while ( merge_text->priv->n_chunks_queued < limit )
+        {
+                g_thread_pool_push (merge_text->priv->pool,
+                                    g_ptr_array_index (merge_text->priv->chunks,
+                                                       merge_text->priv->n_chunks_queued),
+                                    NULL);
+                merge_text->priv->n_chunks_queued++;
+        }
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* Worker thread: parse all records of a chunk.                             */
+/*--------------------------------------------------------------------------*/
+static void
+parse_chunk (gpointer data,
+             gpointer user_data)
+{
+        Chunk       *chunk      = (Chunk *)data;
+        glMergeText *merge_text = GL_MERGE_TEXT (user_data);
+        gsize        pos;
+        GPtrArray   *fields;
+
+        pos = chunk->start;
+        while ( (fields = parse_line_buffer (merge_text->priv->data,
+                                             chunk->end,
+                                             &pos,
+                                             merge_text->priv->delim)) != NULL )
+        {
+                chunk->n_fields_max = MAX (chunk->n_fields_max, (gint)fields->len);
+                g_ptr_array_add (chunk->records, new_record (merge_text, fields));
+                g_ptr_array_free (fields, TRUE);
+        }
+
+        g_mutex_lock (&merge_text->priv->chunk_mutex);
+        chunk->done = TRUE;
+        g_cond_broadcast (&merge_text->priv->chunk_cond);
+        g_mutex_unlock (&merge_text->priv->chunk_mutex);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* Copy merge_text specific fields.                                          */
+/*---------------------------------------------------------------------------*/
+static void
+gl_merge_text_copy (glMerge       *dst_merge,
+                    const glMerge *src_merge)
+{
+        glMergeText *dst_merge_text;
+        glMergeText *src_merge_text;
+        gint         i;
+
+        dst_merge_text = GL_MERGE_TEXT (dst_merge);
+        src_merge_text = GL_MERGE_TEXT (src_merge);
+
+        dst_merge_text->priv->delim          = src_merge_text->priv->delim;
+        dst_merge_text->priv->line1_has_keys = src_merge_text->priv->line1_has_keys;
+
+        for ( i=0; i < src_merge_text->priv->keys->len; i++ )
+        {
+                g_ptr_array_add (dst_merge_text->priv->keys,
+                                 g_strdup ((gchar *)g_ptr_array_index (src_merge_text->priv->keys, i)));
+        }
+
+        dst_merge_text->priv->n_fields_max   = src_merge_text->priv->n_fields_max;
+
+        /* Share decoded text with the original. */
+        source_cache_unref (dst_merge_text->priv->source_cache);
+        dst_merge_text->priv->source_cache = source_cache_ref (src_merge_text->priv->source_cache);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Parse line.                                                     */
+/*                                                                           */
+/* Attempt to be a robust parser of various CSV (and similar) formats.       */
+/*                                                                           */
+/* Based on CSV format described in RFC 4180 section 2.                      */
+/*                                                                           */
+/* Additions to RFC 4180 rules:                                              */
+/*   - delimeters and other special characters may be "escaped" by a leading */
+/*     backslash (\)                                                         */
+/*   - C escape sequences for newline (\n) and tab (\t) are also translated. */
+/*   - if quoted text is not followed by a delimeter, any additional text is */
+/*     concatenated with quoted portion.                                     */
+/*                                                                           */
+/* Returns an array of fields.  A blank line is considered a line with one   */
+/* empty field.  Returns NULL when done.                                     */
+/*---------------------------------------------------------------------------*/
+static GPtrArray *
+parse_line (glMergeText* merge_text,
+            gchar  delim )
+{
+        if (merge_text->priv->mapped_file != NULL) {
+                return parse_line_buffer (merge_text->priv->data,
+                                          merge_text->priv->data_len,
+                                          &merge_text->priv->data_pos,
+                                          delim);
+        } else {
+                return parse_line_stream (merge_text, delim);
+        }
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Parse line from stream, one character at a time.                */
+/*---------------------------------------------------------------------------*/
+static GPtrArray *
+parse_line_stream (glMergeText* merge_text,
+                   gchar  delim )
+{
+        GPtrArray *list;
+        GString   *field;
+        gint     c;
+        enum { DELIM,
+               QUOTED, QUOTED_QUOTE1, QUOTED_ESCAPED,
+               SIMPLE, SIMPLE_ESCAPED,
+               DONE } state;
+
+        if (merge_text->priv->fp == NULL) {
+                return NULL;
+        }
+               
+        state = DELIM;
+        list  = g_ptr_array_new_with_free_func (g_free);
+        field = g_string_new( "" );
+        while ( state != DONE ) {
+                c=gl_getc (merge_text);
+
+                switch (state) {
+
+                case DELIM:
+                        switch (c) {
+                        case '\n':
+                                /* last field is empty. */
+                                g_ptr_array_add (list, g_strdup (""));
+                                state = DONE;
+                                break;
+                        case '\r':
+                                /* ignore */
+                                state = DELIM;
+                                break;
+                        case EOF:
+                                /* end of file, no more lines. */
+                                state = DONE;
+                                break;
+                        case '"':
+                                /* start a quoted field. */
+                                state = QUOTED;
+                                break;
+                        case '\\':
+                                /* simple field, but 1st character is an escape. */
+                                state = SIMPLE_ESCAPED;
+                                break;
+                        default:
+                                if ( c == delim )
+                                {
+                                        /* field is empty. */
+                                        g_ptr_array_add (list, g_strdup (""));
+                                        state = DELIM;
+                                }
+                                else
+                                {
+                                        /* begining of a simple field. */
+                                        field = g_string_append_c (field, c);
+                                        state = SIMPLE;
+                                }
+                                break;
+                        }
+                        break;
+
+                case QUOTED:
+                        switch (c) {
+                        case EOF:
+                                /* File ended mid way through quoted item, truncate field. */
+                                g_ptr_array_add (list, g_strdup (field->str));
+                                state = DONE;
+                                break;
+                        case '"':
+                                /* Possible end of field, but could be 1st of a pair. */
+                                state = QUOTED_QUOTE1;
+                                break;
+                        case '\\':
+                                /* Escape next character, or special escape, e.g. \n. */
+                                state = QUOTED_ESCAPED;
+                                break;
+                        default:
+                                /* Use character literally. */
+                                field = g_string_append_c (field, c);
+                                break;
+                        }
+                        break;
+
+                case QUOTED_QUOTE1:
+                        switch (c) {
+                        case '\n':
+                        case EOF:
+                                /* line or file ended after quoted item */
+                                g_ptr_array_add (list, g_strdup (field->str));
+                                state = DONE;
+                                break;
+                        case '"':
+                                /* second quote, insert and stay quoted. */
+                                field = g_string_append_c (field, c);
+                                state = QUOTED;
+                                break;
+                        case '\r':
+                                /* ignore and go to fallback */
+                                state = SIMPLE;
+                                break;
+                        default:
+                                if ( c == delim )
+                                {
+                                        /* end of field. */
+                                        g_ptr_array_add (list, g_strdup (field->str));
+                                        field = g_string_assign( field, "" );
+                                        state = DELIM;
+                                }
+                                else
+                                {
+                                        /* fallback if not a delim or another quote. */
+                                        field = g_string_append_c (field, c);
+                                        state = SIMPLE;
+                                }
+                                break;
+                        }
+                        break;
+
+                case QUOTED_ESCAPED:
+                        switch (c) {
+                        case EOF:
+                                /* File ended mid way through quoted item */
+                                g_ptr_array_add (list, g_strdup (field->str));
+                                state = DONE;
+                                break;
+                        case 'n':
+                                /* Decode "\n" as newline. */
+                                field = g_string_append_c (field, '\n');
+                                state = QUOTED;
+                                break;
+                        case 't':
+                                /* Decode "\t" as tab. */
+                                field = g_string_append_c (field, '\t');
+                                state = QUOTED;
+                                break;
+                        default:
+                                /* Use character literally. */
+                                field = g_string_append_c (field, c);
+                                state = QUOTED;
+                                break;
+                        }
+                        break;
+
+                case SIMPLE:
+                        switch (c) {
+                        case '\n':
+                        case EOF:
+                                /* line or file ended */
+                                g_ptr_array_add (list, g_strdup (field->str));
+                                state = DONE;
+                                break;
+                        case '\r':
+                                /* ignore */
+                                state = SIMPLE;
+                                break;
+                        case '\\':
+                                /* Escape next character, or special escape, e.g. \n. */
+                                state = SIMPLE_ESCAPED;
+                                break;
+                        default:
+                                if ( c == delim )
+                                {
+                                        /* end of field. */
+                                        g_ptr_array_add (list, g_strdup (field->str));
+                                        field = g_string_assign( field, "" );
+                                        state = DELIM;
+                                }
+                                else
+                                {
+                                        /* Use character literally. */
+                                        field = g_string_append_c (field, c);
+                                        state = SIMPLE;
+                                }
+                                break;
+                        }
+                        break;
+
+                case SIMPLE_ESCAPED:
+                        switch (c) {
+                        case EOF:
+                                /* File ended mid way through quoted item */
+                                g_ptr_array_add (list, g_strdup (field->str));
+                                state = DONE;
+                                break;
+                        case 'n':
+                                /* Decode "\n" as newline. */
+                                field = g_string_append_c (field, '\n');
+                                state = SIMPLE;
+                                break;
+                        case 't':
+                                /* Decode "\t" as tab. */
+                                field = g_string_append_c (field, '\t');
+                                state = SIMPLE;
+                                break;
+                        default:
+                                /* Use character literally. */
+                                field = g_string_append_c (field, c);
+                                state = SIMPLE;
+                                break;
+                        }
+                        break;
+
+                default:
+                        g_assert_not_reached();
+                        break;
+                }
 
-        if (merge_text->priv->fp == NULL) {
-                return NULL;
         }
-               
+        g_string_free( field, TRUE );
+
+        if ( list->len == 0 ) {
+                g_ptr_array_free (list, TRUE);
+                list = NULL;
+        }
+
+        return list;
+}
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Parse line from memory buffer, starting at *pos.                */
+/*                                                                           */
+/* Same state machine as parse_line_stream(), but runs of ordinary           */
+/* characters within simple and quoted fields are located with              */
+/* find_special() and appended to the field in one go.  The end of the       */
+/* buffer (len) is treated as end of file.                                   */
+/*---------------------------------------------------------------------------*/
+static GPtrArray *
+parse_line_buffer (const gchar *data,
+                   gsize        len,
+                   gsize       *pos,
+                   gchar        delim)
+{
+        GPtrArray   *list;
+        GString     *field;
+        gint         c;
+        const gchar *p, *end, *run_end;
+        enum { DELIM,
+               QUOTED, QUOTED_QUOTE1, QUOTED_ESCAPED,
+               SIMPLE, SIMPLE_ESCAPED,
+               DONE } state;
+
+        p   = data + *pos;
+        end = data + len;
+
+        if (p >= end) {
+                return NULL;
+        }
+
         state = DELIM;
-        list  = NULL;
+        list  = g_ptr_array_new_with_free_func (g_free);
         field = g_string_new( "" );
         while ( state != DONE ) {
-                c=gl_getc (merge_text);
+
+                if ( state == SIMPLE ) {
+                        run_end = find_special (p, end, '\n', '\r', '\\', delim);
+                        g_string_append_len (field, p, run_end - p);
+                        p = run_end;
+                } else if ( state == QUOTED ) {
+                        run_end = find_special (p, end, '"', '\\', '"', '\\');
+                        g_string_append_len (field, p, run_end - p);
+                        p = run_end;
+                }
+
+                c = (p < end) ? (guchar)*p++ : EOF;
 
                 switch (state) {
 
@@ -699,7 +2194,7 @@ parse_line (glMergeText* merge_text,
                         switch (c) {
                         case '\n':
                                 /* last field is empty. */
-                                list = g_list_append (list, g_strdup (""));
+                                g_ptr_array_add (list, g_strdup (""));
                                 state = DONE;
                                 break;
                         case '\r':
@@ -722,7 +2217,7 @@ parse_line (glMergeText* merge_text,
                                 if ( c == delim )
                                 {
                                         /* field is empty. */
-                                        list = g_list_append (list, g_strdup (""));
+                                        g_ptr_array_add (list, g_strdup (""));
                                         state = DELIM;
                                 }
                                 else
@@ -739,7 +2234,7 @@ parse_line (glMergeText* merge_text,
                         switch (c) {
                         case EOF:
                                 /* File ended mid way through quoted item, truncate field. */
-                                list = g_list_append (list, g_strdup (field->str));
+                                g_ptr_array_add (list, g_strdup (field->str));
                                 state = DONE;
                                 break;
                         case '"':
@@ -762,7 +2257,7 @@ parse_line (glMergeText* merge_text,
                         case '\n':
                         case EOF:
                                 /* line or file ended after quoted item */
-                                list = g_list_append (list, g_strdup (field->str));
+                                g_ptr_array_add (list, g_strdup (field->str));
                                 state = DONE;
                                 break;
                         case '"':
@@ -778,7 +2273,7 @@ parse_line (glMergeText* merge_text,
                                 if ( c == delim )
                                 {
                                         /* end of field. */
-                                        list = g_list_append (list, g_strdup (field->str));
+                                        g_ptr_array_add (list, g_strdup (field->str));
                                         field = g_string_assign( field, "" );
                                         state = DELIM;
                                 }
@@ -796,7 +2291,7 @@ parse_line (glMergeText* merge_text,
                         switch (c) {
                         case EOF:
                                 /* File ended mid way through quoted item */
-                                list = g_list_append (list, g_strdup (field->str));
+                                g_ptr_array_add (list, g_strdup (field->str));
                                 state = DONE;
                                 break;
                         case 'n':
@@ -822,7 +2317,7 @@ parse_line (glMergeText* merge_text,
                         case '\n':
                         case EOF:
                                 /* line or file ended */
-                                list = g_list_append (list, g_strdup (field->str));
+                                g_ptr_array_add (list, g_strdup (field->str));
                                 state = DONE;
                                 break;
                         case '\r':
@@ -837,7 +2332,7 @@ parse_line (glMergeText* merge_text,
                                 if ( c == delim )
                                 {
                                         /* end of field. */
-                                        list = g_list_append (list, g_strdup (field->str));
+                                        g_ptr_array_add (list, g_strdup (field->str));
                                         field = g_string_assign( field, "" );
                                         state = DELIM;
                                 }
@@ -855,7 +2350,7 @@ parse_line (glMergeText* merge_text,
                         switch (c) {
                         case EOF:
                                 /* File ended mid way through quoted item */
-                                list = g_list_append (list, g_strdup (field->str));
+                                g_ptr_array_add (list, g_strdup (field->str));
                                 state = DONE;
                                 break;
                         case 'n':
@@ -884,29 +2379,194 @@ parse_line (glMergeText* merge_text,
         }
         g_string_free( field, TRUE );
 
+        *pos = p - data;
+
+        if ( list->len == 0 ) {
+                g_ptr_array_free (list, TRUE);
+                list = NULL;
+        }
+
         return list;
 }
 
 
 /*---------------------------------------------------------------------------*/
-/* Free list of fields.                                                      */
+/* PRIVATE.  Find end of record starting at pos, without parsing its fields. */
+/*                                                                           */
+/* Follows the same transitions as parse_line_buffer(), only tracking       */
+/* whether a newline terminates the record.  Returns offset just past the    */
+/* record, which is the start of the next record.                            */
+/*---------------------------------------------------------------------------*/
+static gsize
+find_record_end (const gchar *data,
+                 gsize        len,
+                 gsize        pos,
+                 gchar        delim)
+{
+        const gchar *p, *end;
+        gint         c;
+        enum { DELIM,
+               QUOTED, QUOTED_QUOTE1, QUOTED_ESCAPED,
+               SIMPLE, SIMPLE_ESCAPED } state;
+
+        p   = data + pos;
+        end = data + len;
+
+        state = DELIM;
+        while ( p < end ) {
+
+                if ( state == SIMPLE ) {
+                        p = find_special (p, end, '\n', '\\', delim, delim);
+                } else if ( state == QUOTED ) {
+                        p = find_special (p, end, '"', '\\', '"', '\\');
+                }
+                if ( p >= end ) {
+                        break;
+                }
+
+                c = (guchar)*p++;
+
+                switch (state) {
+
+                case DELIM:
+                        if ( c == '\n' ) {
+                                return p - data;
+                        } else if ( c == '\r' ) {
+                                state = DELIM;
+                        } else if ( c == '"' ) {
+                                state = QUOTED;
+                        } else if ( c == '\\' ) {
+                                state = SIMPLE_ESCAPED;
+                        } else if ( c == delim ) {
+                                state = DELIM;
+                        } else {
+                                state = SIMPLE;
+                        }
+                        break;
+
+                case QUOTED:
+                        if ( c == '"' ) {
+                                state = QUOTED_QUOTE1;
+                        } else if ( c == '\\' ) {
+                                state = QUOTED_ESCAPED;
+                        }
+                        break;
+
+                case QUOTED_QUOTE1:
+                        if ( c == '\n' ) {
+                                return p - data;
+                        } else if ( c == '"' ) {
+                                state = QUOTED;
+                        } else if ( c == '\r' ) {
+                                state = SIMPLE;
+                        } else if ( c == delim ) {
+                                state = DELIM;
+                        } else {
+                                state = SIMPLE;
+                        }
+                        break;
+
+                case QUOTED_ESCAPED:
+                        state = QUOTED;
+                        break;
+
+                case SIMPLE:
+                        if ( c == '\n' ) {
+                                return p - data;
+                        } else if ( c == '\r' ) {
+                                state = SIMPLE;
+                        } else if ( c == '\\' ) {
+                                state = SIMPLE_ESCAPED;
+                        } else if ( c == delim ) {
+                                state = DELIM;
+                        }
+                        break;
+
+                case SIMPLE_ESCAPED:
+                        state = SIMPLE;
+                        break;
+
+                default:
+                        g_assert_not_reached();
+                        break;
+                }
+
+        }
+
+        return len;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Find first occurrence of any of the given characters.           */
+/*                                                                           */
+/* Returns end if none of c1..c4 occur in [p,end).  Scans 16 bytes at a time */
+/* when SSE2 is available.                                                   */
 /*---------------------------------------------------------------------------*/
-void
-free_fields (GList ** list)
+static const gchar *
+find_special (const gchar *p,
+              const gchar *end,
+              gchar        c1,
+              gchar        c2,
+              gchar        c3,
+              gchar        c4)
 {
-        GList *p;
+#ifdef __SSE2__
+        const __m128i v1 = _mm_set1_epi8 (c1);
+        const __m128i v2 = _mm_set1_epi8 (c2);
+        const __m128i v3 = _mm_set1_epi8 (c3);
+        const __m128i v4 = _mm_set1_epi8 (c4);
+        __m128i       chunk, hits;
+        gint          mask;
+
+        while ( (end - p) >= 16 )
+        {
+                chunk = _mm_loadu_si128 ((const __m128i *)p);
+                hits  = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (chunk, v1),
+                                                    _mm_cmpeq_epi8 (chunk, v2)),
+                                      _mm_or_si128 (_mm_cmpeq_epi8 (chunk, v3),
+                                                    _mm_cmpeq_epi8 (chunk, v4)));
+                mask  = _mm_movemask_epi8 (hits);
+                if ( mask != 0 )
+                {
+                        return p + g_bit_nth_lsf (mask, -1);
+                }
+                p += 16;
+        }
+#endif
 
-        for ( p = *list; p != NULL; p = p->next )
+        for ( ; p < end; p++ )
         {
-                g_free (p->data);
-                p->data = NULL;
+                if ( (*p == c1) || (*p == c2) || (*p == c3) || (*p == c4) )
+                {
+                        return p;
+                }
         }
 
-        g_list_free (*list);
-        *list = NULL;
+        return end;
 }
 
 
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Convert raw field to UTF-8 value, NULL if not convertible.      */
+/*---------------------------------------------------------------------------*/
+static gchar *
+field_to_utf8 (glMergeText *merge_text,
+               const gchar *field)
+{
+#ifndef CSV_ALWAYS_UTF8
+        if (merge_text->priv->encoding == SYSTEM_ENCODING) {
+                if ( g_get_charset (NULL) ) {
+                        /* Locale is already UTF-8, only validate. */
+                        return g_utf8_validate (field, -1, NULL) ? g_strdup (field) : NULL;
+                } else {
+                        return g_locale_to_utf8 (field, -1, NULL, NULL, NULL);
+                }
+        }
+#endif
+        return g_strdup (field);
+}
+
 
 /*
  * Local Variables:       -- emacs
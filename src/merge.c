@@ -24,23 +24,142 @@
 
 #include <glib/gi18n.h>
 #include <gobject/gvaluecollector.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <libglabels.h>
 
+#include "stats.h"
+
 #include "debug.h"
 
 /*========================================================*/
 /* Private types.                                         */
 /*========================================================*/
 
+/*
+ * Columnar record store.  Keys are interned once and identified by a column
+ * index.  All values live in one contiguous arena, and each record is a row
+ * of value offsets indexed by column (offset+1, 0 if field is absent).
+ * A store is immutable once populated, and is then only accessed through
+ * the sealed view, which points either into its own arrays or into a
+ * mapped parse cache file.
+ */
+struct _glMergeStore {
+	gint               ref_count;
+
+	GPtrArray         *keys;       /* Interned keys, indexed by column    */
+	GHashTable        *key_index;  /* Key -> column+1                     */
+
+	GString           *values;     /* Arena of NUL-terminated values      */
+	GArray            *slots;      /* guint64 value offsets (+1) per slot */
+	GArray            *rows;       /* guint64 first slot of each record   */
+
+	GMappedFile       *cache_file; /* Parse cache backing the view        */
+
+	const gchar       *value_data; /* Sealed view                         */
+	const guint64     *slot_data;
+	const guint64     *row_data;
+	gsize              n_slots;
+	gsize              n_rows;
+	gsize              values_len;
+};
+
+/*
+ * Records are shared between duplicates of a merge object (copy-on-write).
+ * A record set is never modified while more than one merge references it.
+ * Record sets loaded from the parse cache also carry the key list and
+ * primary key of the backend, which has not seen the source.
+ */
+typedef struct {
+	gint               ref_count;
+	GList             *list;
+	glMergeStore      *store;
+
+	glMergeRecord     *record_block; /* Records of list, if one block   */
+	GList             *key_list;
+	gchar             *primary_key;
+} RecordSet;
+
+/*
+ * Parse cache file.  The header is followed by the value arena of the store
+ * (padded to a multiple of 8 bytes), the slots and rows arrays, and a block
+ * of NUL-terminated strings (cache key, primary key, column keys, backend
+ * key list), so that the store can be used in place.  This order lets the
+ * file be written in one pass while the source is parsed: only the header,
+ * which is patched last, depends on the whole source.  Files are named
+ * after a checksum of the cache key, which identifies the backend and the
+ * source (e.g. its path, size and modification time).
+ */
+#define CACHE_MAGIC       "GLMC0002"
+#define CACHE_BYTE_ORDER  0x01020304
+#define CACHE_SUFFIX      ".glmc"
+#define CACHE_ALIGN(len)  (((len) + 7) & ~(guint64)7)
+
+typedef struct {
+	gchar              magic[8];
+	guint32            byte_order;
+	guint32            n_columns;
+	guint32            n_key_list;
+	guint32            reserved;
+	guint64            strings_len;
+	guint64            n_rows;
+	guint64            n_slots;
+	guint64            values_len;
+} CacheHeader;
+
+/*
+ * Parse cache file being written.  Values go straight to the temporary
+ * cache file, slots and rows to temporary files of their own, which are
+ * appended to it once the source is exhausted.
+ */
+typedef struct {
+	gchar             *tmp_name;
+	gchar             *slots_name;
+	gchar             *rows_name;
+	FILE              *fp;
+	FILE              *slots_fp;
+	FILE              *rows_fp;
+
+	glMergeStore      *keys;       /* Key table only                      */
+	GArray            *slots;      /* Slots of current record             */
+
+	guint64            n_rows;
+	guint64            n_slots;
+	guint64            values_len;
+	gboolean           ok;
+} CacheWriter;
+
 struct _glMergePrivate {
 	gchar             *name;
 	gchar             *description;
 	gchar             *src;
 	glMergeSrcType     src_type;
 
-	GList             *record_list;
+	gboolean           stream_flag;
+	RecordSet         *records;
+};
+
+/*
+ * Cursor over the records of a merge.  For streaming merges, records are
+ * read one at a time from the backend of a private duplicate of the merge,
+ * so memory use does not depend on the size of the source.
+ */
+struct _glMergeCursor {
+	glMerge           *merge;
+
+	GList             *p_record;   /* Current record, materialised records */
+
+	gboolean           open_flag;
+	glMergeRecord     *record;     /* Current record, streaming merge      */
+
+	guint              i_row;      /* Current record, streaming from store */
+	glMergeRecord      row;
+
+	gint               range_start; /* Window of records visible through   */
+	gint               range_len;   /* cursor, range_len < 0 for no limit. */
+	gint               i_pos;       /* Current record, relative to window   */
 };
 
 enum {
@@ -63,7 +182,11 @@ typedef struct {
 /* Private globals.                                       */
 /*========================================================*/
 
-static GList *backends = NULL;
+static GList    *backends = NULL;
+
+static gboolean  default_stream_flag = FALSE;
+
+static gchar    *cache_dir = NULL;
 
 /*========================================================*/
 /* Private function prototypes.                           */
@@ -77,6 +200,11 @@ static void           merge_close            (glMerge              *merge);
 
 static glMergeRecord *merge_get_record       (glMerge              *merge);
 
+static gint           merge_get_record_count (glMerge              *merge);
+
+static gboolean       merge_seek_record      (glMerge              *merge,
+                                              gint                  i_record);
+
 static void           merge_free_record      (glMergeRecord       **record);
 
 static glMergeRecord *merge_dup_record       (const glMergeRecord  *record);
@@ -85,6 +213,71 @@ static void           merge_free_record_list (GList               **record_list)
 
 static GList         *merge_dup_record_list  (GList                *record_list);
 
+static RecordSet     *record_set_new         (GList                *record_list,
+                                              glMergeStore         *store);
+
+static RecordSet     *record_set_ref         (RecordSet            *records);
+
+static void           record_set_unref       (RecordSet            *records);
+
+static glMergeStore  *store_new              (void);
+
+static glMergeStore  *store_ref              (glMergeStore         *store);
+
+static void           store_unref            (glMergeStore         *store);
+
+static gint           store_intern_key       (glMergeStore         *store,
+                                              const gchar          *key);
+
+static glMergeRecord *store_add_record       (glMergeStore         *store,
+                                              const glMergeRecord  *record);
+
+static void           store_seal             (glMergeStore         *store);
+
+static const gchar   *store_peek_value       (const glMergeStore   *store,
+                                              guint                 i_record,
+                                              gint                  column);
+
+static gchar         *cache_get_filename     (const glMerge        *merge,
+                                              gchar               **key);
+
+static RecordSet     *cache_load             (const glMerge        *merge,
+                                              const gchar          *filename,
+                                              const gchar          *key);
+
+static gboolean       cache_check_store      (const glMergeStore   *store);
+
+static gboolean       cache_write            (glMerge              *merge,
+                                              const gchar          *filename,
+                                              const gchar          *key);
+
+static FILE          *cache_open_tmp         (const gchar          *filename,
+                                              gchar               **tmp_name);
+
+static gboolean       cache_append_tmp       (FILE                 *fp,
+                                              FILE                 *tmp_fp);
+
+static CacheWriter   *cache_writer_new       (const gchar          *filename);
+
+static void           cache_writer_add       (CacheWriter          *writer,
+                                              const glMergeRecord  *record);
+
+static gboolean       cache_writer_finish    (CacheWriter          *writer,
+                                              const gchar          *filename,
+                                              const gchar          *key,
+                                              const glMerge        *merge);
+
+static void           cursor_rewind_source   (glMergeCursor        *cursor);
+
+static glMergeRecord *cursor_peek_source     (glMergeCursor        *cursor);
+
+static void           cursor_seek_source     (glMergeCursor        *cursor,
+                                              gint                  i_record);
+
+static void           cursor_next_source     (glMergeCursor        *cursor);
+
+static gboolean       cursor_is_over_store   (const glMergeCursor  *cursor);
+
 
 
 
@@ -261,7 +454,7 @@ gl_merge_finalize (GObject *object)
 
 	g_return_if_fail (object && GL_IS_MERGE (object));
 
-	merge_free_record_list (&merge->priv->record_list);
+	record_set_unref (merge->priv->records);
 	g_free (merge->priv->name);
 	g_free (merge->priv->description);
 	g_free (merge->priv->src);
@@ -296,6 +489,7 @@ gl_merge_new (const gchar *name)
 			merge->priv->name        = g_strdup (name);
 			merge->priv->description = g_strdup (backend->description);
 			merge->priv->src_type    = backend->src_type;
+			merge->priv->stream_flag = default_stream_flag;
 
 			break;
 		}
@@ -332,8 +526,8 @@ gl_merge_dup (const glMerge *src_merge)
 	dst_merge->priv->description = g_strdup (src_merge->priv->description);
 	dst_merge->priv->src         = g_strdup (src_merge->priv->src);
 	dst_merge->priv->src_type    = src_merge->priv->src_type;
-	dst_merge->priv->record_list 
-		= merge_dup_record_list (src_merge->priv->record_list);
+	dst_merge->priv->stream_flag = src_merge->priv->stream_flag;
+	dst_merge->priv->records     = record_set_ref (src_merge->priv->records);
 
 	if ( GL_MERGE_GET_CLASS(src_merge)->copy != NULL ) {
 
@@ -347,6 +541,76 @@ gl_merge_dup (const glMerge *src_merge)
 	return dst_merge;
 }
 
+/*****************************************************************************/
+/* Set default stream flag for newly created merge objects.                  */
+/*****************************************************************************/
+void
+gl_merge_set_default_stream_flag (gboolean stream_flag)
+{
+	default_stream_flag = stream_flag;
+}
+
+/*****************************************************************************/
+/* Set directory of parse cache, NULL (the default) disables the cache.      */
+/*                                                                           */
+/* Parsed records of sources supported by the backend are saved there, and  */
+/* later loaded in place of parsing the source, as long as it is unchanged. */
+/*****************************************************************************/
+void
+gl_merge_set_cache_dir (const gchar *dir)
+{
+	g_free (cache_dir);
+	cache_dir = g_strdup (dir);
+}
+
+/*****************************************************************************/
+/* Get directory of parse cache, NULL if disabled.  Backends may keep their  */
+/* own per-source data (e.g. record indexes) there.                          */
+/*****************************************************************************/
+const gchar *
+gl_merge_get_cache_dir (void)
+{
+	return cache_dir;
+}
+
+/*****************************************************************************/
+/* Set stream flag of merge.                                                 */
+/*                                                                           */
+/* A streaming merge never reads its whole source into memory, records are   */
+/* only available one at a time through a glMergeCursor.  Must be set before */
+/* the src of the merge is set.  Standard input ("-") is the exception: it   */
+/* cannot be reopened, so it is always read in full.                         */
+/*****************************************************************************/
+void
+gl_merge_set_stream_flag (glMerge  *merge,
+			  gboolean  stream_flag)
+{
+	gl_debug (DEBUG_MERGE, "START");
+
+	g_return_if_fail (merge && GL_IS_MERGE (merge));
+
+	merge->priv->stream_flag = stream_flag;
+
+	gl_debug (DEBUG_MERGE, "END");
+}
+
+/*****************************************************************************/
+/* Get stream flag of merge.                                                 */
+/*****************************************************************************/
+gboolean
+gl_merge_get_stream_flag (const glMerge *merge)
+{
+	gl_debug (DEBUG_MERGE, "");
+
+	if (merge == NULL) {
+		return FALSE;
+	}
+
+	g_return_val_if_fail (GL_IS_MERGE (merge), FALSE);
+
+	return merge->priv->stream_flag;
+}
+
 /*****************************************************************************/
 /* Get name of merge.                                                        */
 /*****************************************************************************/
@@ -407,6 +671,10 @@ gl_merge_set_src (glMerge       *merge,
 {
 	GList         *record_list = NULL;
 	glMergeRecord *record;
+	glMergeStore  *store;
+	gchar         *cache_name, *cache_key = NULL;
+	CacheWriter   *writer;
+	glStatsTimer   timer;
 
 	gl_debug (DEBUG_MERGE, "START");
 
@@ -426,7 +694,8 @@ gl_merge_set_src (glMerge       *merge,
 			g_free (merge->priv->src);
 		}
 		merge->priv->src = NULL;
-		merge_free_record_list (&merge->priv->record_list);
+		record_set_unref (merge->priv->records);
+		merge->priv->records = NULL;
 
 	}
 	else
@@ -438,15 +707,89 @@ gl_merge_set_src (glMerge       *merge,
 		}
 		merge->priv->src = g_strdup (src);
 
-		merge_free_record_list (&merge->priv->record_list);
-			
+		record_set_unref (merge->priv->records);
+		merge->priv->records = NULL;
+
+		cache_name = cache_get_filename (merge, &cache_key);
+		if ( cache_name != NULL )
+		{
+			gl_stats_timer_start (&timer);
+			merge->priv->records = cache_load (merge, cache_name, cache_key);
+			gl_stats_add_phase (GL_STATS_PHASE_MERGE, &timer);
+			if ( merge->priv->records != NULL )
+			{
+				g_free (cache_name);
+				g_free (cache_key);
+				gl_debug (DEBUG_MERGE, "END (cached)");
+				return;
+			}
+		}
+		else if ( merge->priv->stream_flag && (strcmp (src, "-") != 0) )
+		{
+			/*
+			 * Records will be read on demand by cursors.  Standard
+			 * input cannot be reopened by each cursor, so it is
+			 * read once below and cursors walk the stored records.
+			 */
+			gl_debug (DEBUG_MERGE, "END (streaming)");
+			return;
+		}
+
+		if ( (cache_name != NULL) && merge->priv->stream_flag )
+		{
+			/*
+			 * Parse cache miss: parse the source straight into a
+			 * new cache file, one record at a time, and map it.  If
+			 * the cache cannot be written, records are read on
+			 * demand by cursors, as without a cache directory.
+			 */
+			if ( cache_write (merge, cache_name, cache_key) )
+			{
+				merge->priv->records = cache_load (merge, cache_name, cache_key);
+			}
+			g_free (cache_name);
+			g_free (cache_key);
+			gl_debug (DEBUG_MERGE, "END (streaming)");
+			return;
+		}
+
+		/*
+		 * Read whole source into a store, writing the parse cache as
+		 * records are read.  Backends that support it (e.g. large
+		 * text files) parse in parallel here.
+		 */
+		store  = store_new ();
+		writer = (cache_name != NULL) ? cache_writer_new (cache_name) : NULL;
+
 		merge_open (merge);
 		while ( (record = merge_get_record (merge)) != NULL )
 		{
-			record_list = g_list_append( record_list, record );
+			record_list = g_list_prepend( record_list,
+						      store_add_record (store, record) );
+			if ( writer != NULL )
+			{
+				cache_writer_add (writer, record);
+			}
+			merge_free_record (&record);
 		}
 		merge_close (merge);
-		merge->priv->record_list = record_list;
+		store_seal (store);
+		merge->priv->records = record_set_new (g_list_reverse (record_list), store);
+		store_unref (store);
+
+		if ( cache_name != NULL )
+		{
+			merge->priv->records->key_list    = gl_merge_get_key_list (merge);
+			merge->priv->records->primary_key = gl_merge_get_primary_key (merge);
+
+			if ( writer != NULL )
+			{
+				cache_writer_finish (writer, cache_name, cache_key, merge);
+			}
+
+			g_free (cache_name);
+			g_free (cache_key);
+		}
 
 	}
 		     
@@ -478,6 +821,7 @@ GList *
 gl_merge_get_key_list (const glMerge *merge)
 {
 	GList *key_list = NULL;
+	GList *p;
 
 	gl_debug (DEBUG_MERGE, "START");
 
@@ -487,7 +831,14 @@ gl_merge_get_key_list (const glMerge *merge)
 
 	g_return_val_if_fail (GL_IS_MERGE (merge), NULL);
 
-	if ( GL_MERGE_GET_CLASS(merge)->get_key_list != NULL ) {
+	if ( (merge->priv->records != NULL) && (merge->priv->records->key_list != NULL) ) {
+
+		for ( p = merge->priv->records->key_list; p != NULL; p = p->next ) {
+			key_list = g_list_prepend (key_list, g_strdup (p->data));
+		}
+		key_list = g_list_reverse (key_list);
+
+	} else if ( GL_MERGE_GET_CLASS(merge)->get_key_list != NULL ) {
 
 		key_list = GL_MERGE_GET_CLASS(merge)->get_key_list (merge);
 
@@ -535,7 +886,11 @@ gl_merge_get_primary_key (const glMerge *merge)
 
 	g_return_val_if_fail (GL_IS_MERGE (merge), NULL);
 
-	if ( GL_MERGE_GET_CLASS(merge)->get_primary_key != NULL ) {
+	if ( (merge->priv->records != NULL) && (merge->priv->records->primary_key != NULL) ) {
+
+		key = g_strdup (merge->priv->records->primary_key);
+
+	} else if ( GL_MERGE_GET_CLASS(merge)->get_primary_key != NULL ) {
 
 		key = GL_MERGE_GET_CLASS(merge)->get_primary_key (merge);
 
@@ -591,6 +946,7 @@ static glMergeRecord *
 merge_get_record (glMerge *merge)
 {
 	glMergeRecord *record = NULL;
+	glStatsTimer   timer;
 
 	gl_debug (DEBUG_MERGE, "START");
 
@@ -598,7 +954,9 @@ merge_get_record (glMerge *merge)
 
 	if ( GL_MERGE_GET_CLASS(merge)->get_record != NULL ) {
 
+		gl_stats_timer_start (&timer);
 		record = GL_MERGE_GET_CLASS(merge)->get_record (merge);
+		gl_stats_add_phase (GL_STATS_PHASE_MERGE, &timer);
 
 	}
 
@@ -607,6 +965,54 @@ merge_get_record (glMerge *merge)
 	return record;
 }
 
+/*****************************************************************************/
+/* Free a merge record obtained from a backend.                              */
+/*****************************************************************************/
+void
+gl_merge_free_record (glMergeRecord **record)
+{
+	merge_free_record (record);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Get number of records in opened merge source, -1 if not known.            */
+/*---------------------------------------------------------------------------*/
+static gint
+merge_get_record_count (glMerge *merge)
+{
+	gint n = -1;
+
+	g_return_val_if_fail (merge && GL_IS_MERGE (merge), -1);
+
+	if ( GL_MERGE_GET_CLASS(merge)->get_record_count != NULL ) {
+
+		n = GL_MERGE_GET_CLASS(merge)->get_record_count (merge);
+
+	}
+
+	return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Position opened merge source so next record read is i_record.             */
+/*---------------------------------------------------------------------------*/
+static gboolean
+merge_seek_record (glMerge *merge,
+		   gint     i_record)
+{
+	gboolean ret = FALSE;
+
+	g_return_val_if_fail (merge && GL_IS_MERGE (merge), FALSE);
+
+	if ( GL_MERGE_GET_CLASS(merge)->seek_record != NULL ) {
+
+		ret = GL_MERGE_GET_CLASS(merge)->seek_record (merge, i_record);
+
+	}
+
+	return ret;
+}
+
 /*---------------------------------------------------------------------------*/
 /* Free a merge record (list of fields)                                      */
 /*---------------------------------------------------------------------------*/
@@ -653,6 +1059,8 @@ merge_dup_record (const glMergeRecord *record)
 
 	dest_record = g_new0 (glMergeRecord, 1);
 	dest_record->select_flag = record->select_flag;
+	dest_record->store       = record->store;
+	dest_record->i_record    = record->i_record;
 
 	for (p = record->field_list; p != NULL; p = p->next) {
 		field = (glMergeField *) p->data;
@@ -682,17 +1090,34 @@ gl_merge_eval_key (const glMergeRecord *record,
 {
 	GList        *p;
 	glMergeField *field;
+	gpointer      column;
 	gchar        *val = NULL;
 
 	gl_debug (DEBUG_MERGE, "START");
 
 	if ( (record != NULL) && (key != NULL) ) {
-		for (p = record->field_list; p != NULL; p = p->next) {
-			field = (glMergeField *) p->data;
 
-			if (strcmp (key, field->key) == 0) {
-				val = g_strdup (field->value);
+		if ( record->store != NULL ) {
+
+			column = g_hash_table_lookup (record->store->key_index, key);
+			if ( column != NULL ) {
+				val = g_strdup (store_peek_value (record->store,
+								  record->i_record,
+								  GPOINTER_TO_INT (column) - 1));
+			}
+
+		} else {
+
+			/* Last matching field wins. */
+			for (p = record->field_list; p != NULL; p = p->next) {
+				field = (glMergeField *) p->data;
+
+				if (strcmp (key, field->key) == 0) {
+					val = field->value;
+				}
+
 			}
+			val = g_strdup (val);
 
 		}
 	}
@@ -702,6 +1127,93 @@ gl_merge_eval_key (const glMergeRecord *record,
 	return val;
 }
 
+/*****************************************************************************/
+/* Get columnar store of merge's records, NULL if records are streamed.      */
+/*****************************************************************************/
+const glMergeStore *
+gl_merge_get_store (const glMerge *merge)
+{
+	if ( (merge == NULL) || (merge->priv->records == NULL) ) {
+		return NULL;
+	}
+
+	return merge->priv->records->store;
+}
+
+/*****************************************************************************/
+/* Resolve key to a column index, -1 if not a known key.                     */
+/*                                                                           */
+/* Column indices are those of gl_merge_get_store(), and are stable for the  */
+/* lifetime of the merge's current src, so callers can resolve keys once per */
+/* job and use gl_merge_eval_column() for records of that store.             */
+/*****************************************************************************/
+gint
+gl_merge_get_key_column (const glMerge *merge,
+                         const gchar   *key)
+{
+	gpointer column;
+
+	if ( (merge == NULL) || (merge->priv->records == NULL) || (key == NULL) ) {
+		return -1;
+	}
+
+	column = g_hash_table_lookup (merge->priv->records->store->key_index, key);
+
+	return GPOINTER_TO_INT (column) - 1;
+}
+
+/*****************************************************************************/
+/* Evaluate field of record by column index.                                 */
+/*****************************************************************************/
+gchar *
+gl_merge_eval_column (const glMergeRecord *record,
+                      gint                 column)
+{
+	if ( (record == NULL) || (record->store == NULL) ||
+	     (column < 0) || (column >= (gint)record->store->keys->len) ) {
+		return NULL;
+	}
+
+	return g_strdup (store_peek_value (record->store, record->i_record, column));
+}
+
+/*****************************************************************************/
+/* Call func for each field (key/value pair) of record.                      */
+/*****************************************************************************/
+void
+gl_merge_record_foreach_field (const glMergeRecord *record,
+                               glMergeFieldFunc     func,
+                               gpointer             user_data)
+{
+	GList        *p;
+	glMergeField *field;
+	gint          column, n_columns;
+	const gchar  *value;
+
+	g_return_if_fail (record != NULL);
+
+	if ( record->store != NULL ) {
+
+		n_columns = record->store->keys->len;
+		for ( column = 0; column < n_columns; column++ ) {
+			value = store_peek_value (record->store, record->i_record, column);
+			if ( value != NULL ) {
+				func (g_ptr_array_index (record->store->keys, column),
+				      value, user_data);
+			}
+		}
+
+	} else {
+
+		for (p = record->field_list; p != NULL; p = p->next) {
+			field = (glMergeField *) p->data;
+
+			func (field->key, field->value, user_data);
+		}
+
+	}
+}
+
 /*****************************************************************************/
 /* Read all records from merge source.                                       */
 /*****************************************************************************/
@@ -710,13 +1222,48 @@ gl_merge_get_record_list (const glMerge *merge)
 {
 	gl_debug (DEBUG_MERGE, "");
 	      
-	if ( merge != NULL ) {
-		return merge->priv->record_list;
+	if ( (merge != NULL) && (merge->priv->records != NULL) ) {
+		return merge->priv->records->list;
 	} else {
 		return NULL;
 	}
 }
 
+/*****************************************************************************/
+/* Get records for modification (e.g. changing select flags).                */
+/*                                                                           */
+/* If the records are currently shared with other merge objects, they are    */
+/* first copied, so that changes are only seen through this merge object.    */
+/*****************************************************************************/
+GList *
+gl_merge_get_mutable_record_list (glMerge *merge)
+{
+	RecordSet *records;
+
+	gl_debug (DEBUG_MERGE, "START");
+
+	if ( (merge == NULL) || (merge->priv->records == NULL) ) {
+		gl_debug (DEBUG_MERGE, "END (NULL)");
+		return NULL;
+	}
+
+	if ( g_atomic_int_get (&merge->priv->records->ref_count) > 1 ) {
+		/* Field values are immutable, so the store itself stays shared. */
+		records = record_set_new (merge_dup_record_list (merge->priv->records->list),
+					  merge->priv->records->store);
+		if ( merge->priv->records->key_list != NULL ) {
+			records->key_list = gl_merge_get_key_list (merge);
+		}
+		records->primary_key = g_strdup (merge->priv->records->primary_key);
+		record_set_unref (merge->priv->records);
+		merge->priv->records = records;
+	}
+
+	gl_debug (DEBUG_MERGE, "END");
+
+	return merge->priv->records->list;
+}
+
 /*---------------------------------------------------------------------------*/
 /* Free a list of records.                                                   */
 /*---------------------------------------------------------------------------*/
@@ -756,8 +1303,9 @@ merge_dup_record_list (GList *record_list)
 		record = (glMergeRecord *) p->data;
 
 		dest_record = merge_dup_record( record );
-		dest_list = g_list_append (dest_list, dest_record);
+		dest_list = g_list_prepend (dest_list, dest_record);
 	}
+	dest_list = g_list_reverse (dest_list);
 
 
 	gl_debug (DEBUG_MERGE, "END");
@@ -765,30 +1313,1044 @@ merge_dup_record_list (GList *record_list)
 	return dest_list;
 }
 
-/*****************************************************************************/
-/* Count selected records.                                                   */
-/*****************************************************************************/
-gint
-gl_merge_get_record_count (const glMerge *merge)
+/*---------------------------------------------------------------------------*/
+/* New shared record set, takes ownership of list.                           */
+/*---------------------------------------------------------------------------*/
+static RecordSet *
+record_set_new (GList        *record_list,
+		glMergeStore *store)
 {
-	GList *p;
-	glMergeRecord *record;
-	gint count;
+	RecordSet *records;
 
-	gl_debug (DEBUG_MERGE, "START");
+	records = g_new0 (RecordSet, 1);
+	records->ref_count = 1;
+	records->list      = record_list;
+	records->store     = store_ref (store);
 
-	count = 0;
-	for ( p=merge->priv->record_list; p!=NULL; p=p->next ) {
-		record = (glMergeRecord *)p->data;
+	return records;
+}
 
-		if ( record->select_flag ) count ++;
+/*---------------------------------------------------------------------------*/
+/* Add reference to shared record set.                                       */
+/*---------------------------------------------------------------------------*/
+static RecordSet *
+record_set_ref (RecordSet *records)
+{
+	if ( records != NULL ) {
+		g_atomic_int_inc (&records->ref_count);
 	}
 
-	gl_debug (DEBUG_MERGE, "END");
+	return records;
+}
 
-	return count;
+/*---------------------------------------------------------------------------*/
+/* Drop reference to shared record set, freeing records with last reference. */
+/*---------------------------------------------------------------------------*/
+static void
+record_set_unref (RecordSet *records)
+{
+	if ( records == NULL ) {
+		return;
+	}
+
+	if ( g_atomic_int_dec_and_test (&records->ref_count) ) {
+		if ( records->record_block != NULL ) {
+			g_list_free (records->list);
+			g_free (records->record_block);
+		} else {
+			merge_free_record_list (&records->list);
+		}
+		store_unref (records->store);
+		gl_merge_free_key_list (&records->key_list);
+		g_free (records->primary_key);
+		g_free (records);
+	}
 }
 
+/*---------------------------------------------------------------------------*/
+/* New empty record store.                                                   */
+/*---------------------------------------------------------------------------*/
+static glMergeStore *
+store_new (void)
+{
+	glMergeStore *store;
+
+	store = g_new0 (glMergeStore, 1);
+	store->ref_count = 1;
+
+	store->keys      = g_ptr_array_new_with_free_func (g_free);
+	store->key_index = g_hash_table_new (g_str_hash, g_str_equal);
+	store->values    = g_string_new ("");
+	store->slots     = g_array_new (FALSE, TRUE, sizeof (guint64));
+	store->rows      = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+	return store;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Add reference to record store.                                            */
+/*---------------------------------------------------------------------------*/
+static glMergeStore *
+store_ref (glMergeStore *store)
+{
+	if ( store != NULL ) {
+		g_atomic_int_inc (&store->ref_count);
+	}
+
+	return store;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Drop reference to record store.                                           */
+/*---------------------------------------------------------------------------*/
+static void
+store_unref (glMergeStore *store)
+{
+	if ( store == NULL ) {
+		return;
+	}
+
+	if ( g_atomic_int_dec_and_test (&store->ref_count) ) {
+		g_hash_table_destroy (store->key_index);
+		g_ptr_array_free (store->keys, TRUE);
+		if ( store->cache_file != NULL ) {
+			g_mapped_file_unref (store->cache_file);
+		} else {
+			g_string_free (store->values, TRUE);
+			g_array_free (store->slots, TRUE);
+			g_array_free (store->rows, TRUE);
+		}
+		g_free (store);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* Lookup column of key, adding it to the key table if new.                  */
+/*---------------------------------------------------------------------------*/
+static gint
+store_intern_key (glMergeStore *store,
+		  const gchar  *key)
+{
+	gpointer  column;
+	gchar    *interned_key;
+
+	column = g_hash_table_lookup (store->key_index, key);
+	if ( column == NULL ) {
+		interned_key = g_strdup (key);
+		g_ptr_array_add (store->keys, interned_key);
+		column = GINT_TO_POINTER (store->keys->len);
+		g_hash_table_insert (store->key_index, interned_key, column);
+	}
+
+	return GPOINTER_TO_INT (column) - 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Append fields of backend record to store, returns new stored record.      */
+/*---------------------------------------------------------------------------*/
+static glMergeRecord *
+store_add_record (glMergeStore        *store,
+		  const glMergeRecord *record)
+{
+	glMergeRecord *stored_record;
+	GList         *p;
+	glMergeField  *field;
+	guint64        first_slot, offset;
+	gint           column;
+
+	first_slot = store->slots->len;
+	g_array_append_val (store->rows, first_slot);
+
+	for (p = record->field_list; p != NULL; p = p->next) {
+		field = (glMergeField *) p->data;
+
+		column = store_intern_key (store, field->key);
+		if ( first_slot + column >= store->slots->len ) {
+			g_array_set_size (store->slots, first_slot + column + 1);
+		}
+
+		if ( field->value != NULL ) {
+			offset = store->values->len + 1;
+			g_string_append_len (store->values, field->value, strlen (field->value) + 1);
+		} else {
+			offset = 0;
+		}
+		g_array_index (store->slots, guint64, first_slot + column) = offset;
+	}
+
+	stored_record = g_new0 (glMergeRecord, 1);
+	stored_record->select_flag = record->select_flag;
+	stored_record->store       = store;
+	stored_record->i_record    = store->rows->len - 1;
+
+	return stored_record;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Seal populated store, setting up view of its arrays.                      */
+/*---------------------------------------------------------------------------*/
+static void
+store_seal (glMergeStore *store)
+{
+	store->value_data = store->values->str;
+	store->slot_data  = (const guint64 *)store->slots->data;
+	store->row_data   = (const guint64 *)store->rows->data;
+	store->n_slots    = store->slots->len;
+	store->n_rows     = store->rows->len;
+	store->values_len = store->values->len;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Lookup value of field in stored record, NULL if record has no such field. */
+/*                                                                           */
+/* Rows and slots mapped from a parse cache file are not checked when the    */
+/* file is loaded, so out of range entries are treated as absent fields.     */
+/*---------------------------------------------------------------------------*/
+static const gchar *
+store_peek_value (const glMergeStore *store,
+		  guint               i_record,
+		  gint                column)
+{
+	guint64 first_slot, end_slot, offset;
+
+	first_slot = store->row_data[i_record];
+	if ( i_record + 1 < store->n_rows ) {
+		end_slot = store->row_data[i_record + 1];
+	} else {
+		end_slot = store->n_slots;
+	}
+
+	if ( (column < 0) || (end_slot > store->n_slots) || (first_slot > end_slot) ||
+	     (column >= end_slot - first_slot) )
+	{
+		return NULL;
+	}
+
+	/* Slots hold value offset + 1, 0 for no value. */
+	offset = store->slot_data[first_slot + column];
+	if ( (offset == 0) || (offset > store->values_len) ) {
+		return NULL;
+	}
+
+	return store->value_data + offset - 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Get parse cache filename and cache key for current src of merge, or NULL  */
+/* if the cache is disabled or the backend cannot identify the src.          */
+/*---------------------------------------------------------------------------*/
+static gchar *
+cache_get_filename (const glMerge  *merge,
+		    gchar         **key)
+{
+	gchar *src_key, *checksum, *basename, *filename;
+
+	if ( (cache_dir == NULL) || (GL_MERGE_GET_CLASS(merge)->get_cache_key == NULL) ) {
+		return NULL;
+	}
+
+	src_key = GL_MERGE_GET_CLASS(merge)->get_cache_key (merge);
+	if ( src_key == NULL ) {
+		return NULL;
+	}
+
+	*key     = g_strdup_printf ("%s\n%s", merge->priv->name, src_key);
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, *key, -1);
+	basename = g_strconcat (checksum, CACHE_SUFFIX, NULL);
+	filename = g_build_filename (cache_dir, basename, NULL);
+
+	g_free (src_key);
+	g_free (checksum);
+	g_free (basename);
+
+	return filename;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Get next NUL-terminated string of cache string block, NULL if none.       */
+/*---------------------------------------------------------------------------*/
+static const gchar *
+cache_next_string (const gchar **p,
+		   const gchar  *end)
+{
+	const gchar *s = *p;
+	const gchar *nul;
+
+	if ( (s >= end) || ((nul = memchr (s, '\0', end - s)) == NULL) ) {
+		return NULL;
+	}
+	*p = nul + 1;
+
+	return s;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Map parse cache file, returns NULL if missing or not valid for key.       */
+/*                                                                           */
+/* The store of the returned record set is used in place.  Streaming merges  */
+/* only need the store, other merges also get a list of records.             */
+/*---------------------------------------------------------------------------*/
+static RecordSet *
+cache_load (const glMerge *merge,
+	    const gchar   *filename,
+	    const gchar   *key)
+{
+	GMappedFile       *file;
+	const gchar       *data, *p, *end, *s;
+	gsize              len, values_pos, slots_pos, rows_pos, strings_pos;
+	const CacheHeader *header;
+	glMergeStore      *store;
+	RecordSet         *records;
+	guint              i;
+	guint64            i_row;
+	glMergeRecord     *record;
+
+	gl_debug (DEBUG_MERGE, "START");
+
+	file = g_mapped_file_new (filename, FALSE, NULL);
+	if ( file == NULL ) {
+		gl_debug (DEBUG_MERGE, "END (no cache)");
+		return NULL;
+	}
+
+	data   = g_mapped_file_get_contents (file);
+	len    = g_mapped_file_get_length (file);
+	header = (const CacheHeader *)data;
+
+	if ( (len < sizeof (CacheHeader)) ||
+	     (memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) != 0) ||
+	     (header->byte_order != CACHE_BYTE_ORDER) ||
+	     (header->strings_len > len) ||
+	     (header->n_rows > len / sizeof (guint64)) ||
+	     (header->n_slots > len / sizeof (guint64)) ||
+	     (header->values_len > len) )
+	{
+		g_mapped_file_unref (file);
+		gl_debug (DEBUG_MERGE, "END (invalid cache)");
+		return NULL;
+	}
+
+	values_pos  = sizeof (CacheHeader);
+	slots_pos   = values_pos + CACHE_ALIGN (header->values_len);
+	rows_pos    = slots_pos  + header->n_slots * sizeof (guint64);
+	strings_pos = rows_pos   + header->n_rows  * sizeof (guint64);
+
+	p   = data + strings_pos;
+	end = data + len;
+
+	if ( (strings_pos + header->strings_len != len) ||
+	     ((s = cache_next_string (&p, end)) == NULL) ||
+	     (strcmp (s, key) != 0) ||
+	     ((s = cache_next_string (&p, end)) == NULL) )
+	{
+		g_mapped_file_unref (file);
+		gl_debug (DEBUG_MERGE, "END (stale cache)");
+		return NULL;
+	}
+
+	records = g_new0 (RecordSet, 1);
+	records->ref_count   = 1;
+	records->primary_key = (*s != '\0') ? g_strdup (s) : NULL;
+
+	store = g_new0 (glMergeStore, 1);
+	store->ref_count  = 1;
+	store->keys       = g_ptr_array_new_with_free_func (g_free);
+	store->key_index  = g_hash_table_new (g_str_hash, g_str_equal);
+	store->cache_file = file;
+	store->value_data = data + values_pos;
+	store->slot_data  = (const guint64 *)(data + slots_pos);
+	store->row_data   = (const guint64 *)(data + rows_pos);
+	store->n_slots    = header->n_slots;
+	store->n_rows     = header->n_rows;
+	store->values_len = header->values_len;
+	records->store    = store;
+
+	if ( !cache_check_store (store) ) {
+		record_set_unref (records);
+		gl_debug (DEBUG_MERGE, "END (invalid cache)");
+		return NULL;
+	}
+
+	for ( i = 0; i < header->n_columns; i++ ) {
+		if ( ((s = cache_next_string (&p, end)) == NULL) ||
+		     (store_intern_key (store, s) != (gint)i) )
+		{
+			record_set_unref (records);
+			gl_debug (DEBUG_MERGE, "END (invalid cache)");
+			return NULL;
+		}
+	}
+	for ( i = 0; i < header->n_key_list; i++ ) {
+		if ( (s = cache_next_string (&p, end)) == NULL ) {
+			record_set_unref (records);
+			gl_debug (DEBUG_MERGE, "END (invalid cache)");
+			return NULL;
+		}
+		records->key_list = g_list_prepend (records->key_list, g_strdup (s));
+	}
+	records->key_list = g_list_reverse (records->key_list);
+
+	if ( !merge->priv->stream_flag && (store->n_rows > 0) ) {
+		/* One block of records, rather than one allocation per record. */
+		records->record_block = g_new0 (glMergeRecord, store->n_rows);
+		for ( i_row = store->n_rows; i_row > 0; i_row-- ) {
+			record = &records->record_block[i_row - 1];
+			record->select_flag = TRUE;
+			record->store       = store;
+			record->i_record    = i_row - 1;
+			records->list = g_list_prepend (records->list, record);
+		}
+	}
+
+	gl_debug (DEBUG_MERGE, "END");
+
+	return records;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Check store mapped from a parse cache file.  Only the value arena is      */
+/* checked, for a final NUL, so that every value offset within it yields a   */
+/* terminated string; store_peek_value() checks rows and slots as it reads.  */
+/*---------------------------------------------------------------------------*/
+static gboolean
+cache_check_store (const glMergeStore *store)
+{
+	if ( (store->values_len > 0) && (store->value_data[store->values_len - 1] != '\0') ) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Parse whole source of merge into parse cache file, without keeping its    */
+/* records.  Returns FALSE if the file could not be written.                 */
+/*---------------------------------------------------------------------------*/
+static gboolean
+cache_write (glMerge     *merge,
+	     const gchar *filename,
+	     const gchar *key)
+{
+	CacheWriter   *writer;
+	glMergeRecord *record;
+
+	writer = cache_writer_new (filename);
+	if ( writer == NULL ) {
+		return FALSE;
+	}
+
+	merge_open (merge);
+	while ( writer->ok && ((record = merge_get_record (merge)) != NULL) )
+	{
+		cache_writer_add (writer, record);
+		merge_free_record (&record);
+	}
+	merge_close (merge);
+
+	return cache_writer_finish (writer, filename, key, merge);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Create temporary file next to filename, so that it can be renamed to it.  */
+/*---------------------------------------------------------------------------*/
+static FILE *
+cache_open_tmp (const gchar  *filename,
+		gchar       **tmp_name)
+{
+	gchar *dirname;
+	gint   fd;
+	FILE  *fp;
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	*tmp_name = g_strconcat (filename, ".XXXXXX", NULL);
+
+	fd = g_mkstemp (*tmp_name);
+	if ( (fd < 0) || !g_close (fd, NULL) ) {
+		g_free (*tmp_name);
+		*tmp_name = NULL;
+		return NULL;
+	}
+
+	fp = g_fopen (*tmp_name, "w+b");
+	if ( fp == NULL ) {
+		g_unlink (*tmp_name);
+		g_free (*tmp_name);
+		*tmp_name = NULL;
+	}
+
+	return fp;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Start writing parse cache file, NULL if no temporary file can be created. */
+/*---------------------------------------------------------------------------*/
+static CacheWriter *
+cache_writer_new (const gchar *filename)
+{
+	CacheWriter *writer;
+	CacheHeader  header;
+
+	writer = g_new0 (CacheWriter, 1);
+	writer->ok = TRUE;
+
+	writer->fp       = cache_open_tmp (filename, &writer->tmp_name);
+	writer->slots_fp = cache_open_tmp (filename, &writer->slots_name);
+	writer->rows_fp  = cache_open_tmp (filename, &writer->rows_name);
+
+	if ( (writer->fp == NULL) || (writer->slots_fp == NULL) || (writer->rows_fp == NULL) ) {
+		writer->ok = FALSE;
+		cache_writer_finish (writer, filename, NULL, NULL);
+		return NULL;
+	}
+
+	/* Placeholder, until the source is exhausted. */
+	memset (&header, 0, sizeof (header));
+	writer->ok = (fwrite (&header, 1, sizeof (header), writer->fp) == sizeof (header));
+
+	writer->keys  = store_new ();
+	writer->slots = g_array_new (FALSE, TRUE, sizeof (guint64));
+
+	return writer;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Append fields of backend record to parse cache file being written.        */
+/*---------------------------------------------------------------------------*/
+static void
+cache_writer_add (CacheWriter         *writer,
+		  const glMergeRecord *record)
+{
+	GList        *p;
+	glMergeField *field;
+	gint          column;
+	gsize         len;
+	guint64       offset;
+
+	if ( !writer->ok ) {
+		return;
+	}
+
+	g_array_set_size (writer->slots, 0);
+
+	for (p = record->field_list; p != NULL; p = p->next) {
+		field = (glMergeField *) p->data;
+
+		column = store_intern_key (writer->keys, field->key);
+		if ( (guint)column >= writer->slots->len ) {
+			g_array_set_size (writer->slots, column + 1);
+		}
+
+		if ( field->value != NULL ) {
+			len    = strlen (field->value) + 1;
+			offset = writer->values_len + 1;
+			writer->ok = writer->ok && (fwrite (field->value, 1, len, writer->fp) == len);
+			writer->values_len += len;
+		} else {
+			offset = 0;
+		}
+		g_array_index (writer->slots, guint64, column) = offset;
+	}
+
+	writer->ok = writer->ok &&
+		(fwrite (&writer->n_slots, sizeof (guint64), 1, writer->rows_fp) == 1) &&
+		(fwrite (writer->slots->data, sizeof (guint64), writer->slots->len, writer->slots_fp) == writer->slots->len);
+
+	writer->n_slots += writer->slots->len;
+	writer->n_rows++;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Append contents of temporary file to parse cache file, in blocks.         */
+/*---------------------------------------------------------------------------*/
+static gboolean
+cache_append_tmp (FILE *fp,
+		  FILE *tmp_fp)
+{
+	gchar  buf[64*1024];
+	gsize  n;
+
+	if ( (fflush (tmp_fp) != 0) || (fseek (tmp_fp, 0, SEEK_SET) != 0) ) {
+		return FALSE;
+	}
+
+	while ( (n = fread (buf, 1, sizeof (buf), tmp_fp)) > 0 ) {
+		if ( fwrite (buf, 1, n, fp) != n ) {
+			return FALSE;
+		}
+	}
+
+	return !ferror (tmp_fp);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Finish parse cache file: append slots, rows and strings, patch header and */
+/* move file into place.  Frees writer.  Failure is not an error, the source */
+/* is simply parsed again next time.                                         */
+/*---------------------------------------------------------------------------*/
+static gboolean
+cache_writer_finish (CacheWriter   *writer,
+		     const gchar   *filename,
+		     const gchar   *key,
+		     const glMerge *merge)
+{
+	GString     *strings;
+	CacheHeader  header;
+	GList       *key_list, *p;
+	gchar       *primary_key;
+	guint        i;
+	gboolean     ok = writer->ok;
+
+	gl_debug (DEBUG_MERGE, "START");
+
+	if ( ok ) {
+		strings = g_string_new (NULL);
+		g_string_append_len (strings, key, strlen (key) + 1);
+		primary_key = gl_merge_get_primary_key (merge);
+		if ( primary_key != NULL ) {
+			g_string_append (strings, primary_key);
+		}
+		g_string_append_c (strings, '\0');
+		for ( i = 0; i < writer->keys->keys->len; i++ ) {
+			g_string_append (strings, g_ptr_array_index (writer->keys->keys, i));
+			g_string_append_c (strings, '\0');
+		}
+		key_list = gl_merge_get_key_list (merge);
+		for ( p = key_list; p != NULL; p = p->next ) {
+			g_string_append (strings, p->data);
+			g_string_append_c (strings, '\0');
+		}
+
+		memset (&header, 0, sizeof (header));
+		memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+		header.byte_order  = CACHE_BYTE_ORDER;
+		header.n_columns   = writer->keys->keys->len;
+		header.n_key_list  = g_list_length (key_list);
+		header.strings_len = strings->len;
+		header.n_rows      = writer->n_rows;
+		header.n_slots     = writer->n_slots;
+		header.values_len  = writer->values_len;
+
+		for ( i = 0; i < CACHE_ALIGN (writer->values_len) - writer->values_len; i++ ) {
+			ok = ok && (fputc ('\0', writer->fp) != EOF);
+		}
+		ok = ok && cache_append_tmp (writer->fp, writer->slots_fp);
+		ok = ok && cache_append_tmp (writer->fp, writer->rows_fp);
+		ok = ok && (fwrite (strings->str, 1, strings->len, writer->fp) == strings->len);
+		ok = ok && (fseek (writer->fp, 0, SEEK_SET) == 0);
+		ok = ok && (fwrite (&header, 1, sizeof (header), writer->fp) == sizeof (header));
+
+		g_string_free (strings, TRUE);
+		gl_merge_free_key_list (&key_list);
+		g_free (primary_key);
+	}
+
+	if ( writer->fp != NULL ) {
+		ok = (fclose (writer->fp) == 0) && ok;
+	}
+	if ( writer->slots_fp != NULL ) {
+		fclose (writer->slots_fp);
+		g_unlink (writer->slots_name);
+	}
+	if ( writer->rows_fp != NULL ) {
+		fclose (writer->rows_fp);
+		g_unlink (writer->rows_name);
+	}
+
+	ok = ok && (g_rename (writer->tmp_name, filename) == 0);
+	if ( !ok ) {
+		g_message ("Cannot write merge cache %s", filename);
+		if ( writer->tmp_name != NULL ) {
+			g_unlink (writer->tmp_name);
+		}
+	}
+
+	store_unref (writer->keys);
+	if ( writer->slots != NULL ) {
+		g_array_free (writer->slots, TRUE);
+	}
+	g_free (writer->tmp_name);
+	g_free (writer->slots_name);
+	g_free (writer->rows_name);
+	g_free (writer);
+
+	gl_debug (DEBUG_MERGE, "END");
+
+	return ok;
+}
+
+/*****************************************************************************/
+/* Count selected records.                                                   */
+/*****************************************************************************/
+gint
+gl_merge_get_record_count (const glMerge *merge)
+{
+	GList               *p;
+	const glMergeRecord *record;
+	glMergeCursor       *cursor;
+	gint                 count;
+
+	gl_debug (DEBUG_MERGE, "START");
+
+	count = 0;
+
+	if ( merge->priv->stream_flag && (merge->priv->records != NULL) ) {
+
+		/* Streaming from parse cache, all records are selected. */
+		count = merge->priv->records->store->n_rows;
+
+	} else if ( merge->priv->stream_flag ) {
+
+		cursor = gl_merge_cursor_new (merge);
+
+		/* Streamed records are always selected, so ask backend if it knows. */
+		count = cursor->open_flag ? merge_get_record_count (cursor->merge) : 0;
+		if ( count < 0 ) {
+
+			/* Single pass over source, holding one record at a time. */
+			count = 0;
+			for ( ; (record = gl_merge_cursor_peek (cursor)) != NULL;
+			      gl_merge_cursor_next (cursor) ) {
+
+				if ( record->select_flag ) count ++;
+			}
+
+		}
+		gl_merge_cursor_free (cursor);
+
+	} else {
+
+		for ( p=(GList *)gl_merge_get_record_list (merge); p!=NULL; p=p->next ) {
+			record = (glMergeRecord *)p->data;
+
+			if ( record->select_flag ) count ++;
+		}
+
+	}
+
+	gl_debug (DEBUG_MERGE, "END");
+
+	return count;
+}
+
+/*****************************************************************************/
+/* New cursor, positioned at first record of merge.                          */
+/*****************************************************************************/
+glMergeCursor *
+gl_merge_cursor_new (const glMerge *merge)
+{
+	glMergeCursor *cursor;
+
+	gl_debug (DEBUG_MERGE, "START");
+
+	g_return_val_if_fail (merge && GL_IS_MERGE (merge), NULL);
+
+	cursor = g_new0 (glMergeCursor, 1);
+	cursor->merge     = gl_merge_dup (merge);
+	cursor->range_len = -1;
+
+	gl_merge_cursor_rewind (cursor);
+
+	gl_debug (DEBUG_MERGE, "END");
+
+	return cursor;
+}
+
+/*****************************************************************************/
+/* Free cursor.                                                              */
+/*****************************************************************************/
+void
+gl_merge_cursor_free (glMergeCursor *cursor)
+{
+	gl_debug (DEBUG_MERGE, "START");
+
+	if ( cursor == NULL ) {
+		gl_debug (DEBUG_MERGE, "END (NULL)");
+		return;
+	}
+
+	if ( cursor->record != NULL ) {
+		merge_free_record (&cursor->record);
+	}
+	if ( cursor->open_flag ) {
+		merge_close (cursor->merge);
+	}
+	g_object_unref (cursor->merge);
+	g_free (cursor);
+
+	gl_debug (DEBUG_MERGE, "END");
+}
+
+/*****************************************************************************/
+/* Restrict cursor to window of n_records records starting at first_record  */
+/* (zero based, counting unselected records), n_records < 0 for all         */
+/* records from first_record on.  Cursor is repositioned at first record of  */
+/* window.                                                                   */
+/*****************************************************************************/
+void
+gl_merge_cursor_set_range (glMergeCursor *cursor,
+			   gint           first_record,
+			   gint           n_records)
+{
+	g_return_if_fail (cursor != NULL);
+
+	cursor->range_start = MAX (first_record, 0);
+	cursor->range_len   = n_records;
+
+	gl_merge_cursor_rewind (cursor);
+}
+
+/*****************************************************************************/
+/* Reposition cursor at first record.                                        */
+/*****************************************************************************/
+void
+gl_merge_cursor_rewind (glMergeCursor *cursor)
+{
+	gl_debug (DEBUG_MERGE, "START");
+
+	g_return_if_fail (cursor != NULL);
+
+	if ( cursor->range_start > 0 ) {
+		cursor_seek_source (cursor, cursor->range_start);
+	} else {
+		cursor_rewind_source (cursor);
+	}
+	cursor->i_pos = 0;
+
+	gl_debug (DEBUG_MERGE, "END");
+}
+
+/*****************************************************************************/
+/* Get current record of cursor, NULL if past last record.                   */
+/*****************************************************************************/
+glMergeRecord *
+gl_merge_cursor_peek (glMergeCursor *cursor)
+{
+	g_return_val_if_fail (cursor != NULL, NULL);
+
+	if ( (cursor->range_len >= 0) && (cursor->i_pos >= cursor->range_len) ) {
+		return NULL;
+	}
+
+	return cursor_peek_source (cursor);
+}
+
+/*****************************************************************************/
+/* Reposition cursor at i'th record (zero based) of merge, or of its window. */
+/*                                                                           */
+/* Streaming backends that support random access jump directly to the       */
+/* record, otherwise the records before it are read and discarded.           */
+/*****************************************************************************/
+void
+gl_merge_cursor_seek (glMergeCursor *cursor,
+		      gint           i_record)
+{
+	gl_debug (DEBUG_MERGE, "START");
+
+	g_return_if_fail (cursor != NULL);
+
+	i_record = MAX (i_record, 0);
+
+	cursor_seek_source (cursor, cursor->range_start + i_record);
+	cursor->i_pos = i_record;
+
+	gl_debug (DEBUG_MERGE, "END");
+}
+
+/*****************************************************************************/
+/* Advance cursor to next record.                                            */
+/*****************************************************************************/
+void
+gl_merge_cursor_next (glMergeCursor *cursor)
+{
+	g_return_if_fail (cursor != NULL);
+
+	if ( gl_merge_cursor_peek (cursor) != NULL ) {
+		cursor_next_source (cursor);
+		cursor->i_pos++;
+	}
+}
+
+/*****************************************************************************/
+/* Reposition cursor at n_selected'th selected record (zero based) of its    */
+/* window, past the last record if there are not that many.                  */
+/*                                                                           */
+/* Streamed records are always selected, so streaming merges seek directly. */
+/*****************************************************************************/
+void
+gl_merge_cursor_seek_selected (glMergeCursor *cursor,
+			       gint           n_selected)
+{
+	glMergeRecord *record;
+
+	g_return_if_fail (cursor != NULL);
+
+	if ( cursor->merge->priv->stream_flag ) {
+		gl_merge_cursor_seek (cursor, n_selected);
+		return;
+	}
+
+	gl_merge_cursor_rewind (cursor);
+	for ( ; (record = gl_merge_cursor_peek (cursor)) != NULL;
+	      gl_merge_cursor_next (cursor) ) {
+
+		if ( record->select_flag && (n_selected-- <= 0) ) {
+			break;
+		}
+	}
+}
+
+/*****************************************************************************/
+/* Count selected records in window of cursor, leaving it at first record.   */
+/*                                                                           */
+/* This takes a pass over the window, see gl_merge_get_record_count() for   */
+/* counting all records of a streaming merge.                                */
+/*****************************************************************************/
+gint
+gl_merge_cursor_count_selected (glMergeCursor *cursor)
+{
+	glMergeRecord *record;
+	gint           count = 0;
+
+	g_return_val_if_fail (cursor != NULL, 0);
+
+	gl_merge_cursor_rewind (cursor);
+	for ( ; (record = gl_merge_cursor_peek (cursor)) != NULL;
+	      gl_merge_cursor_next (cursor) ) {
+
+		if ( record->select_flag ) count ++;
+	}
+	gl_merge_cursor_rewind (cursor);
+
+	return count;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Reposition cursor at first record of merge, ignoring window.              */
+/*---------------------------------------------------------------------------*/
+static void
+cursor_rewind_source (glMergeCursor *cursor)
+{
+	if ( cursor_is_over_store (cursor) ) {
+
+		cursor->i_row = 0;
+
+	} else if ( cursor->merge->priv->stream_flag ) {
+
+		if ( cursor->record != NULL ) {
+			merge_free_record (&cursor->record);
+		}
+		if ( cursor->open_flag ) {
+			merge_close (cursor->merge);
+		}
+
+		if ( cursor->merge->priv->src != NULL ) {
+			merge_open (cursor->merge);
+			cursor->open_flag = TRUE;
+			cursor->record = merge_get_record (cursor->merge);
+		} else {
+			cursor->open_flag = FALSE;
+		}
+
+	} else {
+
+		cursor->p_record = (GList *)gl_merge_get_record_list (cursor->merge);
+
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* Get current record of cursor, ignoring window.                            */
+/*---------------------------------------------------------------------------*/
+static glMergeRecord *
+cursor_peek_source (glMergeCursor *cursor)
+{
+	if ( cursor_is_over_store (cursor) ) {
+		if ( cursor->i_row >= cursor->merge->priv->records->store->n_rows ) {
+			return NULL;
+		}
+		cursor->row.select_flag = TRUE;
+		cursor->row.store       = cursor->merge->priv->records->store;
+		cursor->row.i_record    = cursor->i_row;
+		return &cursor->row;
+	} else if ( cursor->merge->priv->stream_flag ) {
+		return cursor->record;
+	} else {
+		return cursor->p_record ? cursor->p_record->data : NULL;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* Reposition cursor at i'th record of merge, ignoring window.               */
+/*---------------------------------------------------------------------------*/
+static void
+cursor_seek_source (glMergeCursor *cursor,
+		    gint           i_record)
+{
+	gint i;
+
+	cursor_rewind_source (cursor);
+
+	if ( cursor_is_over_store (cursor) ) {
+
+		cursor->i_row = MIN ((guint)i_record,
+				     cursor->merge->priv->records->store->n_rows);
+
+	} else if ( cursor->merge->priv->stream_flag && cursor->open_flag &&
+		    merge_seek_record (cursor->merge, i_record) ) {
+
+		if ( cursor->record != NULL ) {
+			merge_free_record (&cursor->record);
+		}
+		cursor->record = merge_get_record (cursor->merge);
+
+	} else {
+
+		for ( i = 0; (i < i_record) && (cursor_peek_source (cursor) != NULL); i++ ) {
+			cursor_next_source (cursor);
+		}
+
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* Advance cursor to next record of merge, ignoring window.                  */
+/*---------------------------------------------------------------------------*/
+static void
+cursor_next_source (glMergeCursor *cursor)
+{
+	if ( cursor_is_over_store (cursor) ) {
+
+		if ( cursor->i_row < cursor->merge->priv->records->store->n_rows ) {
+			cursor->i_row++;
+		}
+
+	} else if ( cursor->merge->priv->stream_flag ) {
+
+		if ( cursor->record != NULL ) {
+			merge_free_record (&cursor->record);
+			cursor->record = merge_get_record (cursor->merge);
+		}
+
+	} else {
+
+		if ( cursor->p_record != NULL ) {
+			cursor->p_record = cursor->p_record->next;
+		}
+
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* Does streaming cursor read records from a (cached) store, not a backend?  */
+/*---------------------------------------------------------------------------*/
+static gboolean
+cursor_is_over_store (const glMergeCursor *cursor)
+{
+	return cursor->merge->priv->stream_flag && (cursor->merge->priv->records != NULL);
+}
 
 
 /*
@@ -35,11 +35,22 @@ typedef struct {
 	gchar *value;
 } glMergeField;
 
+typedef struct _glMergeStore glMergeStore;
+
+typedef struct _glMergeCursor glMergeCursor;
+
 typedef struct {
-	gboolean select_flag;
-	GList    *field_list;  /* List of glMergeFields */
+	gboolean            select_flag;
+	GList              *field_list;  /* List of glMergeFields (from backend) */
+
+	const glMergeStore *store;       /* Columnar store holding field values  */
+	guint               i_record;    /* Row of this record within store      */
 } glMergeRecord;
 
+typedef void (*glMergeFieldFunc) (const gchar *key,
+                                  const gchar *value,
+                                  gpointer     user_data);
+
 
 #define GL_TYPE_MERGE              (gl_merge_get_type ())
 #define GL_MERGE(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GL_TYPE_MERGE, glMerge))
@@ -76,6 +87,15 @@ struct _glMergeClass {
 
 	void           (*copy)            (glMerge       *dst_merge,
 					   const glMerge *src_merge);
+
+	/* Optional random access to an opened source. */
+	gint           (*get_record_count) (glMerge      *merge);
+
+	gboolean       (*seek_record)     (glMerge       *merge,
+					   gint           i_record);
+
+	/* Optional key identifying current src for the parse cache. */
+	gchar         *(*get_cache_key)   (const glMerge *merge);
 };
 
 
@@ -98,6 +118,17 @@ glMerge          *gl_merge_new                 (const gchar         *name);
 
 glMerge          *gl_merge_dup                 (const glMerge       *orig);
 
+void              gl_merge_set_default_stream_flag (gboolean         stream_flag);
+
+void              gl_merge_set_cache_dir       (const gchar         *dir);
+
+const gchar      *gl_merge_get_cache_dir       (void);
+
+void              gl_merge_set_stream_flag     (glMerge             *merge,
+                                                gboolean             stream_flag);
+
+gboolean          gl_merge_get_stream_flag     (const glMerge       *merge);
+
 gchar            *gl_merge_get_name            (const glMerge       *merge);
 
 gchar            *gl_merge_get_description     (const glMerge       *merge);
@@ -115,13 +146,51 @@ void              gl_merge_free_key_list       (GList              **keys);
 
 gchar            *gl_merge_get_primary_key     (const glMerge       *merge);
 
+void              gl_merge_free_record         (glMergeRecord      **record);
+
 gchar            *gl_merge_eval_key            (const glMergeRecord *record,
                                                 const gchar         *key);
 
+const glMergeStore *gl_merge_get_store        (const glMerge       *merge);
+
+gint              gl_merge_get_key_column      (const glMerge       *merge,
+                                                const gchar         *key);
+
+gchar            *gl_merge_eval_column         (const glMergeRecord *record,
+                                                gint                 column);
+
+void              gl_merge_record_foreach_field (const glMergeRecord *record,
+                                                 glMergeFieldFunc     func,
+                                                 gpointer             user_data);
+
 const GList      *gl_merge_get_record_list     (const glMerge       *merge);
 
+GList            *gl_merge_get_mutable_record_list (glMerge         *merge);
+
 gint              gl_merge_get_record_count    (const glMerge       *merge);
 
+glMergeCursor    *gl_merge_cursor_new          (const glMerge       *merge);
+
+void              gl_merge_cursor_free         (glMergeCursor       *cursor);
+
+void              gl_merge_cursor_set_range    (glMergeCursor       *cursor,
+                                                gint                 first_record,
+                                                gint                 n_records);
+
+void              gl_merge_cursor_rewind       (glMergeCursor       *cursor);
+
+glMergeRecord    *gl_merge_cursor_peek         (glMergeCursor       *cursor);
+
+void              gl_merge_cursor_next         (glMergeCursor       *cursor);
+
+void              gl_merge_cursor_seek         (glMergeCursor       *cursor,
+                                                gint                 i_record);
+
+void              gl_merge_cursor_seek_selected (glMergeCursor      *cursor,
+                                                 gint                n_selected);
+
+gint              gl_merge_cursor_count_selected (glMergeCursor     *cursor);
+
 G_END_DECLS
 
 #endif
@@ -156,7 +156,8 @@ gl_mini_label_preview_set_by_name (glMiniLabelPreview *this,
         }
         else
         {
-                this->priv->template = lgl_db_lookup_template_from_name (name);
+                lgl_template_unref (this->priv->template);
+                this->priv->template = lgl_db_get_template_from_name (name);
                 this->priv->rotate_flag = rotate_flag;
         }
 
@@ -63,9 +63,9 @@ gl_mini_preview_pixbuf_cache_init (void)
         {
                 gl_debug (DEBUG_PIXBUF_CACHE, "name = \"%s\"", p->data);
 
-                template = lgl_db_lookup_template_from_name (p->data);
+                template = lgl_db_get_template_from_name (p->data);
                 gl_mini_preview_pixbuf_cache_add_by_template (template);
-                lgl_template_free (template);
+                lgl_template_unref (template);
         }
         lgl_db_free_template_name_list (names);
 
@@ -106,9 +106,9 @@ gl_mini_preview_pixbuf_cache_add_by_name (gchar      *name)
 
 	gl_debug (DEBUG_PIXBUF_CACHE, "START");
 
-        template = lgl_db_lookup_template_from_name (name);
+        template = lgl_db_get_template_from_name (name);
         pixbuf = gl_mini_preview_pixbuf_new (template, 72, 72);
-        lgl_template_free (template);
+        lgl_template_unref (template);
 
         g_hash_table_insert (mini_preview_pixbuf_cache, g_strdup (name), pixbuf);
 
@@ -322,11 +322,11 @@ gl_mini_preview_set_by_name (glMiniPreview *this,
         gl_debug (DEBUG_MINI_PREVIEW, "START");
 
         /* Fetch template */
-        template = lgl_db_lookup_template_from_name (name);
+        template = lgl_db_get_template_from_name (name);
 
         gl_mini_preview_set_template (this, template);
 
-        lgl_template_free (template);
+        lgl_template_unref (template);
 
         gl_debug (DEBUG_MINI_PREVIEW, "END");
 }
@@ -351,8 +351,9 @@ gl_mini_preview_set_template (glMiniPreview     *this,
         /*
          * Set template
          */
+        lgl_template_ref ((lglTemplate *)template);
         lgl_template_free (this->priv->template);
-        this->priv->template = lgl_template_dup (template);
+        this->priv->template = (lglTemplate *)template;
 
         /*
          * Set labels per sheet
@@ -1145,8 +1146,12 @@ draw_rich_preview (glMiniPreview          *this,
                  *        previous pages must be rendered to establish
                  *        state.
                  */
-                state.i_copy = 0;
-                state.p_record = (GList *)gl_merge_get_record_list (merge);
+                state.i_copy       = 0;
+                state.cursor       = NULL;
+                state.record_start = 0;
+                state.record_end   = 0;
+                state.first_sheet  = 0;
+                state.n_records    = -1;
 
                 if (this->priv->collate_flag)
                 {
@@ -1172,6 +1177,9 @@ draw_rich_preview (glMiniPreview          *this,
                                                          this->priv->crop_marks_flag,
                                                          &state);
                 }
+
+                gl_print_state_clear (&state);
+                g_object_unref (merge);
         }
 }
 
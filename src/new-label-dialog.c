@@ -330,9 +330,11 @@ forward_page_function (gint              current_page,
                 name = gl_media_select_get_name (GL_MEDIA_SELECT (this->priv->combo));
                 if ( name != NULL )
                 {
-                        template = lgl_db_lookup_template_from_name (name);
+                        template = lgl_db_get_template_from_name (name);
                         frame    = (lglTemplateFrame *)template->frames->data;
                         lgl_template_frame_get_size (frame, &w, &h);
+                        lgl_template_unref (template);
+                        g_free (name);
 
                         if ( w == h )
                         {
@@ -451,7 +453,7 @@ set_info (glNewLabelDialog  *this,
         GList                *list, *p;
         GString              *list_string;
 
-        template = lgl_db_lookup_template_from_name (name);
+        template = lgl_db_get_template_from_name (name);
         frame    = template->frames->data;
         vendor   = lgl_db_lookup_vendor_from_name (template->brand);
 
@@ -522,6 +524,7 @@ set_info (glNewLabelDialog  *this,
         g_free (page_size_string);
         g_free (label_size_string);
         g_free (layout_string);
+        lgl_template_unref (template);
 }
 
 
@@ -577,6 +577,10 @@ merge_changed_cb (glLabel        *label,
 
 	merge = gl_label_get_merge (label);
 	set_key_names (editor, merge);
+	if (merge != NULL)
+	{
+		g_object_unref (merge);
+	}
 
 	gl_debug (DEBUG_EDITOR, "END");
 }
@@ -876,6 +880,11 @@ object_changed_cb (glLabelObject  *object,
 
         gl_color_node_free (&shadow_color_node);
 
+        if (merge != NULL)
+        {
+                g_object_unref (merge);
+        }
+
 
         gl_debug (DEBUG_EDITOR, "END");
 }
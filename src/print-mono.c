@@ -0,0 +1,257 @@
+/*
+ *  print-mono.c
+ *  Copyright (C) 2026  gLabels contributors.
+ *
+ *  This file is part of gLabels.
+ *
+ *  gLabels is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gLabels is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gLabels.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "print-mono.h"
+
+#include <stdio.h>
+#include <glib/gstdio.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "debug.h"
+
+
+/*===========================================*/
+/* Private macros and constants.             */
+/*===========================================*/
+
+/*
+ * A pixel is black when its luminance (0-255) is at or below its threshold.
+ * Plain thresholding uses MONO_THRESHOLD everywhere; ordered dithering uses
+ * an 8x8 Bayer matrix, repeated across the image.
+ */
+#define MONO_THRESHOLD 127
+
+static const guchar bayer[8][8] = {
+        {  0, 32,  8, 40,  2, 34, 10, 42 },
+        { 48, 16, 56, 24, 50, 18, 58, 26 },
+        { 12, 44,  4, 36, 14, 46,  6, 38 },
+        { 60, 28, 52, 20, 62, 30, 54, 22 },
+        {  3, 35, 11, 43,  1, 33,  9, 41 },
+        { 51, 19, 59, 27, 49, 17, 57, 25 },
+        { 15, 47,  7, 39, 13, 45,  5, 37 },
+        { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+
+/*===========================================*/
+/* Local function prototypes                 */
+/*===========================================*/
+
+static void   pack_row      (const guint32 *src,
+                             gint           width,
+                             const guchar  *thresholds,
+                             guchar        *dest);
+
+static guchar reverse_bits  (guint          bits);
+
+
+
+/*****************************************************************************/
+/* Convert RGB24 image surface to 1 bit per pixel, 1 for black.              */
+/*                                                                           */
+/* Rows are packed most significant bit first and padded to whole bytes, as  */
+/* expected by PBM and most thermal printer languages.  Returned buffer is   */
+/* freed with g_free().                                                      */
+/*****************************************************************************/
+guchar *
+gl_print_mono_pack (cairo_surface_t *surface,
+                    gboolean         dither_flag,
+                    gint            *stride)
+{
+        gint          width, height, src_stride, x, y;
+        const guchar *src;
+        guchar       *bits;
+        guchar        thresholds[8][16];
+
+        gl_debug (DEBUG_PRINT, "START");
+
+        cairo_surface_flush (surface);
+
+        width      = cairo_image_surface_get_width (surface);
+        height     = cairo_image_surface_get_height (surface);
+        src_stride = cairo_image_surface_get_stride (surface);
+        src        = cairo_image_surface_get_data (surface);
+
+        /* Thresholds of 16 consecutive pixels, for each row of the matrix. */
+        for (y = 0; y < 8; y++)
+        {
+                for (x = 0; x < 16; x++)
+                {
+                        thresholds[y][x] = dither_flag ? (bayer[y][x % 8] * 4 + 1) : MONO_THRESHOLD;
+                }
+        }
+
+        *stride = (width + 7) / 8;
+        bits    = g_malloc0 (*stride * height);
+
+        for (y = 0; y < height; y++)
+        {
+                pack_row ((const guint32 *)(src + y * src_stride),
+                          width,
+                          thresholds[y % 8],
+                          bits + y * *stride);
+        }
+
+        gl_debug (DEBUG_PRINT, "END");
+
+        return bits;
+}
+
+
+/*****************************************************************************/
+/* Save RGB24 image surface as 1 bit per pixel binary PBM file.              */
+/*****************************************************************************/
+gboolean
+gl_print_mono_save_pbm (cairo_surface_t *surface,
+                        gboolean         dither_flag,
+                        const gchar     *filename)
+{
+        guchar   *bits;
+        gint      stride, height;
+        FILE     *fp;
+        gboolean  ok;
+
+        bits   = gl_print_mono_pack (surface, dither_flag, &stride);
+        height = cairo_image_surface_get_height (surface);
+
+        fp = g_fopen (filename, "wb");
+        if (fp == NULL)
+        {
+                g_free (bits);
+                return FALSE;
+        }
+
+        fprintf (fp, "P4\n%d %d\n", cairo_image_surface_get_width (surface), height);
+        ok = (fwrite (bits, stride, height, fp) == (size_t)height);
+        ok = (fclose (fp) == 0) && ok;
+
+        g_free (bits);
+
+        return ok;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Threshold and pack one row of pixels.                           */
+/*                                                                           */
+/* Luminance is (77 R + 150 G + 29 B) / 256.  Sixteen pixels are converted   */
+/* at a time when SSE2 is available.                                         */
+/*---------------------------------------------------------------------------*/
+static void
+pack_row (const guint32 *src,
+          gint           width,
+          const guchar  *thresholds,
+          guchar        *dest)
+{
+        gint    x, i;
+        guint32 pixel;
+        guint   lum;
+        guchar  byte;
+
+        x = 0;
+
+#ifdef __SSE2__
+        {
+                const __m128i mask  = _mm_set1_epi32 (0xff);
+                const __m128i kr    = _mm_set1_epi16 (77);
+                const __m128i kg    = _mm_set1_epi16 (150);
+                const __m128i kb    = _mm_set1_epi16 (29);
+                const __m128i thr   = _mm_loadu_si128 ((const __m128i *)thresholds);
+                __m128i       p[4], r[2], g[2], b[2], l[2], lum8, black;
+                gint          bitmask;
+
+                for ( ; (x + 16) <= width; x += 16)
+                {
+                        for (i = 0; i < 4; i++)
+                        {
+                                p[i] = _mm_loadu_si128 ((const __m128i *)(src + x + 4*i));
+                        }
+                        for (i = 0; i < 2; i++)
+                        {
+                                r[i] = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (p[2*i], 16), mask),
+                                                        _mm_and_si128 (_mm_srli_epi32 (p[2*i+1], 16), mask));
+                                g[i] = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (p[2*i], 8), mask),
+                                                        _mm_and_si128 (_mm_srli_epi32 (p[2*i+1], 8), mask));
+                                b[i] = _mm_packs_epi32 (_mm_and_si128 (p[2*i], mask),
+                                                        _mm_and_si128 (p[2*i+1], mask));
+                                l[i] = _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (r[i], kr),
+                                                                                     _mm_mullo_epi16 (g[i], kg)),
+                                                                      _mm_mullo_epi16 (b[i], kb)),
+                                                       8);
+                        }
+                        lum8  = _mm_packus_epi16 (l[0], l[1]);
+
+                        /* lum <= thr, unsigned. */
+                        black   = _mm_cmpeq_epi8 (_mm_min_epu8 (lum8, thr), lum8);
+                        bitmask = _mm_movemask_epi8 (black);
+
+                        dest[x / 8]     = reverse_bits (bitmask & 0xff);
+                        dest[x / 8 + 1] = reverse_bits ((bitmask >> 8) & 0xff);
+                }
+        }
+#endif
+
+        for ( ; x < width; x += 8)
+        {
+                byte = 0;
+                for (i = 0; (i < 8) && (x + i < width); i++)
+                {
+                        pixel = src[x + i];
+                        lum   = ( 77 * ((pixel >> 16) & 0xff) +
+                                 150 * ((pixel >> 8) & 0xff) +
+                                  29 * (pixel & 0xff) ) >> 8;
+                        if (lum <= thresholds[(x + i) % 16])
+                        {
+                                byte |= 0x80 >> i;
+                        }
+                }
+                dest[x / 8] = byte;
+        }
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Reverse order of bits in byte.                                  */
+/*---------------------------------------------------------------------------*/
+static guchar
+reverse_bits (guint bits)
+{
+        bits = ((bits & 0xf0) >> 4) | ((bits & 0x0f) << 4);
+        bits = ((bits & 0xcc) >> 2) | ((bits & 0x33) << 2);
+        bits = ((bits & 0xaa) >> 1) | ((bits & 0x55) << 1);
+
+        return bits;
+}
+
+
+
+/*
+ * Local Variables:       -- emacs
+ * mode: C                -- emacs
+ * c-basic-offset: 8      -- emacs
+ * tab-width: 8           -- emacs
+ * indent-tabs-mode: nil  -- emacs
+ * End:                   -- emacs
+ */
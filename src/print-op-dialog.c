@@ -178,8 +178,6 @@ gl_print_op_dialog_finalize (GObject *object)
 	g_free (op->priv);
 
 	G_OBJECT_CLASS (gl_print_op_dialog_parent_class)->finalize (object);
-
-	g_free (op->priv);
 }
 
 
@@ -391,9 +389,12 @@ create_custom_widget_cb (GtkPrintOperation *operation,
                 g_signal_connect (G_OBJECT (op->priv->preview), "released",
                                   G_CALLBACK (preview_released_cb), op);
 
-		g_object_unref (G_OBJECT(merge));
-
 	}
+        if (merge != NULL)
+        {
+                /* Reference returned by gl_label_get_merge(). */
+                g_object_unref (G_OBJECT(merge));
+        }
 
         /* --- Set options --- */
         gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (op->priv->outline_check),
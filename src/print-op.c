@@ -23,22 +23,120 @@
 #include "print-op.h"
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <ctype.h>
 
+#include <cairo-pdf.h>
+#include <cairo-ps.h>
+#include <cairo-svg.h>
+
 #include <libglabels.h>
+#include <libglbarcode.h>
 #include "print.h"
+#include "print-mono.h"
 #include "label.h"
+#include "text-node.h"
+#include "stats.h"
 
 #include "debug.h"
 
 
+/*===========================================*/
+/* Private macros and constants.             */
+/*===========================================*/
+
+/*
+ * Parallel rendering.  Pages are handed out to worker threads in blocks of
+ * consecutive pages.  Each worker draws its pages with its own copy of the
+ * label into recording surfaces, which draw_page_cb() then replays in page
+ * order.  Workers stay at most BLOCKS_AHEAD_PER_THREAD blocks per thread
+ * ahead of the page being drawn, to bound memory use.
+ */
+#define BLOCK_MIN_PAGES          4
+#define BLOCKS_PER_THREAD        4
+#define BLOCKS_AHEAD_PER_THREAD  2
+
+
 /*===========================================*/
 /* Private data types                        */
 /*===========================================*/
 
+typedef struct {
+        glPrintOp  *op;
+        glLabel    *label;
+        GThread    *thread;
+} Worker;
+
+/*
+ * Raster export job.  Work items are either blocks of whole pages, or, when
+ * there are fewer pages than threads, horizontal bands of pages; the last
+ * band drawn of a page writes its file.
+ */
+typedef struct {
+        glPrintOp        *op;
+        const gchar      *filename;
+        gdouble           scale;
+        gint              width;
+        gint              height;
+        gint              n_bands;
+        gint              band_height;
+        gint              block_size;
+        gint              n_items;
+        gint              next_item;
+        cairo_surface_t **pages;
+        gint             *bands_left;
+        gboolean          ok;
+        GMutex            mutex;
+} RasterJob;
+
+/*
+ * Label export job.  Work items are blocks of consecutive merge records (or
+ * the single unmerged label), and every copy of a label is written to its
+ * own file.
+ */
+typedef enum {
+        LABEL_FORMAT_VECTOR,
+        LABEL_FORMAT_RASTER,
+        LABEL_FORMAT_MONO
+} LabelFormat;
+
+typedef struct {
+        glPrintOp        *op;
+        const gchar      *filename;
+        GList            *pattern;    /* Fields of filename, NULL if none */
+        GPtrArray        *names;      /* Unique names of label copies, if pattern */
+        LabelFormat       format;
+        gdouble           scale;
+        gboolean          dither_flag;
+        gint              record_start;
+        gint              n_records;
+        gint              block_size;
+        gint              n_items;
+        gint              next_item;
+        gboolean          ok;
+        GMutex            mutex;
+} LabelJob;
+
+#define LABEL_BLOCK_RECORDS 64
+
+/* Export file being written, through a cairo stream. */
+typedef struct {
+        FILE       *fp;
+        goffset     n_bytes;
+} OutputFile;
+
+/* Worker thread of a raster or label export job. */
+typedef struct {
+        gpointer    job;
+        glLabel    *label;
+        GThread    *thread;
+} JobWorker;
+
 struct _glPrintOpPrivate {
 
 	glLabel   *label;
@@ -59,6 +157,20 @@ struct _glPrintOpPrivate {
         gint       n_copies;
 
         glPrintState state;
+
+        gint       pages_per_file;   /* Split export, 0 for no limit */
+        goffset    max_file_size;
+
+        gint              n_threads;
+        GPtrArray        *workers;
+        cairo_surface_t **pages;
+        gint              block_size;
+        gint              n_pages_ahead;
+        gint              next_block;
+        gint              next_page;
+        gboolean          stop_flag;
+        GMutex            mutex;
+        GCond             cond;
 };
 
 struct _glPrintOpSettings
@@ -83,6 +195,12 @@ struct _glPrintOpSettings
 /* Private globals                           */
 /*===========================================*/
 
+/*
+ * Print ops may be created by jobs of several threads (e.g. glabels-batch
+ * --serve).  The GtkPrintOperation instance init is not thread safe (it
+ * numbers jobs in a global), so instances are created one at a time.
+ */
+static GMutex new_mutex;
 
 /*===========================================*/
 /* Local function prototypes                 */
@@ -90,6 +208,9 @@ struct _glPrintOpSettings
 
 static void     gl_print_op_finalize          (GObject           *object);
 
+static void     construct_job                 (glPrintOp         *op,
+                                               glLabel           *label);
+
 static void     set_page_size                 (glPrintOp         *op,
                                                glLabel           *label);
 
@@ -102,6 +223,91 @@ static void     draw_page_cb                  (GtkPrintOperation *operation,
                                                int                page_nr,
                                                gpointer           user_data);
 
+static void     end_print_cb                  (GtkPrintOperation *operation,
+                                               GtkPrintContext   *context,
+                                               gpointer           user_data);
+
+static void     draw_page                     (glPrintOp         *op,
+                                               cairo_t           *cr,
+                                               gint               page_nr);
+
+static gint      draw_sheet                    (glPrintOp         *op,
+                                               glLabel           *label,
+                                               cairo_t           *cr,
+                                               gint               page_nr,
+                                               glPrintState      *state);
+
+static void     start_workers                 (glPrintOp         *op);
+
+static void     stop_workers                  (glPrintOp         *op);
+
+static gpointer worker_thread                 (gpointer           data);
+
+static gpointer raster_thread                 (gpointer           data);
+
+static void     draw_raster_band              (RasterJob         *job,
+                                               glLabel           *label,
+                                               cairo_surface_t   *page,
+                                               gint               band,
+                                               gint               page_nr,
+                                               glPrintState      *state);
+
+static void     write_raster_page             (RasterJob         *job,
+                                               cairo_surface_t   *page,
+                                               gint               page_nr);
+
+static void     run_job_workers               (glPrintOp         *op,
+                                               gint               n_threads,
+                                               GThreadFunc        func,
+                                               gpointer           job);
+
+static gboolean run_label_job                 (LabelJob          *job);
+
+static gpointer label_thread                  (gpointer           data);
+
+static void     draw_label                    (glPrintOp         *op,
+                                               glLabel           *label,
+                                               cairo_t           *cr,
+                                               glMergeRecord     *record);
+
+static gboolean write_label                   (LabelJob          *job,
+                                               glLabel           *label,
+                                               glMergeRecord     *record,
+                                               gint               i_record,
+                                               gint               i_copy);
+
+static gchar   *label_filename                (LabelJob          *job,
+                                               glMergeRecord     *record,
+                                               gint               i_record,
+                                               gint               i_copy);
+
+static void     name_labels                   (LabelJob          *job);
+
+static gboolean name_copies                   (const gchar       *name,
+                                               gint               n_copies,
+                                               GHashTable        *used,
+                                               gchar            **copies);
+
+static gchar   *expand_pattern                (LabelJob          *job,
+                                               glMergeRecord     *record);
+
+static gchar   *numbered_filename             (const gchar       *filename,
+                                               gint               number);
+
+static cairo_surface_t *
+                create_vector_surface         (const gchar       *filename,
+                                               gdouble            w,
+                                               gdouble            h,
+                                               OutputFile        *out);
+
+static cairo_status_t
+                write_output                  (void              *closure,
+                                               const guchar      *data,
+                                               guint              length);
+
+static gboolean save_image                    (cairo_surface_t   *surface,
+                                               const gchar       *filename);
+
 
 /*****************************************************************************/
 /* Boilerplate object stuff.                                                 */
@@ -127,12 +333,12 @@ gl_print_op_init (glPrintOp *op)
 {
 	gl_debug (DEBUG_PRINT, "");
 
-	gtk_print_operation_set_use_full_page (GTK_PRINT_OPERATION (op), TRUE);
-
-        gtk_print_operation_set_unit (GTK_PRINT_OPERATION (op), GTK_UNIT_POINTS);
-
 	op->priv = g_new0 (glPrintOpPrivate, 1);
 
+        op->priv->n_threads = 1;
+        g_mutex_init (&op->priv->mutex);
+        g_cond_init (&op->priv->cond);
+
 }
 
 
@@ -147,18 +353,26 @@ gl_print_op_finalize (GObject *object)
         g_return_if_fail (GL_IS_PRINT_OP (op));
 	g_return_if_fail (op->priv != NULL);
 
+        stop_workers (op);
+        g_mutex_clear (&op->priv->mutex);
+        g_cond_clear (&op->priv->cond);
         g_object_unref (G_OBJECT(op->priv->label));
+        gl_print_state_clear (&op->priv->state);
         g_free (op->priv->filename);
 	g_free (op->priv);
 
 	G_OBJECT_CLASS (gl_print_op_parent_class)->finalize (object);
-
-	g_free (op->priv);
 }
 
 
 /*****************************************************************************/
-/* NEW print op.                                                         */
+/* NEW print op, for exporting.                                              */
+/*                                                                           */
+/* The op is only set up for the gl_print_op_export*() functions, which      */
+/* draw with cairo alone and take the page size from the label's template,  */
+/* so no GTK calls are made on it and GTK needs no initialization.  Print   */
+/* ops to be run as a GtkPrintOperation are set up by                        */
+/* gl_print_op_construct() instead.                                          */
 /*****************************************************************************/
 glPrintOp *
 gl_print_op_new (glLabel      *label)
@@ -167,26 +381,57 @@ gl_print_op_new (glLabel      *label)
 
 	gl_debug (DEBUG_PRINT, "");
 
+	g_mutex_lock (&new_mutex);
 	op = GL_PRINT_OP (g_object_new (GL_TYPE_PRINT_OP, NULL));
+	g_mutex_unlock (&new_mutex);
 
-	gl_print_op_construct (GL_PRINT_OP(op), label);
+	construct_job (op, label);
 
 	return op;
 }
 
 
 /*****************************************************************************/
-/* Construct print op.                                                       */
+/* Construct print op, to be run as a GtkPrintOperation.                     */
 /*****************************************************************************/
 void
 gl_print_op_construct (glPrintOp      *op,
                        glLabel        *label)
+{
+        construct_job (op, label);
+
+	gtk_print_operation_set_use_full_page (GTK_PRINT_OPERATION (op), TRUE);
+
+        gtk_print_operation_set_unit (GTK_PRINT_OPERATION (op), GTK_UNIT_POINTS);
+
+        set_page_size (op, label);
+
+	gtk_print_operation_set_custom_tab_label ( GTK_PRINT_OPERATION (op),
+						   _("Labels"));
+
+	g_signal_connect (G_OBJECT (op), "begin-print",
+			  G_CALLBACK (begin_print_cb), label);
+
+	g_signal_connect (G_OBJECT (op), "draw-page",
+			  G_CALLBACK (draw_page_cb), label);
+
+	g_signal_connect (G_OBJECT (op), "end-print",
+			  G_CALLBACK (end_print_cb), label);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Set up job of print op for label.                               */
+/*---------------------------------------------------------------------------*/
+static void
+construct_job (glPrintOp      *op,
+               glLabel        *label)
 {
         glMerge                *merge = NULL;
         const lglTemplate      *template;
         const lglTemplateFrame *frame;
 
-	op->priv->label              = label;
+	op->priv->label              = g_object_ref (label);
 	op->priv->force_outline_flag = FALSE;
 
         merge    = gl_label_get_merge (label);
@@ -194,21 +439,15 @@ gl_print_op_construct (glPrintOp      *op,
         frame    = (lglTemplateFrame *)template->frames->data;
 
         op->priv->merge_flag         = (merge != NULL);
+        if (merge != NULL)
+        {
+                g_object_unref (merge);
+        }
         op->priv->n_sheets           = 1;
         op->priv->first              = 1;
         op->priv->last               = lgl_template_frame_get_n_labels (frame);
         op->priv->n_copies           = 1;
-
-        set_page_size (op, label);
-
-	gtk_print_operation_set_custom_tab_label ( GTK_PRINT_OPERATION (op),
-						   _("Labels"));
-
-	g_signal_connect (G_OBJECT (op), "begin-print",
-			  G_CALLBACK (begin_print_cb), label);
-
-	g_signal_connect (G_OBJECT (op), "draw-page",
-			  G_CALLBACK (draw_page_cb), label);
+        op->priv->state.n_records    = -1;
 }
 
 
@@ -239,8 +478,8 @@ void
 gl_print_op_set_filename (glPrintOp *op,
                           gchar     *filename)
 {
-        gtk_print_operation_set_export_filename (GTK_PRINT_OPERATION (op),
-                                                 filename);
+        g_free (op->priv->filename);
+        op->priv->filename = g_strdup (filename);
 }
 
 
@@ -307,6 +546,62 @@ gl_print_op_set_crop_marks_flag (glPrintOp *op,
         op->priv->crop_marks_flag = crop_marks_flag;
 }
 
+void
+gl_print_op_set_record_range (glPrintOp *op,
+                              gint       record_start,
+                              gint       record_end)
+{
+        op->priv->state.record_start = record_start;
+        op->priv->state.record_end   = record_end;
+}
+
+void
+gl_print_op_set_first_sheet (glPrintOp *op,
+                             gint       first_sheet)
+{
+        op->priv->state.first_sheet = first_sheet;
+}
+
+/*
+ * Number of records of the merge, when already known to the caller, so that
+ * it is not counted again.  Otherwise it is counted once per print op.
+ */
+void
+gl_print_op_set_n_records (glPrintOp *op,
+                           gint       n_records)
+{
+        op->priv->state.n_records = n_records;
+}
+
+/*
+ * Exports are split into files of at most pages_per_file sheets and, as far
+ * as can be told while writing, max_file_size bytes.  Zero for no limit.
+ */
+void
+gl_print_op_set_pages_per_file (glPrintOp *op,
+                                gint       pages_per_file)
+{
+        op->priv->pages_per_file = MAX (pages_per_file, 0);
+}
+
+void
+gl_print_op_set_max_file_size (glPrintOp *op,
+                               goffset    max_file_size)
+{
+        op->priv->max_file_size = MAX (max_file_size, 0);
+}
+
+/*
+ * Pages are only drawn in parallel when they are requested in order, as
+ * when exporting to a file.
+ */
+void
+gl_print_op_set_n_threads (glPrintOp *op,
+                           gint       n_threads)
+{
+        op->priv->n_threads = MAX (n_threads, 1);
+}
+
 
 /*****************************************************************************/
 /* Get job parameters.                                                       */
@@ -314,13 +609,7 @@ gl_print_op_set_crop_marks_flag (glPrintOp *op,
 gchar *
 gl_print_op_get_filename (glPrintOp *op)
 {
-        gchar *filename = NULL;
-
-        g_object_get (G_OBJECT (op),
-                      "export_filename", filename,
-                      NULL);
-
-        return filename;
+        return g_strdup (op->priv->filename);
 }
 
 
@@ -380,6 +669,267 @@ gl_print_op_get_crop_marks_flag (glPrintOp *op)
 }
 
 
+/*****************************************************************************/
+/* Export job directly to file, without running the print operation.       */
+/*                                                                           */
+/* The format is chosen from the extension of filename: PostScript (".ps"), */
+/* SVG (".svg") or otherwise PDF.  Pages are drawn with cairo alone, sized  */
+/* after the label's template, so neither a display nor GTK initialization  */
+/* is needed (see gl_print_op_new()).                                        */
+/* A job without sheets writes no file and succeeds; callers that need to   */
+/* tell an empty job apart check gl_print_op_get_n_sheets() first.           */
+/*                                                                           */
+/* When a pages per file or file size limit is set, the job is split at     */
+/* sheet boundaries into files numbered "out-0001.pdf", "out-0002.pdf"...   */
+/* One print state runs through all of them, so the order of records and    */
+/* copies is the same as in a single file.  File sizes are checked after    */
+/* each sheet, rolling over before a sheet of average size would exceed the */
+/* limit; data written at the end of a file (e.g. fonts) is not foreseen.    */
+/*****************************************************************************/
+gboolean
+gl_print_op_export (glPrintOp   *op,
+                    const gchar *filename)
+{
+        const lglTemplate *template;
+        gboolean           split_flag;
+        OutputFile         out;
+        gchar             *file_name = NULL;
+        gint               i_file, n_file_pages;
+        cairo_surface_t   *surface = NULL;
+        cairo_t           *cr = NULL;
+        cairo_status_t     status;
+        gboolean           ok = TRUE;
+        gint               page_nr;
+        glStatsTimer       timer;
+
+        gl_debug (DEBUG_PRINT, "START");
+
+        template = gl_label_get_template (op->priv->label);
+
+        split_flag   = (op->priv->pages_per_file > 0) || (op->priv->max_file_size > 0);
+        i_file       = 0;
+        n_file_pages = 0;
+
+        if ( (op->priv->n_threads > 1) && (op->priv->n_sheets > 1) )
+        {
+                start_workers (op);
+        }
+
+        for (page_nr = 0; page_nr < op->priv->n_sheets; page_nr++)
+        {
+                if (surface == NULL)
+                {
+                        i_file++;
+                        file_name = split_flag ? numbered_filename (filename, i_file) : g_strdup (filename);
+
+                        out.fp      = g_fopen (file_name, "wb");
+                        out.n_bytes = 0;
+                        if (out.fp == NULL)
+                        {
+                                g_message ("Cannot export to %s", file_name);
+                                g_free (file_name);
+                                ok = FALSE;
+                                break;
+                        }
+
+                        surface      = create_vector_surface (file_name,
+                                                              template->page_width,
+                                                              template->page_height,
+                                                              &out);
+                        cr           = cairo_create (surface);
+                        n_file_pages = 0;
+                }
+
+                draw_page (op, cr, page_nr);
+
+                gl_stats_timer_start (&timer);
+                cairo_show_page (cr);
+                gl_stats_add_phase (GL_STATS_PHASE_FINISH, &timer);
+                gl_stats_count (GL_STATS_PAGES, 1);
+                n_file_pages++;
+
+                if ( ((op->priv->pages_per_file > 0) &&
+                      (n_file_pages >= op->priv->pages_per_file)) ||
+                     ((op->priv->max_file_size > 0) &&
+                      (out.n_bytes + out.n_bytes / n_file_pages > op->priv->max_file_size)) ||
+                     (page_nr == op->priv->n_sheets - 1) )
+                {
+                        gl_stats_timer_start (&timer);
+                        cairo_destroy (cr);
+                        cairo_surface_finish (surface);
+                        status = cairo_surface_status (surface);
+                        cairo_surface_destroy (surface);
+                        surface = NULL;
+
+                        if ( (fclose (out.fp) != 0) && (status == CAIRO_STATUS_SUCCESS) )
+                        {
+                                status = CAIRO_STATUS_WRITE_ERROR;
+                        }
+                        gl_stats_add_phase (GL_STATS_PHASE_FINISH, &timer);
+                        if (status != CAIRO_STATUS_SUCCESS)
+                        {
+                                g_message ("Cannot export to %s (%s)", file_name,
+                                           cairo_status_to_string (status));
+                                ok = FALSE;
+                        }
+                        g_free (file_name);
+                }
+        }
+
+        stop_workers (op);
+
+        gl_debug (DEBUG_PRINT, "END");
+
+        return ok;
+}
+
+
+/*****************************************************************************/
+/* Export job to raster image files at given resolution.                    */
+/*                                                                           */
+/* One image is written per sheet, as TIFF (".tif" or ".tiff") or otherwise  */
+/* PNG.  Jobs of more than one sheet number their files after the sheet,     */
+/* e.g. "out-0001.png".  Sheets, or bands of sheets, are drawn in parallel.  */
+/* As with gl_print_op_export(), a job without sheets writes no files.       */
+/*****************************************************************************/
+gboolean
+gl_print_op_export_raster (glPrintOp   *op,
+                           const gchar *filename,
+                           gdouble      dpi)
+{
+        const lglTemplate *template;
+        RasterJob          job;
+        gint               n_threads, page_nr;
+
+        gl_debug (DEBUG_PRINT, "START");
+
+        template = gl_label_get_template (op->priv->label);
+
+        job.op          = op;
+        job.filename    = filename;
+        job.scale       = dpi / 72.0;
+        job.width       = ceil (template->page_width * job.scale);
+        job.height      = ceil (template->page_height * job.scale);
+        job.next_item   = 0;
+        job.pages       = NULL;
+        job.bands_left  = NULL;
+        job.ok          = TRUE;
+        g_mutex_init (&job.mutex);
+
+        n_threads = MAX (op->priv->n_threads, 1);
+
+        /* Count records once here, rather than in every worker. */
+        if (op->priv->merge_flag)
+        {
+                gl_print_state_count_records (&op->priv->state, op->priv->label);
+        }
+
+        if (n_threads > op->priv->n_sheets)
+        {
+                /* Too few sheets to go around, so split sheets into bands. */
+                job.n_bands     = MIN ((n_threads + op->priv->n_sheets - 1) / op->priv->n_sheets,
+                                       job.height);
+                job.band_height = (job.height + job.n_bands - 1) / job.n_bands;
+                job.block_size  = 1;
+                job.n_items     = op->priv->n_sheets * job.n_bands;
+
+                job.pages      = g_new0 (cairo_surface_t *, op->priv->n_sheets);
+                job.bands_left = g_new0 (gint, op->priv->n_sheets);
+                for (page_nr = 0; page_nr < op->priv->n_sheets; page_nr++)
+                {
+                        job.pages[page_nr]      = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+                                                                              job.width,
+                                                                              job.height);
+                        job.bands_left[page_nr] = job.n_bands;
+                }
+        }
+        else
+        {
+                job.n_bands     = 1;
+                job.band_height = job.height;
+                job.block_size  = MAX (op->priv->n_sheets / (n_threads * BLOCKS_PER_THREAD),
+                                       BLOCK_MIN_PAGES);
+                job.n_items     = (op->priv->n_sheets + job.block_size - 1) / job.block_size;
+        }
+
+        run_job_workers (op, MIN (n_threads, job.n_items), raster_thread, &job);
+
+        g_free (job.pages);
+        g_free (job.bands_left);
+        g_mutex_clear (&job.mutex);
+
+        gl_debug (DEBUG_PRINT, "END");
+
+        return job.ok;
+}
+
+
+/*****************************************************************************/
+/* Export each label of job to its own file.                                */
+/*                                                                           */
+/* The format is chosen from the extension of filename: PDF, PostScript or  */
+/* SVG, sized to the label; PNG or TIFF at resolution dpi; or 1 bit per      */
+/* pixel PBM at resolution dpi, thresholded or, with dither_flag, ordered    */
+/* dithered.  Labels are drawn in their own (unrotated) orientation.         */
+/*                                                                           */
+/* Merge fields in filename, e.g. "${order_id}.pdf", are expanded for each  */
+/* record, with directory separators in field values replaced by "_", as    */
+/* well as a leading "." or "-", and empty values replaced by "_".  When    */
+/* records of the merge expand to the same name, all but the first are      */
+/* numbered after their merge record, e.g. "A17-0005.pdf", also when only    */
+/* some of the records are in the job (e.g. a shard), and names of copies    */
+/* never take the name of another file.                                      */
+/* Otherwise files are numbered after their merge record, e.g.               */
+/* "out-0001.pdf", unless the job is a single unmerged label.  Copies of a   */
+/* label are numbered in either case.                                        */
+/*****************************************************************************/
+gboolean
+gl_print_op_export_labels (glPrintOp   *op,
+                           const gchar *filename,
+                           gdouble      dpi,
+                           gboolean     dither_flag)
+{
+        LabelJob  job;
+        GList    *lines;
+        gboolean  ok;
+
+        job.op          = op;
+        job.filename    = filename;
+        job.pattern     = NULL;
+        job.names       = NULL;
+        job.scale       = dpi / 72.0;
+        job.dither_flag = dither_flag;
+
+        if (g_str_has_suffix (filename, ".pbm"))
+        {
+                job.format = LABEL_FORMAT_MONO;
+        }
+        else if (g_str_has_suffix (filename, ".png") ||
+                 g_str_has_suffix (filename, ".tif") ||
+                 g_str_has_suffix (filename, ".tiff"))
+        {
+                job.format = LABEL_FORMAT_RASTER;
+        }
+        else
+        {
+                job.format = LABEL_FORMAT_VECTOR;
+        }
+
+        lines = NULL;
+        if (strstr (filename, "${") != NULL)
+        {
+                lines       = gl_text_node_lines_new_from_text (filename);
+                job.pattern = lines->data;
+        }
+
+        ok = run_label_job (&job);
+
+        gl_text_node_lines_free (&lines);
+
+        return ok;
+}
+
+
 /*--------------------------------------------------------------------------*/
 /* PRIVATE.  Set page size.                                                 */
 /*--------------------------------------------------------------------------*/
@@ -524,6 +1074,11 @@ begin_print_cb (GtkPrintOperation *operation,
 
         gtk_print_operation_set_n_pages (operation, op->priv->n_sheets);
 
+        if ( (op->priv->n_threads > 1) && (op->priv->n_sheets > 1) )
+        {
+                start_workers (op);
+        }
+
 }
 
 
@@ -536,50 +1091,1018 @@ draw_page_cb (GtkPrintOperation *operation,
 	      int                page_nr,
 	      gpointer           user_data)
 {
-        glPrintOp *op = GL_PRINT_OP (operation);
-        cairo_t       *cr;
+        glPrintOp       *op = GL_PRINT_OP (operation);
+        cairo_t         *cr;
 
         cr = gtk_print_context_get_cairo_context (context);
 
+        draw_page (op, cr, page_nr);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  "End print" callback.                                          */
+/*--------------------------------------------------------------------------*/
+static void
+end_print_cb (GtkPrintOperation *operation,
+              GtkPrintContext   *context,
+              gpointer           user_data)
+{
+        stop_workers (GL_PRINT_OP (operation));
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Draw page of job, directly or by replaying a worker's drawing. */
+/*--------------------------------------------------------------------------*/
+static void
+draw_page (glPrintOp *op,
+           cairo_t   *cr,
+           gint       page_nr)
+{
+        cairo_surface_t *surface;
+        glStatsTimer     timer;
+
+        if (op->priv->workers == NULL)
+        {
+                gl_stats_count (GL_STATS_LABELS,
+                                draw_sheet (op, op->priv->label, cr, page_nr, &op->priv->state));
+                return;
+        }
+
+        /* Wait for page to be drawn by a worker, then replay it. */
+        g_mutex_lock (&op->priv->mutex);
+        while (op->priv->pages[page_nr] == NULL)
+        {
+                g_cond_wait (&op->priv->cond, &op->priv->mutex);
+        }
+        surface = op->priv->pages[page_nr];
+        op->priv->pages[page_nr] = NULL;
+        op->priv->next_page = page_nr + 1;
+        g_cond_broadcast (&op->priv->cond);
+        g_mutex_unlock (&op->priv->mutex);
+
+        gl_stats_timer_start (&timer);
+        cairo_save (cr);
+        cairo_set_source_surface (cr, surface, 0, 0);
+        cairo_paint (cr);
+        cairo_restore (cr);
+        cairo_surface_destroy (surface);
+        gl_stats_add_phase (GL_STATS_PHASE_RENDER, &timer);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Draw sheet (page) of job, returning number of labels drawn.    */
+/*--------------------------------------------------------------------------*/
+static gint
+draw_sheet (glPrintOp         *op,
+            glLabel           *label,
+            cairo_t           *cr,
+            gint               page_nr,
+            glPrintState      *state)
+{
+        glStatsTimer timer;
+        gint         n_labels;
+
+        gl_stats_timer_start (&timer);
+
         if (!op->priv->merge_flag)
         {
-                gl_print_simple_sheet (op->priv->label,
-                                       cr,
-                                       page_nr,
-                                       op->priv->n_sheets,
-                                       op->priv->first,
-                                       op->priv->last,
-                                       op->priv->outline_flag,
-                                       op->priv->reverse_flag,
-                                       op->priv->crop_marks_flag);
+                n_labels = gl_print_simple_sheet (label,
+                                                  cr,
+                                                  page_nr,
+                                                  op->priv->n_sheets,
+                                                  op->priv->first,
+                                                  op->priv->last,
+                                                  op->priv->outline_flag,
+                                                  op->priv->reverse_flag,
+                                                  op->priv->crop_marks_flag);
         }
         else
         {
                 if (op->priv->collate_flag)
                 {
-                        gl_print_collated_merge_sheet (op->priv->label,
-                                                       cr,
-                                                       page_nr,
-                                                       op->priv->n_copies,
-                                                       op->priv->first,
-                                                       op->priv->outline_flag,
-                                                       op->priv->reverse_flag,
-                                                       op->priv->crop_marks_flag,
-                                                       &op->priv->state);
+                        n_labels = gl_print_collated_merge_sheet (label,
+                                                                  cr,
+                                                                  page_nr,
+                                                                  op->priv->n_copies,
+                                                                  op->priv->first,
+                                                                  op->priv->outline_flag,
+                                                                  op->priv->reverse_flag,
+                                                                  op->priv->crop_marks_flag,
+                                                                  state);
                 }
                 else
                 {
-                        gl_print_uncollated_merge_sheet (op->priv->label,
-                                                         cr,
-                                                         page_nr,
-                                                         op->priv->n_copies,
-                                                         op->priv->first,
-                                                         op->priv->outline_flag,
-                                                         op->priv->reverse_flag,
-                                                         op->priv->crop_marks_flag,
-                                                         &op->priv->state);
+                        n_labels = gl_print_uncollated_merge_sheet (label,
+                                                                    cr,
+                                                                    page_nr,
+                                                                    op->priv->n_copies,
+                                                                    op->priv->first,
+                                                                    op->priv->outline_flag,
+                                                                    op->priv->reverse_flag,
+                                                                    op->priv->crop_marks_flag,
+                                                                    state);
                 }
         }
+
+        gl_stats_add_phase (GL_STATS_PHASE_RENDER, &timer);
+
+        return n_labels;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Start worker threads drawing pages of job.                     */
+/*--------------------------------------------------------------------------*/
+static void
+start_workers (glPrintOp *op)
+{
+        gint    n_threads, i;
+        Worker *worker;
+
+        n_threads = MIN (op->priv->n_threads, op->priv->n_sheets);
+
+        op->priv->pages         = g_new0 (cairo_surface_t *, op->priv->n_sheets);
+        op->priv->block_size    = MAX (op->priv->n_sheets / (n_threads * BLOCKS_PER_THREAD),
+                                       BLOCK_MIN_PAGES);
+        op->priv->n_pages_ahead = n_threads * BLOCKS_AHEAD_PER_THREAD * op->priv->block_size;
+        op->priv->next_block    = 0;
+        op->priv->next_page     = 0;
+        op->priv->stop_flag     = FALSE;
+
+        /* Count records once here, rather than in every worker. */
+        if (op->priv->merge_flag)
+        {
+                gl_print_state_count_records (&op->priv->state, op->priv->label);
+        }
+
+        /* Labels are copied here, so that workers never share objects. */
+        op->priv->workers = g_ptr_array_new ();
+        for (i = 0; i < n_threads; i++)
+        {
+                worker = g_new0 (Worker, 1);
+                worker->op     = op;
+                worker->label  = gl_label_dup (op->priv->label);
+                worker->thread = g_thread_new ("glabels-print", worker_thread, worker);
+
+                g_ptr_array_add (op->priv->workers, worker);
+        }
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Stop worker threads, discarding pages not yet drawn.           */
+/*--------------------------------------------------------------------------*/
+static void
+stop_workers (glPrintOp *op)
+{
+        guint   i;
+        gint    page_nr;
+        Worker *worker;
+
+        if (op->priv->workers == NULL)
+        {
+                return;
+        }
+
+        g_mutex_lock (&op->priv->mutex);
+        op->priv->stop_flag = TRUE;
+        g_cond_broadcast (&op->priv->cond);
+        g_mutex_unlock (&op->priv->mutex);
+
+        for (i = 0; i < op->priv->workers->len; i++)
+        {
+                worker = g_ptr_array_index (op->priv->workers, i);
+
+                g_thread_join (worker->thread);
+                g_object_unref (worker->label);
+                g_free (worker);
+        }
+        g_ptr_array_free (op->priv->workers, TRUE);
+        op->priv->workers = NULL;
+
+        for (page_nr = 0; page_nr < op->priv->n_sheets; page_nr++)
+        {
+                if (op->priv->pages[page_nr] != NULL)
+                {
+                        cairo_surface_destroy (op->priv->pages[page_nr]);
+                }
+        }
+        g_free (op->priv->pages);
+        op->priv->pages = NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Worker thread, draws blocks of pages into recording surfaces.  */
+/*                                                                          */
+/* Each block starts with a fresh print state, positioned past the labels   */
+/* of earlier sheets, exactly as if it were the first sheet of a shard.     */
+/*--------------------------------------------------------------------------*/
+static gpointer
+worker_thread (gpointer data)
+{
+        Worker          *worker = data;
+        glPrintOp       *op     = worker->op;
+        glPrintState     state;
+        gint             i_block, first_page, last_page, page_nr;
+        cairo_surface_t *surface;
+        cairo_t         *cr;
+
+        state.i_copy       = 0;
+        state.cursor       = NULL;
+        state.record_start = op->priv->state.record_start;
+        state.record_end   = op->priv->state.record_end;
+        state.first_sheet  = 0;
+        state.n_records    = op->priv->state.n_records;
+
+        for (;;)
+        {
+                g_mutex_lock (&op->priv->mutex);
+                while (!op->priv->stop_flag &&
+                       (op->priv->next_block * op->priv->block_size < op->priv->n_sheets) &&
+                       (op->priv->next_block * op->priv->block_size >= op->priv->next_page + op->priv->n_pages_ahead))
+                {
+                        g_cond_wait (&op->priv->cond, &op->priv->mutex);
+                }
+                if (op->priv->stop_flag ||
+                    (op->priv->next_block * op->priv->block_size >= op->priv->n_sheets))
+                {
+                        g_mutex_unlock (&op->priv->mutex);
+                        break;
+                }
+                i_block = op->priv->next_block++;
+                g_mutex_unlock (&op->priv->mutex);
+
+                first_page = i_block * op->priv->block_size;
+                last_page  = MIN (first_page + op->priv->block_size, op->priv->n_sheets);
+
+                state.first_sheet = op->priv->state.first_sheet + first_page;
+
+                for (page_nr = first_page; page_nr < last_page; page_nr++)
+                {
+                        surface = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+                        cr      = cairo_create (surface);
+                        gl_stats_count (GL_STATS_LABELS,
+                                        draw_sheet (op, worker->label, cr, page_nr - first_page, &state));
+                        cairo_destroy (cr);
+
+                        g_mutex_lock (&op->priv->mutex);
+                        op->priv->pages[page_nr] = surface;
+                        g_cond_broadcast (&op->priv->cond);
+                        g_mutex_unlock (&op->priv->mutex);
+                }
+        }
+
+        gl_print_state_clear (&state);
+
+        return NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Raster worker thread, draws and writes pages or bands of pages.*/
+/*--------------------------------------------------------------------------*/
+static gpointer
+raster_thread (gpointer data)
+{
+        JobWorker       *worker = data;
+        RasterJob       *job    = worker->job;
+        glPrintOp       *op     = job->op;
+        glPrintState     state;
+        gint             i_item, first_page, last_page, page_nr;
+        cairo_surface_t *page;
+        gboolean         last_band_flag;
+
+        state.i_copy       = 0;
+        state.cursor       = NULL;
+        state.record_start = op->priv->state.record_start;
+        state.record_end   = op->priv->state.record_end;
+        state.first_sheet  = 0;
+        state.n_records    = op->priv->state.n_records;
+
+        for (;;)
+        {
+                g_mutex_lock (&job->mutex);
+                i_item = (job->next_item < job->n_items) ? job->next_item++ : -1;
+                g_mutex_unlock (&job->mutex);
+
+                if (i_item < 0)
+                {
+                        break;
+                }
+
+                if (job->n_bands == 1)
+                {
+                        first_page = i_item * job->block_size;
+                        last_page  = MIN (first_page + job->block_size, op->priv->n_sheets);
+
+                        state.first_sheet = op->priv->state.first_sheet + first_page;
+
+                        for (page_nr = first_page; page_nr < last_page; page_nr++)
+                        {
+                                page = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+                                                                   job->width,
+                                                                   job->height);
+                                draw_raster_band (job, worker->label, page, 0, page_nr - first_page, &state);
+                                write_raster_page (job, page, page_nr);
+                                cairo_surface_destroy (page);
+                        }
+                }
+                else
+                {
+                        page_nr = i_item / job->n_bands;
+
+                        state.first_sheet = op->priv->state.first_sheet + page_nr;
+
+                        draw_raster_band (job, worker->label, job->pages[page_nr],
+                                          i_item % job->n_bands, 0, &state);
+
+                        g_mutex_lock (&job->mutex);
+                        last_band_flag = (--job->bands_left[page_nr] == 0);
+                        g_mutex_unlock (&job->mutex);
+
+                        if (last_band_flag)
+                        {
+                                write_raster_page (job, job->pages[page_nr], page_nr);
+                                cairo_surface_destroy (job->pages[page_nr]);
+                                job->pages[page_nr] = NULL;
+                        }
+                }
+        }
+
+        gl_print_state_clear (&state);
+
+        return NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Draw one band of page into its rows of the page image.         */
+/*--------------------------------------------------------------------------*/
+static void
+draw_raster_band (RasterJob       *job,
+                  glLabel         *label,
+                  cairo_surface_t *page,
+                  gint             band,
+                  gint             page_nr,
+                  glPrintState    *state)
+{
+        gint             y0, h, stride, n_labels;
+        cairo_surface_t *surface;
+        cairo_t         *cr;
+
+        y0 = band * job->band_height;
+        h  = MIN (job->band_height, job->height - y0);
+        if (h <= 0)
+        {
+                return;
+        }
+
+        stride  = cairo_image_surface_get_stride (page);
+        surface = cairo_image_surface_create_for_data (cairo_image_surface_get_data (page) + y0 * stride,
+                                                       CAIRO_FORMAT_RGB24,
+                                                       job->width,
+                                                       h,
+                                                       stride);
+        cr = cairo_create (surface);
+
+        cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
+        cairo_paint (cr);
+
+        cairo_translate (cr, 0, -y0);
+        cairo_scale (cr, job->scale, job->scale);
+        n_labels = draw_sheet (job->op, label, cr, page_nr, state);
+        if (band == 0)
+        {
+                /* Every band draws the labels of the page; count them once. */
+                gl_stats_count (GL_STATS_LABELS, n_labels);
+        }
+
+        cairo_destroy (cr);
+        cairo_surface_finish (surface);
+        cairo_surface_destroy (surface);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Write page image to its file.                                  */
+/*--------------------------------------------------------------------------*/
+static void
+write_raster_page (RasterJob       *job,
+                   cairo_surface_t *page,
+                   gint             page_nr)
+{
+        glPrintOp   *op = job->op;
+        gchar       *filename;
+        gboolean     ok;
+        glStatsTimer timer;
+
+        if ( (op->priv->n_sheets == 1) && (op->priv->state.first_sheet == 0) )
+        {
+                filename = g_strdup (job->filename);
+        }
+        else
+        {
+                filename = numbered_filename (job->filename,
+                                              op->priv->state.first_sheet + page_nr + 1);
+        }
+
+        cairo_surface_mark_dirty (page);
+
+        gl_stats_timer_start (&timer);
+        ok = save_image (page, filename);
+        gl_stats_add_phase (GL_STATS_PHASE_FINISH, &timer);
+        gl_stats_count (GL_STATS_PAGES, 1);
+        if (!ok)
+        {
+                g_message ("Cannot export to %s", filename);
+
+                g_mutex_lock (&job->mutex);
+                job->ok = FALSE;
+                g_mutex_unlock (&job->mutex);
+        }
+
+        g_free (filename);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Run worker threads of raster or label job to completion.       */
+/*--------------------------------------------------------------------------*/
+static void
+run_job_workers (glPrintOp   *op,
+                 gint         n_threads,
+                 GThreadFunc  func,
+                 gpointer     job)
+{
+        JobWorker *workers;
+        gint       i;
+
+        workers = g_new0 (JobWorker, MAX (n_threads, 1));
+
+        if (n_threads <= 1)
+        {
+                workers[0].job   = job;
+                workers[0].label = op->priv->label;
+                func (&workers[0]);
+        }
+        else
+        {
+                /* Labels are copied here, so that workers never share objects. */
+                for (i = 0; i < n_threads; i++)
+                {
+                        workers[i].job    = job;
+                        workers[i].label  = gl_label_dup (op->priv->label);
+                        workers[i].thread = g_thread_new ("glabels-export", func, &workers[i]);
+                }
+                for (i = 0; i < n_threads; i++)
+                {
+                        g_thread_join (workers[i].thread);
+                        g_object_unref (workers[i].label);
+                }
+        }
+
+        g_free (workers);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Run label export job over window of records of job.            */
+/*--------------------------------------------------------------------------*/
+static gboolean
+run_label_job (LabelJob *job)
+{
+        glPrintOp *op = job->op;
+        gint       n_records;
+
+        gl_debug (DEBUG_PRINT, "START");
+
+        if (op->priv->merge_flag)
+        {
+                n_records = gl_print_state_count_records (&op->priv->state, op->priv->label);
+
+                if (op->priv->state.record_end)
+                {
+                        n_records = MIN (n_records, op->priv->state.record_end);
+                }
+                job->record_start = op->priv->state.record_start;
+                job->n_records    = MAX (n_records - job->record_start, 0);
+        }
+        else
+        {
+                job->record_start = 0;
+                job->n_records    = 1;
+        }
+
+        if (job->pattern != NULL)
+        {
+                name_labels (job);
+        }
+
+        job->block_size = LABEL_BLOCK_RECORDS;
+        job->n_items    = (job->n_records + job->block_size - 1) / job->block_size;
+        job->next_item  = 0;
+        job->ok         = TRUE;
+        g_mutex_init (&job->mutex);
+
+        run_job_workers (op, MIN (MAX (op->priv->n_threads, 1), job->n_items), label_thread, job);
+
+        g_mutex_clear (&job->mutex);
+        if (job->names != NULL)
+        {
+                g_ptr_array_free (job->names, TRUE);
+                job->names = NULL;
+        }
+
+        gl_debug (DEBUG_PRINT, "END");
+
+        return job->ok;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Label worker thread, writes labels of blocks of records.       */
+/*--------------------------------------------------------------------------*/
+static gpointer
+label_thread (gpointer data)
+{
+        JobWorker     *worker = data;
+        LabelJob      *job    = worker->job;
+        glPrintOp     *op     = job->op;
+        glMerge       *merge;
+        glMergeCursor *cursor = NULL;
+        glMergeRecord *record;
+        gint           i_item, i_record, last_record, i_copy;
+        gboolean       ok     = TRUE;
+
+        if (op->priv->merge_flag)
+        {
+                merge  = gl_label_get_merge (worker->label);
+                cursor = gl_merge_cursor_new (merge);
+                g_object_unref (merge);
+        }
+
+        for (;;)
+        {
+                g_mutex_lock (&job->mutex);
+                i_item = (job->next_item < job->n_items) ? job->next_item++ : -1;
+                g_mutex_unlock (&job->mutex);
+
+                if (i_item < 0)
+                {
+                        break;
+                }
+
+                i_record    = job->record_start + i_item * job->block_size;
+                last_record = MIN (i_record + job->block_size, job->record_start + job->n_records);
+
+                if (cursor != NULL)
+                {
+                        gl_merge_cursor_set_range (cursor, i_record, last_record - i_record);
+                }
+
+                for ( ; i_record < last_record; i_record++)
+                {
+                        record = (cursor != NULL) ? gl_merge_cursor_peek (cursor) : NULL;
+
+                        if ( (cursor == NULL) || ((record != NULL) && record->select_flag) )
+                        {
+                                for (i_copy = 0; i_copy < op->priv->n_copies; i_copy++)
+                                {
+                                        ok = write_label (job, worker->label, record, i_record, i_copy) && ok;
+                                }
+                        }
+
+                        if (cursor != NULL)
+                        {
+                                gl_merge_cursor_next (cursor);
+                        }
+                }
+        }
+
+        if (cursor != NULL)
+        {
+                gl_merge_cursor_free (cursor);
+        }
+
+        if (!ok)
+        {
+                g_mutex_lock (&job->mutex);
+                job->ok = FALSE;
+                g_mutex_unlock (&job->mutex);
+        }
+
+        return NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Draw single label, with its upper left corner at origin.       */
+/*--------------------------------------------------------------------------*/
+static void
+draw_label (glPrintOp     *op,
+            glLabel       *label,
+            cairo_t       *cr,
+            glMergeRecord *record)
+{
+        gdouble w, h;
+
+        cairo_save (cr);
+
+        if (op->priv->reverse_flag)
+        {
+                gl_label_get_size (label, &w, &h);
+                cairo_translate (cr, w, 0.0);
+                cairo_scale (cr, -1.0, 1.0);
+        }
+
+        gl_label_draw (label, cr, FALSE, record);
+
+        cairo_restore (cr);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Draw label and write it to its own file.                       */
+/*--------------------------------------------------------------------------*/
+static gboolean
+write_label (LabelJob      *job,
+             glLabel       *label,
+             glMergeRecord *record,
+             gint           i_record,
+             gint           i_copy)
+{
+        gdouble          w, h;
+        gchar           *filename;
+        cairo_surface_t *surface;
+        cairo_t         *cr;
+        gboolean         ok;
+        glStatsTimer     timer;
+
+        gl_label_get_size (label, &w, &h);
+
+        filename = label_filename (job, record, i_record, i_copy);
+
+        if (job->format == LABEL_FORMAT_VECTOR)
+        {
+                surface = create_vector_surface (filename, w, h, NULL);
+                cr      = cairo_create (surface);
+
+                gl_stats_timer_start (&timer);
+                draw_label (job->op, label, cr, record);
+                gl_stats_add_phase (GL_STATS_PHASE_RENDER, &timer);
+
+                gl_stats_timer_start (&timer);
+                cairo_show_page (cr);
+                cairo_destroy (cr);
+                cairo_surface_finish (surface);
+                ok = (cairo_surface_status (surface) == CAIRO_STATUS_SUCCESS);
+                gl_stats_add_phase (GL_STATS_PHASE_FINISH, &timer);
+        }
+        else
+        {
+                surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+                                                      ceil (w * job->scale),
+                                                      ceil (h * job->scale));
+                if (job->format == LABEL_FORMAT_MONO)
+                {
+                        /* Thresholding would make equal bars differ by a pixel. */
+                        lgl_barcode_render_set_pixel_snap (surface, TRUE);
+                }
+                cr      = cairo_create (surface);
+
+                cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
+                cairo_paint (cr);
+
+                cairo_scale (cr, job->scale, job->scale);
+
+                gl_stats_timer_start (&timer);
+                draw_label (job->op, label, cr, record);
+                cairo_destroy (cr);
+                gl_stats_add_phase (GL_STATS_PHASE_RENDER, &timer);
+
+                gl_stats_timer_start (&timer);
+                if (job->format == LABEL_FORMAT_MONO)
+                {
+                        ok = gl_print_mono_save_pbm (surface, job->dither_flag, filename);
+                }
+                else
+                {
+                        ok = save_image (surface, filename);
+                }
+                gl_stats_add_phase (GL_STATS_PHASE_FINISH, &timer);
+        }
+
+        gl_stats_count (GL_STATS_LABELS, 1);
+        gl_stats_count (GL_STATS_PAGES, 1);
+
+        if (!ok)
+        {
+                g_message ("Cannot export to %s", filename);
+        }
+
+        cairo_surface_destroy (surface);
+        g_free (filename);
+
+        return ok;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Get name of file of copy of label of record.                   */
+/*--------------------------------------------------------------------------*/
+static gchar *
+label_filename (LabelJob      *job,
+                glMergeRecord *record,
+                gint           i_record,
+                gint           i_copy)
+{
+        glPrintOp   *op = job->op;
+        const gchar *name;
+
+        if (job->pattern == NULL)
+        {
+                if ( !op->priv->merge_flag && (op->priv->n_copies == 1) )
+                {
+                        return g_strdup (job->filename);
+                }
+                return numbered_filename (job->filename, i_record * op->priv->n_copies + i_copy + 1);
+        }
+
+        name = g_ptr_array_index (job->names,
+                                  (i_record - job->record_start) * op->priv->n_copies + i_copy);
+
+        return g_strdup (name);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Name copies of labels of job after filename pattern.           */
+/*                                                                          */
+/* Names are worked out in one pass over all records of the merge, before   */
+/* any label is written, so that which of the records expanding to the same */
+/* name gets numbered depends neither on the order workers write them in,   */
+/* nor on the window of records of the job: runs over different windows    */
+/* (e.g. shards) writing to the same directory do not overwrite each        */
+/* other's files.  Names of copies, "name-0001.png" etc., are unique too.   */
+/*--------------------------------------------------------------------------*/
+static void
+name_labels (LabelJob *job)
+{
+        glPrintOp     *op = job->op;
+        glMerge       *merge;
+        glMergeCursor *cursor = NULL;
+        glMergeRecord *record = NULL;
+        GHashTable    *used;
+        gchar        **copies;
+        gchar         *name, *numbered;
+        gint           i, i_copy, n_copies;
+
+        if (op->priv->merge_flag)
+        {
+                merge  = gl_label_get_merge (op->priv->label);
+                cursor = gl_merge_cursor_new (merge);
+                g_object_unref (merge);
+        }
+
+        n_copies   = op->priv->n_copies;
+        job->names = g_ptr_array_new_full (job->n_records * n_copies, g_free);
+        used       = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        copies     = g_new0 (gchar *, n_copies);
+
+        for (i = 0; ; i++)
+        {
+                if (cursor != NULL)
+                {
+                        record = gl_merge_cursor_peek (cursor);
+                        if (record == NULL)
+                        {
+                                break;
+                        }
+                }
+                else if (i > 0)
+                {
+                        break;
+                }
+
+                name = expand_pattern (job, record);
+                while (!name_copies (name, n_copies, used, copies))
+                {
+                        numbered = numbered_filename (name, i + 1);
+                        g_free (name);
+                        name = numbered;
+                }
+                g_free (name);
+
+                for (i_copy = 0; i_copy < n_copies; i_copy++)
+                {
+                        if ( (i >= job->record_start) && (i < job->record_start + job->n_records) )
+                        {
+                                g_ptr_array_add (job->names, g_strdup (copies[i_copy]));
+                        }
+                        g_hash_table_add (used, copies[i_copy]);
+                }
+
+                if (cursor != NULL)
+                {
+                        gl_merge_cursor_next (cursor);
+                }
+        }
+
+        g_free (copies);
+        g_hash_table_destroy (used);
+        if (cursor != NULL)
+        {
+                gl_merge_cursor_free (cursor);
+        }
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Name copies of label after name, FALSE if one is already used. */
+/*--------------------------------------------------------------------------*/
+static gboolean
+name_copies (const gchar *name,
+             gint         n_copies,
+             GHashTable  *used,
+             gchar      **copies)
+{
+        gint     i_copy;
+        gboolean ok = TRUE;
+
+        for (i_copy = 0; i_copy < n_copies; i_copy++)
+        {
+                if (n_copies == 1)
+                {
+                        copies[i_copy] = g_strdup (name);
+                }
+                else
+                {
+                        copies[i_copy] = numbered_filename (name, i_copy + 1);
+                }
+                ok = ok && !g_hash_table_contains (used, copies[i_copy]);
+        }
+
+        if (!ok)
+        {
+                for (i_copy = 0; i_copy < n_copies; i_copy++)
+                {
+                        g_free (copies[i_copy]);
+                        copies[i_copy] = NULL;
+                }
+        }
+
+        return ok;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Expand filename pattern of job for record.                     */
+/*--------------------------------------------------------------------------*/
+static gchar *
+expand_pattern (LabelJob      *job,
+                glMergeRecord *record)
+{
+        GString    *name;
+        GList      *p;
+        glTextNode *text_node;
+        gchar      *text;
+
+        name = g_string_new ("");
+        for (p = job->pattern; p != NULL; p = p->next)
+        {
+                text_node = p->data;
+                text      = gl_text_node_expand (text_node, record);
+                if (text_node->field_flag)
+                {
+                        /*
+                         * Field values must not reach outside the directory,
+                         * nor make names such as "..", hidden files or ones
+                         * taken for command line options.
+                         */
+                        g_strdelimit (text, "/\\", '_');
+                        if ( (text[0] == '.') || (text[0] == '-') )
+                        {
+                                text[0] = '_';
+                        }
+                        else if (text[0] == '\0')
+                        {
+                                g_string_append_c (name, '_');
+                        }
+                }
+                g_string_append (name, text);
+                g_free (text);
+        }
+
+        return g_string_free (name, FALSE);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Insert number before extension of filename, "out-0001.png".    */
+/*--------------------------------------------------------------------------*/
+static gchar *
+numbered_filename (const gchar *filename,
+                   gint         number)
+{
+        const gchar *ext;
+        gchar       *base, *numbered;
+
+        ext = strrchr (filename, '.');
+        if ( (ext == NULL) || (strchr (ext, G_DIR_SEPARATOR) != NULL) )
+        {
+                ext = filename + strlen (filename);
+        }
+        base     = g_strndup (filename, ext - filename);
+        numbered = g_strdup_printf ("%s-%04d%s", base, number, ext);
+        g_free (base);
+
+        return numbered;
+}
+
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Create vector surface of format of filename, PDF by default,   */
+/* writing to out if given.                                                 */
+/*--------------------------------------------------------------------------*/
+static cairo_surface_t *
+create_vector_surface (const gchar *filename,
+                       gdouble      w,
+                       gdouble      h,
+                       OutputFile  *out)
+{
+        cairo_surface_t *surface;
+
+        if (g_str_has_suffix (filename, ".ps"))
+        {
+                surface = out ? cairo_ps_surface_create_for_stream (write_output, out, w, h)
+                        : cairo_ps_surface_create (filename, w, h);
+        }
+        else if (g_str_has_suffix (filename, ".svg"))
+        {
+                surface = out ? cairo_svg_surface_create_for_stream (write_output, out, w, h)
+                        : cairo_svg_surface_create (filename, w, h);
+                /* Multiple pages need SVG 1.2 page sets. */
+                cairo_svg_surface_restrict_to_version (surface, CAIRO_SVG_VERSION_1_2);
+        }
+        else
+        {
+                surface = out ? cairo_pdf_surface_create_for_stream (write_output, out, w, h)
+                        : cairo_pdf_surface_create (filename, w, h);
+        }
+
+        return surface;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Cairo stream write function, counting bytes written to file.   */
+/*--------------------------------------------------------------------------*/
+static cairo_status_t
+write_output (void         *closure,
+              const guchar *data,
+              guint         length)
+{
+        OutputFile *out = closure;
+
+        if (fwrite (data, 1, length, out->fp) != length)
+        {
+                return CAIRO_STATUS_WRITE_ERROR;
+        }
+        out->n_bytes += length;
+
+        return CAIRO_STATUS_SUCCESS;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Save RGB24 image surface as TIFF (".tif", ".tiff") or PNG.     */
+/*--------------------------------------------------------------------------*/
+static gboolean
+save_image (cairo_surface_t *surface,
+            const gchar     *filename)
+{
+        GdkPixbuf *pixbuf;
+        gboolean   ok;
+
+        if (g_str_has_suffix (filename, ".tif") || g_str_has_suffix (filename, ".tiff"))
+        {
+                pixbuf = gdk_pixbuf_get_from_surface (surface, 0, 0,
+                                                      cairo_image_surface_get_width (surface),
+                                                      cairo_image_surface_get_height (surface));
+                ok = gdk_pixbuf_save (pixbuf, filename, "tiff", NULL, NULL);
+                g_object_unref (pixbuf);
+        }
+        else
+        {
+                ok = (cairo_surface_write_to_png (surface, filename) == CAIRO_STATUS_SUCCESS);
+        }
+
+        return ok;
 }
 
 
@@ -87,6 +87,19 @@ void               gl_print_op_set_reverse_flag    (glPrintOp         *print_op,
                                                     gboolean           reverse_flag);
 void               gl_print_op_set_crop_marks_flag (glPrintOp         *print_op,
                                                     gboolean           crop_marks_flag);
+void               gl_print_op_set_record_range    (glPrintOp         *print_op,
+                                                    gint               record_start,
+                                                    gint               record_end);
+void               gl_print_op_set_first_sheet     (glPrintOp         *print_op,
+                                                    gint               first_sheet);
+void               gl_print_op_set_n_records       (glPrintOp         *print_op,
+                                                    gint               n_records);
+void               gl_print_op_set_pages_per_file  (glPrintOp         *print_op,
+                                                    gint               pages_per_file);
+void               gl_print_op_set_max_file_size   (glPrintOp         *print_op,
+                                                    goffset            max_file_size);
+void               gl_print_op_set_n_threads       (glPrintOp         *print_op,
+                                                    gint               n_threads);
 
 gchar             *gl_print_op_get_filename        (glPrintOp         *print_op);
 gint               gl_print_op_get_n_sheets        (glPrintOp         *print_op);
@@ -98,6 +111,18 @@ gboolean           gl_print_op_get_outline_flag    (glPrintOp         *print_op)
 gboolean           gl_print_op_get_reverse_flag    (glPrintOp         *print_op);
 gboolean           gl_print_op_get_crop_marks_flag (glPrintOp         *print_op);
 
+gboolean           gl_print_op_export              (glPrintOp         *print_op,
+                                                    const gchar       *filename);
+
+gboolean           gl_print_op_export_raster       (glPrintOp         *print_op,
+                                                    const gchar       *filename,
+                                                    gdouble            dpi);
+
+gboolean           gl_print_op_export_labels       (glPrintOp         *print_op,
+                                                    const gchar       *filename,
+                                                    gdouble            dpi,
+                                                    gboolean           dither_flag);
+
 void               gl_print_op_force_outline       (glPrintOp         *print_op);
 gboolean           gl_print_op_is_outline_forced   (glPrintOp         *print_op);
 
@@ -74,6 +74,12 @@ static void       print_info_free             (PrintInfo       **pi);
 
 static void       print_crop_marks            (PrintInfo        *pi);
 
+static gint       print_state_start           (glPrintState     *state,
+					       glLabel          *label,
+					       gint              n_copies,
+					       gint              first,
+					       gboolean          collate_flag);
+
 static void       print_label                 (PrintInfo        *pi,
 					       glLabel          *label,
 					       gdouble           x,
@@ -91,9 +97,9 @@ static void       clip_to_outline             (PrintInfo        *pi,
 
 
 /*****************************************************************************/
-/* Print simple sheet (no merge data) command.                               */
+/* Print simple sheet (no merge data) command, returning number of labels.   */
 /*****************************************************************************/
-void
+gint
 gl_print_simple_sheet (glLabel          *label,
                        cairo_t          *cr,
                        gint              page,
@@ -133,13 +139,15 @@ gl_print_simple_sheet (glLabel          *label,
 	print_info_free (&pi);
 
 	gl_debug (DEBUG_PRINT, "END");
+
+        return MAX (last - first + 1, 0);
 }
 
 
 /*****************************************************************************/
-/* Print collated merge sheet command                                        */
+/* Print collated merge sheet command, returning number of labels.           */
 /*****************************************************************************/
-void
+gint
 gl_print_collated_merge_sheet   (glLabel          *label,
                                  cairo_t          *cr,
                                  gint              page,
@@ -150,20 +158,15 @@ gl_print_collated_merge_sheet   (glLabel          *label,
                                  gboolean          crop_marks_flag,
                                  glPrintState     *state)
 {
-	glMerge                   *merge;
-	const GList               *record_list;
 	PrintInfo                 *pi;
 	const lglTemplateFrame    *frame;
 	gint                       i_label, n_labels_per_page, i_copy;
+	gint                       n_printed = 0;
 	glMergeRecord             *record;
-	GList                     *p;
 	lglTemplateOrigin         *origins;
 
 	gl_debug (DEBUG_PRINT, "START");
 
-	merge = gl_label_get_merge (label);
-	record_list = gl_merge_get_record_list (merge);
-
 	pi = print_info_new (cr, label);
         frame = (lglTemplateFrame *)pi->template->frames->data;
 
@@ -176,10 +179,7 @@ gl_print_collated_merge_sheet   (glLabel          *label,
 
         if (page == 0)
         {
-                state->i_copy  = 0;
-                state->p_record = (GList *)record_list;
-
-                i_label = first - 1;
+                i_label = print_state_start (state, label, n_copies, first, TRUE);
         }
         else
         {
@@ -187,8 +187,8 @@ gl_print_collated_merge_sheet   (glLabel          *label,
         }
 
 
-	for ( p=(GList *)state->p_record; p!=NULL; p=p->next ) {
-		record = (glMergeRecord *)p->data;
+	for ( ; (record = gl_merge_cursor_peek (state->cursor)) != NULL;
+              gl_merge_cursor_next (state->cursor) ) {
 			
 		if ( record->select_flag ) {
 			for (i_copy = state->i_copy; i_copy < n_copies; i_copy++) {
@@ -198,6 +198,7 @@ gl_print_collated_merge_sheet   (glLabel          *label,
 					     origins[i_label].y,
 					     record,
 					     outline_flag, reverse_flag);
+				n_printed++;
 
 				i_label++;
                                 if (i_label == n_labels_per_page)
@@ -208,13 +209,9 @@ gl_print_collated_merge_sheet   (glLabel          *label,
                                         state->i_copy = (i_copy+1) % n_copies;
                                         if (state->i_copy == 0)
                                         {
-                                                state->p_record = p->next;
-                                        }
-                                        else
-                                        {
-                                                state->p_record = p;
+                                                gl_merge_cursor_next (state->cursor);
                                         }
-                                        return;
+                                        return n_printed;
                                 }
 			}
                         state->i_copy = 0;
@@ -225,13 +222,15 @@ gl_print_collated_merge_sheet   (glLabel          *label,
         print_info_free (&pi);
 
 	gl_debug (DEBUG_PRINT, "END");
+
+        return n_printed;
 }
 
 
 /*****************************************************************************/
-/* Print uncollated merge sheet command                                      */
+/* Print uncollated merge sheet command, returning number of labels.         */
 /*****************************************************************************/
-void
+gint
 gl_print_uncollated_merge_sheet (glLabel          *label,
                                  cairo_t          *cr,
                                  gint              page,
@@ -242,20 +241,15 @@ gl_print_uncollated_merge_sheet (glLabel          *label,
                                  gboolean          crop_marks_flag,
                                  glPrintState     *state)
 {
-	glMerge                   *merge;
-	const GList               *record_list;
 	PrintInfo                 *pi;
 	const lglTemplateFrame    *frame;
 	gint                       i_label, n_labels_per_page, i_copy;
+	gint                       n_printed = 0;
 	glMergeRecord             *record;
-	GList                     *p;
 	lglTemplateOrigin         *origins;
 
 	gl_debug (DEBUG_PRINT, "START");
 
-	merge = gl_label_get_merge (label);
-	record_list = gl_merge_get_record_list (merge);
-
 	pi = print_info_new (cr, label);
         frame = (lglTemplateFrame *)pi->template->frames->data;
 
@@ -268,10 +262,7 @@ gl_print_uncollated_merge_sheet (glLabel          *label,
 
         if (page == 0)
         {
-                state->i_copy  = 0;
-                state->p_record = (GList *)record_list;
-
-                i_label = first - 1;
+                i_label = print_state_start (state, label, n_copies, first, FALSE);
         }
         else
         {
@@ -280,8 +271,8 @@ gl_print_uncollated_merge_sheet (glLabel          *label,
 
 	for (i_copy = state->i_copy; i_copy < n_copies; i_copy++) {
 
-		for ( p=state->p_record; p!=NULL; p=p->next ) {
-			record = (glMergeRecord *)p->data;
+		for ( ; (record = gl_merge_cursor_peek (state->cursor)) != NULL;
+                      gl_merge_cursor_next (state->cursor) ) {
 			
 			if ( record->select_flag ) {
 
@@ -290,6 +281,7 @@ gl_print_uncollated_merge_sheet (glLabel          *label,
 					     origins[i_label].y,
 					     record,
 					     outline_flag, reverse_flag);
+				n_printed++;
 
 				i_label++;
                                 if (i_label == n_labels_per_page)
@@ -297,21 +289,21 @@ gl_print_uncollated_merge_sheet (glLabel          *label,
                                         g_free (origins);
                                         print_info_free (&pi);
 
-                                        state->p_record = p->next;
-                                        if (state->p_record == NULL)
+                                        gl_merge_cursor_next (state->cursor);
+                                        if (gl_merge_cursor_peek (state->cursor) == NULL)
                                         {
-                                                state->p_record = (GList *)record_list;
+                                                gl_merge_cursor_rewind (state->cursor);
                                                 state->i_copy = i_copy + 1;
                                         }
                                         else
                                         {
                                                 state->i_copy = i_copy;
                                         }
-                                        return;
+                                        return n_printed;
                                 }
 			}
 		}
-                state->p_record = (GList *)record_list;
+                gl_merge_cursor_rewind (state->cursor);
 
 	}
 
@@ -319,6 +311,119 @@ gl_print_uncollated_merge_sheet (glLabel          *label,
 	print_info_free (&pi);
 
 	gl_debug (DEBUG_PRINT, "END");
+
+        return n_printed;
+}
+
+
+/*****************************************************************************/
+/* Release resources held by print state.                                    */
+/*****************************************************************************/
+void
+gl_print_state_clear (glPrintState *state)
+{
+        gl_merge_cursor_free (state->cursor);
+        state->cursor = NULL;
+}
+
+
+/*****************************************************************************/
+/* Get number of records of merge of label, counting them only once.         */
+/*                                                                           */
+/* Counting a streaming merge may take a pass over its source, so the count  */
+/* is kept in the state, and states copied from it (e.g. one per worker)     */
+/* start out with it.                                                        */
+/*****************************************************************************/
+gint
+gl_print_state_count_records (glPrintState *state,
+                              glLabel      *label)
+{
+        glMerge *merge;
+
+        if (state->n_records < 0)
+        {
+                merge = gl_label_get_merge (label);
+                state->n_records = merge ? gl_merge_get_record_count (merge) : 0;
+                if (merge)
+                {
+                        g_object_unref (merge);
+                }
+        }
+
+        return state->n_records;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Position print state at first label of first sheet of job.      */
+/*                                                                           */
+/* When earlier sheets of the job are printed by other runs (first_sheet),  */
+/* the cursor and copy are advanced past the labels on those sheets.         */
+/* Returns index of first label position to print on the first sheet.        */
+/*---------------------------------------------------------------------------*/
+static gint
+print_state_start (glPrintState     *state,
+                   glLabel          *label,
+                   gint              n_copies,
+                   gint              first,
+                   gboolean          collate_flag)
+{
+        glMerge                *merge;
+        const lglTemplate      *template;
+        const lglTemplateFrame *frame;
+        gint                    n_skip, n_records;
+
+        merge = gl_label_get_merge (label);
+        if (state->cursor == NULL)
+        {
+                state->cursor = gl_merge_cursor_new (merge);
+        }
+        gl_merge_cursor_set_range (state->cursor,
+                                   state->record_start,
+                                   state->record_end ? state->record_end - state->record_start : -1);
+        state->i_copy = 0;
+
+        if (state->first_sheet == 0)
+        {
+                g_object_unref (merge);
+                return first - 1;
+        }
+
+        template = gl_label_get_template (label);
+        frame    = (lglTemplateFrame *)template->frames->data;
+        n_skip   = state->first_sheet * lgl_template_frame_get_n_labels (frame) - (first - 1);
+
+        /* Labels are only printed for selected records, so skip over those. */
+        if (collate_flag)
+        {
+                gl_merge_cursor_seek_selected (state->cursor, n_skip / n_copies);
+                state->i_copy = n_skip % n_copies;
+        }
+        else
+        {
+                if (gl_merge_get_stream_flag (merge))
+                {
+                        /* Streamed records are always selected. */
+                        n_records = gl_print_state_count_records (state, label) - state->record_start;
+                        if (state->record_end)
+                        {
+                                n_records = MIN (n_records, state->record_end - state->record_start);
+                        }
+                }
+                else
+                {
+                        n_records = gl_merge_cursor_count_selected (state->cursor);
+                }
+                if (n_records > 0)
+                {
+                        gl_merge_cursor_seek_selected (state->cursor, n_skip % n_records);
+                        state->i_copy = n_skip / n_records;
+                }
+        }
+
+        g_object_unref (merge);
+
+        return 0;
 }
 
 
@@ -28,11 +28,18 @@
 G_BEGIN_DECLS
 
 typedef struct {
-	gint   i_copy;
-	GList *p_record;
+	gint           i_copy;
+	glMergeCursor *cursor;
+
+	/* Job window, all zero to print every record from first sheet. */
+	gint           record_start;  /* First merge record (zero based)      */
+	gint           record_end;    /* Last merge record + 1, 0 for no limit */
+	gint           first_sheet;   /* Sheets of job printed by other runs   */
+
+	gint           n_records;     /* Records of merge, -1 until counted    */
 } glPrintState;
 
-void gl_print_simple_sheet           (glLabel          *label,
+gint gl_print_simple_sheet           (glLabel          *label,
 				      cairo_t          *cr,
 				      gint              page,
 				      gint              n_sheets,
@@ -42,7 +49,7 @@ void gl_print_simple_sheet           (glLabel          *label,
 				      gboolean          reverse_flag,
 				      gboolean          crop_marks_flag);
 
-void gl_print_collated_merge_sheet   (glLabel          *label,
+gint gl_print_collated_merge_sheet   (glLabel          *label,
 				      cairo_t          *cr,
 				      gint              page,
 				      gint              n_copies,
@@ -52,7 +59,7 @@ void gl_print_collated_merge_sheet   (glLabel          *label,
 				      gboolean          crop_marks_flag,
 				      glPrintState     *state);
 
-void gl_print_uncollated_merge_sheet (glLabel          *label,
+gint gl_print_uncollated_merge_sheet (glLabel          *label,
 				      cairo_t          *cr,
 				      gint              page,
 				      gint              n_copies,
@@ -62,6 +69,11 @@ void gl_print_uncollated_merge_sheet (glLabel          *label,
 				      gboolean          crop_marks_flag,
 				      glPrintState     *state);
 
+void gl_print_state_clear            (glPrintState     *state);
+
+gint gl_print_state_count_records    (glPrintState     *state,
+				      glLabel          *label);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,344 @@
+/*
+ *  stats.c
+ *  Copyright (C) 2026  gLabels contributors.
+ *
+ *  This file is part of gLabels.
+ *
+ *  gLabels is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gLabels is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gLabels.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "stats.h"
+
+#include <time.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "debug.h"
+
+
+/*===========================================*/
+/* Private types                             */
+/*===========================================*/
+
+typedef struct {
+        gint64  n;
+        gint64  wall;
+        gint64  cpu;
+} Total;
+
+
+/*===========================================*/
+/* Private globals                           */
+/*===========================================*/
+
+/*
+ * Statistics are only gathered once enabled, so that interactive use pays
+ * no more than a test of stats_enabled.  Totals are shared by all threads;
+ * phase and object times are summed over the threads doing the work.
+ */
+static gboolean  stats_enabled = FALSE;
+static gint64    start_wall;
+
+static GMutex    stats_mutex;
+static GMutex    write_mutex;
+static gint64    counters[GL_STATS_N_COUNTERS];
+static Total     phases[GL_STATS_N_PHASES];
+static Total     objects[GL_STATS_N_OBJECTS];
+
+static const gchar *counter_names[GL_STATS_N_COUNTERS] = {
+        "records", "labels", "pages"
+};
+
+static const gchar *phase_names[GL_STATS_N_PHASES] = {
+        "template_db", "merge", "render", "finish"
+};
+
+static const gchar *object_names[GL_STATS_N_OBJECTS] = {
+        "text", "barcode", "image", "shape"
+};
+
+
+/*===========================================*/
+/* Local function prototypes                 */
+/*===========================================*/
+
+static gint64  thread_cpu_time  (void);
+
+static void    append_total     (GString     *json,
+                                 const gchar *name,
+                                 const Total *total,
+                                 gboolean     last_flag);
+
+static void    append_seconds   (GString     *json,
+                                 const gchar *name,
+                                 gint64       usecs);
+
+
+/*****************************************************************************/
+/* Start gathering statistics.                                              */
+/*****************************************************************************/
+void
+gl_stats_enable (void)
+{
+        start_wall    = g_get_monotonic_time ();
+        stats_enabled = TRUE;
+}
+
+
+/*****************************************************************************/
+/* Are statistics being gathered?                                           */
+/*****************************************************************************/
+gboolean
+gl_stats_is_enabled (void)
+{
+        return stats_enabled;
+}
+
+
+/*****************************************************************************/
+/* Add to counter.                                                          */
+/*****************************************************************************/
+void
+gl_stats_count (glStatsCounter counter,
+                gint           n)
+{
+        if (!stats_enabled)
+        {
+                return;
+        }
+
+        g_mutex_lock (&stats_mutex);
+        counters[counter] += n;
+        g_mutex_unlock (&stats_mutex);
+}
+
+
+/*****************************************************************************/
+/* Start timing work of calling thread.                                     */
+/*****************************************************************************/
+void
+gl_stats_timer_start (glStatsTimer *timer)
+{
+        if (!stats_enabled)
+        {
+                return;
+        }
+
+        timer->wall = g_get_monotonic_time ();
+        timer->cpu  = thread_cpu_time ();
+}
+
+
+/*****************************************************************************/
+/* Add time since timer was started to phase.                               */
+/*****************************************************************************/
+void
+gl_stats_add_phase (glStatsPhase        phase,
+                    const glStatsTimer *timer)
+{
+        gint64 wall, cpu;
+
+        if (!stats_enabled)
+        {
+                return;
+        }
+
+        wall = g_get_monotonic_time () - timer->wall;
+        cpu  = thread_cpu_time () - timer->cpu;
+
+        g_mutex_lock (&stats_mutex);
+        phases[phase].n++;
+        phases[phase].wall += wall;
+        phases[phase].cpu  += cpu;
+        g_mutex_unlock (&stats_mutex);
+}
+
+
+/*****************************************************************************/
+/* Add time since timer was started to drawing of object type.              */
+/*****************************************************************************/
+void
+gl_stats_add_object (glStatsObject       object,
+                     const glStatsTimer *timer)
+{
+        gint64 wall, cpu;
+
+        if (!stats_enabled)
+        {
+                return;
+        }
+
+        wall = g_get_monotonic_time () - timer->wall;
+        cpu  = thread_cpu_time () - timer->cpu;
+
+        g_mutex_lock (&stats_mutex);
+        objects[object].n++;
+        objects[object].wall += wall;
+        objects[object].cpu  += cpu;
+        g_mutex_unlock (&stats_mutex);
+}
+
+
+/*****************************************************************************/
+/* Write statistics gathered so far to file, as JSON.                       */
+/*                                                                           */
+/* Besides the counters, phases and objects, the report holds the wall time */
+/* since statistics were enabled, and the CPU time and peak resident set    */
+/* size of the process.  Times are in seconds.                              */
+/*                                                                           */
+/* Threads may write the same file (e.g. after each job of a server), so    */
+/* writes are serialized, and the file ends up with the latest statistics.  */
+/*****************************************************************************/
+gboolean
+gl_stats_write (const gchar  *filename,
+                GError      **error)
+{
+        GString       *json;
+        gint64         user_cpu = 0, system_cpu = 0, peak_rss = 0;
+        gint           i;
+        gboolean       ok;
+#ifdef G_OS_UNIX
+        struct rusage  usage;
+#endif
+
+        gl_debug (DEBUG_PRINT, "START");
+
+        g_mutex_lock (&write_mutex);
+
+#ifdef G_OS_UNIX
+        if (getrusage (RUSAGE_SELF, &usage) == 0)
+        {
+                user_cpu   = usage.ru_utime.tv_sec * G_GINT64_CONSTANT (1000000) + usage.ru_utime.tv_usec;
+                system_cpu = usage.ru_stime.tv_sec * G_GINT64_CONSTANT (1000000) + usage.ru_stime.tv_usec;
+#ifdef __APPLE__
+                peak_rss   = usage.ru_maxrss;               /* bytes */
+#else
+                peak_rss   = usage.ru_maxrss * (gint64)1024; /* kilobytes */
+#endif
+        }
+#endif
+
+        json = g_string_new ("{\n");
+
+        g_mutex_lock (&stats_mutex);
+
+        for (i = 0; i < GL_STATS_N_COUNTERS; i++)
+        {
+                g_string_append_printf (json, "  \"%s\": %" G_GINT64_FORMAT ",\n",
+                                        counter_names[i], counters[i]);
+        }
+
+        g_string_append (json, "  \"phases\": {\n");
+        for (i = 0; i < GL_STATS_N_PHASES; i++)
+        {
+                append_total (json, phase_names[i], &phases[i], i == GL_STATS_N_PHASES - 1);
+        }
+        g_string_append (json, "  },\n");
+
+        g_string_append (json, "  \"objects\": {\n");
+        for (i = 0; i < GL_STATS_N_OBJECTS; i++)
+        {
+                append_total (json, object_names[i], &objects[i], i == GL_STATS_N_OBJECTS - 1);
+        }
+        g_string_append (json, "  },\n");
+
+        g_mutex_unlock (&stats_mutex);
+
+        g_string_append (json, "  \"process\": {");
+        append_seconds (json, "wall", g_get_monotonic_time () - start_wall);
+        g_string_append (json, ",");
+        append_seconds (json, "user_cpu", user_cpu);
+        g_string_append (json, ",");
+        append_seconds (json, "system_cpu", system_cpu);
+        g_string_append_printf (json, ", \"peak_rss_bytes\": %" G_GINT64_FORMAT " }\n", peak_rss);
+
+        g_string_append (json, "}\n");
+
+        ok = g_file_set_contents (filename, json->str, json->len, error);
+
+        g_mutex_unlock (&write_mutex);
+
+        g_string_free (json, TRUE);
+
+        gl_debug (DEBUG_PRINT, "END");
+
+        return ok;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  CPU time of calling thread, microseconds, 0 if not available.   */
+/*---------------------------------------------------------------------------*/
+static gint64
+thread_cpu_time (void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+        struct timespec ts;
+
+        if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        {
+                return ts.tv_sec * G_GINT64_CONSTANT (1000000) + ts.tv_nsec / 1000;
+        }
+#endif
+
+        return 0;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Append total as JSON member.                                    */
+/*---------------------------------------------------------------------------*/
+static void
+append_total (GString     *json,
+              const gchar *name,
+              const Total *total,
+              gboolean     last_flag)
+{
+        g_string_append_printf (json, "    \"%s\": { \"count\": %" G_GINT64_FORMAT ",",
+                                name, total->n);
+        append_seconds (json, "wall", total->wall);
+        g_string_append (json, ",");
+        append_seconds (json, "cpu", total->cpu);
+        g_string_append (json, last_flag ? " }\n" : " },\n");
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* PRIVATE.  Append microseconds as JSON member in seconds.                  */
+/*---------------------------------------------------------------------------*/
+static void
+append_seconds (GString     *json,
+                const gchar *name,
+                gint64       usecs)
+{
+        gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+        g_ascii_formatd (buf, sizeof (buf), "%.6f", usecs / 1e6);
+        g_string_append_printf (json, " \"%s\": %s", name, buf);
+}
+
+
+
+/*
+ * Local Variables:       -- emacs
+ * mode: C                -- emacs
+ * c-basic-offset: 8      -- emacs
+ * tab-width: 8           -- emacs
+ * indent-tabs-mode: nil  -- emacs
+ * End:                   -- emacs
+ */
@@ -0,0 +1,91 @@
+/*
+ *  stats.h
+ *  Copyright (C) 2026  gLabels contributors.
+ *
+ *  This file is part of gLabels.
+ *
+ *  gLabels is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gLabels is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gLabels.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+        GL_STATS_RECORDS,
+        GL_STATS_LABELS,
+        GL_STATS_PAGES,
+
+        GL_STATS_N_COUNTERS
+} glStatsCounter;
+
+typedef enum {
+        GL_STATS_PHASE_DB,
+        GL_STATS_PHASE_MERGE,
+        GL_STATS_PHASE_RENDER,
+        GL_STATS_PHASE_FINISH,
+
+        GL_STATS_N_PHASES
+} glStatsPhase;
+
+typedef enum {
+        GL_STATS_OBJECT_TEXT,
+        GL_STATS_OBJECT_BARCODE,
+        GL_STATS_OBJECT_IMAGE,
+        GL_STATS_OBJECT_SHAPE,
+
+        GL_STATS_N_OBJECTS
+} glStatsObject;
+
+typedef struct {
+        gint64  wall;   /* Monotonic time, microseconds. */
+        gint64  cpu;    /* CPU time of calling thread, microseconds. */
+} glStatsTimer;
+
+
+void      gl_stats_enable       (void);
+
+gboolean  gl_stats_is_enabled   (void);
+
+void      gl_stats_count        (glStatsCounter       counter,
+                                 gint                 n);
+
+void      gl_stats_timer_start  (glStatsTimer        *timer);
+
+void      gl_stats_add_phase    (glStatsPhase         phase,
+                                 const glStatsTimer  *timer);
+
+void      gl_stats_add_object   (glStatsObject        object,
+                                 const glStatsTimer  *timer);
+
+gboolean  gl_stats_write        (const gchar         *filename,
+                                 GError             **error);
+
+G_END_DECLS
+
+#endif
+
+
+
+/*
+ * Local Variables:       -- emacs
+ * mode: C                -- emacs
+ * c-basic-offset: 8      -- emacs
+ * tab-width: 8           -- emacs
+ * indent-tabs-mode: nil  -- emacs
+ * End:                   -- emacs
+ */
@@ -1946,6 +1946,7 @@ print_test_cb (glTemplateDesigner      *dialog)
                                  GTK_WINDOW (dialog),
                                  NULL);
 
+	g_object_unref (G_OBJECT(print_op));
 	lgl_template_free (template);
 	g_object_unref (G_OBJECT(label));
 }
@@ -36,6 +36,9 @@
 static glTextNode *extract_text_node  (const gchar         *text,
 				       gint                *n);
 
+static gchar      *eval_field         (const glTextNode    *text_node,
+				       const glMergeRecord *record);
+
 static gboolean    is_empty_field     (const glTextNode    *text_node,
 				       const glMergeRecord *record);
 
@@ -53,7 +56,7 @@ gl_text_node_expand (const glTextNode    *text_node,
 		if (record == NULL) {
 			return g_strdup_printf ("${%s}", text_node->data);
 		} else {
-			text = gl_merge_eval_key (record, text_node->data);
+			text = eval_field (text_node, record);
 			if (text != NULL) {
 				return text;
 			} else {
@@ -66,6 +69,21 @@ gl_text_node_expand (const glTextNode    *text_node,
 }
 
 
+/*--------------------------------------------------------------------------*/
+/* PRIVATE.  Evaluate field node for record, by column if resolved.         */
+/*--------------------------------------------------------------------------*/
+static gchar *
+eval_field (const glTextNode    *text_node,
+	    const glMergeRecord *record)
+{
+	if ( (text_node->store != NULL) && (text_node->store == record->store) ) {
+		return gl_merge_eval_column (record, text_node->column);
+	} else {
+		return gl_merge_eval_key (record, text_node->data);
+	}
+}
+
+
 /*--------------------------------------------------------------------------*/
 /* PRIVATE.  Is node a field that evaluates empty?                          */
 /*--------------------------------------------------------------------------*/
@@ -77,7 +95,7 @@ is_empty_field (const glTextNode    *text_node,
 	gboolean  ret = FALSE;
 
 	if ( (record != NULL) && text_node->field_flag) {
-		text = gl_merge_eval_key (record, text_node->data);
+		text = eval_field (text_node, record);
 		if ( (text == NULL) || (text[0] == 0) ) {
 			ret = TRUE;
 		}
@@ -175,6 +193,29 @@ gl_text_node_free (glTextNode **text_node)
 }
 
 
+/****************************************************************************/
+/* Resolve field of node to a column of merge's store.                      */
+/*                                                                          */
+/* Resolved nodes evaluate records of that store without looking up their   */
+/* key, so resolve once per job, holding a reference to merge meanwhile.    */
+/* Copies of nodes are not resolved.                                        */
+/****************************************************************************/
+void
+gl_text_node_resolve (glTextNode    *text_node,
+		      const glMerge *merge)
+{
+	text_node->store  = NULL;
+	text_node->column = -1;
+
+	if ( text_node->field_flag ) {
+		text_node->column = gl_merge_get_key_column (merge, text_node->data);
+		if ( text_node->column >= 0 ) {
+			text_node->store = gl_merge_get_store (merge);
+		}
+	}
+}
+
+
 /****************************************************************************/
 /* Compare 2 text nodes for equality.                                       */
 /****************************************************************************/
@@ -316,6 +357,25 @@ gl_text_node_lines_dup (GList *src_lines)
 }
 
 
+/****************************************************************************/
+/* Resolve fields of text lines to columns of merge's store.                */
+/****************************************************************************/
+void
+gl_text_node_lines_resolve (GList         *lines,
+			    const glMerge *merge)
+{
+	GList *p_line, *p_node;
+
+	for (p_line = lines; p_line != NULL; p_line = p_line->next)
+        {
+		for (p_node = (GList *) p_line->data; p_node != NULL; p_node = p_node->next)
+                {
+			gl_text_node_resolve ((glTextNode *)p_node->data, merge);
+		}
+	}
+}
+
+
 /****************************************************************************/
 /* Free a list of text lines.                                               */
 /****************************************************************************/
@@ -29,6 +29,10 @@ G_BEGIN_DECLS
 typedef struct {
 	gboolean field_flag;
 	gchar *data;
+
+	/* Column of field, valid for records of store, see gl_text_node_resolve() */
+	const glMergeStore *store;
+	gint                column;
 } glTextNode;
 
 gchar      *gl_text_node_expand              (const glTextNode    *text_node,
@@ -36,6 +40,8 @@ gchar      *gl_text_node_expand              (const glTextNode    *text_node,
 glTextNode *gl_text_node_new_from_text       (const gchar         *text);
 glTextNode *gl_text_node_dup                 (const glTextNode    *text_node);
 void        gl_text_node_free                (glTextNode         **text_node);
+void        gl_text_node_resolve             (glTextNode          *text_node,
+					      const glMerge       *merge);
 
 gboolean    gl_text_node_equal               (const glTextNode    *text_node1,
 					      const glTextNode    *text_node2);
@@ -44,6 +50,8 @@ gchar      *gl_text_node_lines_expand        (GList               *lines,
 					      const glMergeRecord *record);
 GList      *gl_text_node_lines_new_from_text (const gchar         *text);
 GList      *gl_text_node_lines_dup           (GList               *lines);
+void        gl_text_node_lines_resolve       (GList               *lines,
+					      const glMerge       *merge);
 void        gl_text_node_lines_free          (GList              **lines);
 
 /* debug function */
@@ -211,6 +211,8 @@ gl_ui_cmd_file_print (GtkAction *action,
                 window->print_settings = gl_print_op_get_settings (GL_PRINT_OP (op));
         }
 
+        g_object_unref (op);
+
         gl_debug (DEBUG_COMMANDS, "END");
 }
 
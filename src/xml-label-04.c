@@ -147,11 +147,11 @@ xml04_parse_media_description (xmlNodePtr node,
 
 	template_name = xmlNodeGetContent (node);
 
-	template = lgl_db_lookup_template_from_name ((gchar *)template_name);
+	template = lgl_db_get_template_from_name ((gchar *)template_name);
 	if (template == NULL) {
 		g_message ("Undefined template \"%s\"", template_name);
 		/* Get a default */
-		template = lgl_db_lookup_template_from_name (NULL);
+		template = lgl_db_get_template_from_name (NULL);
 		ret = FALSE;
 	} else {
 		ret = TRUE;
@@ -159,7 +159,7 @@ xml04_parse_media_description (xmlNodePtr node,
 
 	gl_label_set_template (label, template, FALSE);
 
-	lgl_template_free (template);
+	lgl_template_unref (template);
 	xmlFree (template_name);
 
 	gl_debug (DEBUG_XML, "END");